@@ -1,18 +1,43 @@
 #include <math.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <iostream>
 
 #include <vector>
+#include <atomic>
+#include <memory>
 #include <algorithm>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <Core/Abr.hpp>
 #include <Core/Application.hpp>
+#include <Core/AudioPlayer.hpp>
+#include <Core/AudioSink.hpp>
+#include <Core/Damage.hpp>
+#include <Core/DynamicResolution.hpp>
+#include <Core/GpuFrameQueue.hpp>
+#include <Core/HdrColor.hpp>
+#include <Core/ImageSequence.hpp>
+#include <Core/LiveSource.hpp>
+#include <Core/MediaClock.hpp>
+#include <Core/Playlist.hpp>
+#include <Core/Scrub.hpp>
+#include <Core/SphereMesh.hpp>
+#include <Core/SphereView.hpp>
+#include <Core/StereoReader.hpp>
+#include <Core/TiledPlayer.hpp>
+#include <Core/TiledTexture.hpp>
+#include <Core/UploadRing.hpp>
+#include <Core/UploadThread.hpp>
 #include <Core/VideoReader.hpp>
+#include <Core/VirtualTexture.hpp>
+#include <Core/WorkerThread.hpp>
 
 extern "C" {
     #include <libavcodec/avcodec.h>
@@ -63,12 +88,80 @@ const char* vert_shader =
     "    TexCoords = aTexCoords;\n"
     "}\n";
 
-const char* frag_shader =
+// The sphere is drawn as a fullscreen quad and ray cast per pixel, see
+// raycast_frag_input.
+const char* screen_vert_shader =
     "#version 330 core\n"
-    "out vec4 FragColor;\n"
+    "layout (location = 0) in vec2 aPos;\n"
     "\n"
+    "out vec2 ScreenPos;\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "    gl_Position = vec4(aPos, 0.0, 1.0);\n"
+    "    ScreenPos = aPos;\n"
+    "}\n";
+
+// Fragment shaders below sample the frame at TexCoords, with TexCoordsDx and
+// TexCoordsDy its screen space derivatives. One of these two goes in front
+// of them: the texture coordinates interpolated across the mesh, or
+// computed exactly for the pixel.
+const char* mesh_frag_input =
+    "#version 330 core\n"
     "in vec2 TexCoords;\n"
     "\n"
+    "#define TexCoordsDx dFdx(TexCoords)\n"
+    "#define TexCoordsDy dFdy(TexCoords)\n";
+
+// The pixel's ray, rebuilt from the inverse view projection, hits the unit
+// sphere of model space from the inside (the far root, the sphere is seen
+// from within or through its front). The equirect coordinates of the hit
+// are exact, without seams, pole pinching or interpolation error. Their
+// derivatives are taken before any pixel is discarded, and unwrapped where
+// u jumps from 1 back to 0, so the shader's texture() calls, which go
+// through textureGrad, don't pick a coarse level along the seam.
+const char* raycast_frag_input =
+    "#version 330 core\n"
+    "in vec2 ScreenPos;\n"
+    "\n"
+    "uniform mat4 inverse_mvp;\n"
+    "\n"
+    "vec2 TexCoords;\n"
+    "vec2 TexCoordsDx;\n"
+    "vec2 TexCoordsDy;\n"
+    "\n"
+    "void shade();\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "    vec4 near_point = inverse_mvp * vec4(ScreenPos, -1.0, 1.0);\n"
+    "    vec4 far_point = inverse_mvp * vec4(ScreenPos, 1.0, 1.0);\n"
+    "    vec3 origin = near_point.xyz / near_point.w;\n"
+    "    vec3 direction = normalize(far_point.xyz / far_point.w - origin);\n"
+    "\n"
+    "    float b = dot(origin, direction);\n"
+    "    float discriminant = b * b - dot(origin, origin) + 1.0;\n"
+    "    float t = -b + sqrt(max(discriminant, 0.0));\n"
+    "    vec3 hit = origin + t * direction;\n"
+    "\n"
+    "    const float pi = 3.14159265358979;\n"
+    "    TexCoords = vec2(fract(atan(hit.y, hit.x) / (2.0 * pi)), 0.5 - asin(clamp(hit.z, -1.0, 1.0)) / pi);\n"
+    "    TexCoordsDx = dFdx(TexCoords);\n"
+    "    TexCoordsDy = dFdy(TexCoords);\n"
+    "    TexCoordsDx.x -= round(TexCoordsDx.x);\n"
+    "    TexCoordsDy.x -= round(TexCoordsDy.x);\n"
+    "\n"
+    "    if (discriminant < 0.0 || t < 0.0)\n"
+    "        discard;\n"
+    "    shade();\n"
+    "}\n"
+    "\n"
+    "#define main shade\n"
+    "#define texture(sampler, coords) textureGrad(sampler, coords, TexCoordsDx, TexCoordsDy)\n";
+
+const char* frag_shader =
+    "out vec4 FragColor;\n"
+    "\n"
     "uniform sampler2D tex;\n"
     "\n"
     "void main()\n"
@@ -76,6 +169,191 @@ const char* frag_shader =
     "    FragColor = texture(tex, TexCoords);\n"
     "}\n";
 
+// Second pass of dynamic resolution: the scene drawn at a lower resolution,
+// in the lower left of its render target, stretched over the window with
+// bilinear filtering. Sampling stays half a texel inside the part drawn, so
+// what is left in the rest of the target from larger frames never bleeds in.
+const char* upscale_frag_shader =
+    "out vec4 FragColor;\n"
+    "\n"
+    "uniform sampler2D tex;\n"
+    "uniform vec2 source_scale;\n"
+    "uniform vec2 source_texel;\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 coords = clamp(TexCoords * source_scale, source_texel * 0.5, source_scale - source_texel * 0.5);\n"
+    "    FragColor = textureLod(tex, coords, 0.0);\n"
+    "}\n";
+
+// Frames over the texture size limit, split into the layers of an array
+// texture by TiledTexture. The layer is picked per fragment, sampling within
+// it is offset by the tile's border. Texels are clamped to the frame as
+// GL_CLAMP_TO_EDGE would, so the borders at the frame's edges, which nothing
+// is copied into, are never read.
+const char* tiled_frame_frag_shader =
+    "out vec4 FragColor;\n"
+    "\n"
+    "uniform sampler2DArray tex;\n"
+    "\n"
+    "uniform vec2 frame_size;\n"
+    "uniform vec2 tile_size;\n"
+    "uniform ivec2 tile_grid;\n"
+    "\n"
+    "const float tile_border = 1.0;\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 texel = clamp(TexCoords * frame_size, vec2(0.5), frame_size - 0.5);\n"
+    "    ivec2 tile = clamp(ivec2(texel / tile_size), ivec2(0), tile_grid - 1);\n"
+    "    vec2 layer_size = tile_size + 2.0 * tile_border;\n"
+    "    vec2 coords = (texel - vec2(tile) * tile_size + tile_border) / layer_size;\n"
+    "    vec2 scale = frame_size / layer_size;\n"
+    "    FragColor = textureGrad(tex, vec3(coords, float(tile.y * tile_grid.x + tile.x)),\n"
+    "                            TexCoordsDx * scale, TexCoordsDy * scale);\n"
+    "}\n";
+
+// High bit depth frames arrive as P010 planes and are converted here, the
+// CPU reference of the same conversion is in HdrColor.cpp.
+const char* hdr_frag_shader =
+    "out vec4 FragColor;\n"
+    "\n"
+    "uniform sampler2D luma_tex;\n"
+    "uniform sampler2D chroma_tex;\n"
+    "\n"
+    "uniform float sample_scale;\n"
+    "uniform float y_offset;\n"
+    "uniform float y_scale;\n"
+    "uniform float c_offset;\n"
+    "uniform float c_scale;\n"
+    "uniform mat3 yuv_to_rgb;\n"
+    "uniform int transfer;\n"
+    "uniform bool bt2020;\n"
+    "uniform float peak_nits;\n"
+    "uniform float sdr_white_nits;\n"
+    "\n"
+    "float pq_to_nits(float e)\n"
+    "{\n"
+    "    const float m1 = 2610.0 / 16384.0;\n"
+    "    const float m2 = 2523.0 / 4096.0 * 128.0;\n"
+    "    const float c1 = 3424.0 / 4096.0;\n"
+    "    const float c2 = 2413.0 / 4096.0 * 32.0;\n"
+    "    const float c3 = 2392.0 / 4096.0 * 32.0;\n"
+    "    float p = pow(max(e, 0.0), 1.0 / m2);\n"
+    "    return 10000.0 * pow(max(p - c1, 0.0) / (c2 - c3 * p), 1.0 / m1);\n"
+    "}\n"
+    "\n"
+    "float hlg_to_scene(float e)\n"
+    "{\n"
+    "    e = max(e, 0.0);\n"
+    "    return e <= 0.5 ? e * e / 3.0 : (exp((e - 0.55991073) / 0.17883277) + 0.28466892) / 12.0;\n"
+    "}\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "    float y = texture(luma_tex, TexCoords).r * sample_scale;\n"
+    "    vec2 c = texture(chroma_tex, TexCoords).rg * sample_scale;\n"
+    "    vec3 rgb = yuv_to_rgb * vec3((y - y_offset) * y_scale, (c - c_offset) * c_scale);\n"
+    "\n"
+    "    if (transfer == 0)\n"
+    "    {\n"
+    "        FragColor = vec4(clamp(rgb, 0.0, 1.0), 1.0);\n"
+    "        return;\n"
+    "    }\n"
+    "\n"
+    "    vec3 nits;\n"
+    "    if (transfer == 1)\n"
+    "        nits = vec3(pq_to_nits(rgb.r), pq_to_nits(rgb.g), pq_to_nits(rgb.b));\n"
+    "    else\n"
+    "    {\n"
+    "        vec3 scene = vec3(hlg_to_scene(rgb.r), hlg_to_scene(rgb.g), hlg_to_scene(rgb.b));\n"
+    "        float luminance = dot(vec3(0.2627, 0.6780, 0.0593), scene);\n"
+    "        nits = 1000.0 * pow(max(luminance, 1e-6), 0.2) * scene;\n"
+    "    }\n"
+    "\n"
+    "    if (bt2020)\n"
+    "        nits = mat3(1.6605, -0.1246, -0.0182, -0.5876, 1.1329, -0.1006, -0.0728, -0.0083, 1.1187) * nits;\n"
+    "\n"
+    "    const float knee = 0.75;\n"
+    "    vec3 x = max(nits, 0.0) / sdr_white_nits;\n"
+    "    float peak = peak_nits / sdr_white_nits;\n"
+    "    float m = max(max(x.r, x.g), x.b);\n"
+    "    if (m > knee && peak > 1.0)\n"
+    "    {\n"
+    "        float t = (m - knee) / (1.0 - knee);\n"
+    "        float t_peak = (peak - knee) / (1.0 - knee);\n"
+    "        x *= (knee + (1.0 - knee) * t * (1.0 + t / (t_peak * t_peak)) / (1.0 + t)) / m;\n"
+    "    }\n"
+    "\n"
+    "    FragColor = vec4(pow(clamp(x, 0.0, 1.0), vec3(1.0 / 2.2)), 1.0);\n"
+    "}\n";
+
+// Frames are scaled down to 1/8 of their size at most before upload.
+#define MAX_DECIMATION 3
+
+// Degrees around the view converted along with it, for the view to turn into.
+#define ROI_GUARD_DEGREES 15.0f
+
+// Seconds the arrow keys move the position by, page up / down ten times as far.
+#define SCRUB_STEP_SECONDS 5.0
+
+// Degrees per second the sphere turns by for every pixel it is dragged.
+#define DRAG_DEGREES_PER_SECOND 0.75f
+
+// Seconds a followed file's live edge may drift from follow_latency behind
+// the clock before the clock is set back to it.
+#define FOLLOW_DRIFT_SECONDS 0.5
+
+// Atlas of 16 x 16 tiles for still panoramas, 4128 x 4128 texels (68 MB).
+#define PANO_ATLAS_SLOTS 16
+
+// Panorama tiles copied into the atlas per frame at most, about 4 MB.
+#define PANO_MAX_UPLOADS 16
+
+// Still panoramas are sampled through a page table: the entry of the page
+// under the fragment, at the detail level its screen footprint calls for,
+// says where in the atlas the tile (or a coarser stand-in) sits. See
+// VirtualTexture.hpp.
+const char* pano_frag_shader =
+    "out vec4 FragColor;\n"
+    "\n"
+    "uniform sampler2D atlas_tex;\n"
+    "uniform sampler2D page_table_tex;\n"
+    "\n"
+    "uniform vec2 virtual_size;\n"
+    "uniform int level_count;\n"
+    "uniform int page_rows[16];\n"
+    "uniform ivec2 page_counts[16];\n"
+    "uniform float atlas_size;\n"
+    "\n"
+    "const float tile_size = 256.0;\n"
+    "const float tile_border = 1.0;\n"
+    "const float slot_size = tile_size + 2.0 * tile_border;\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 texel = TexCoords * virtual_size;\n"
+    "    vec2 dx = TexCoordsDx * virtual_size;\n"
+    "    vec2 dy = TexCoordsDy * virtual_size;\n"
+    "    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-12));\n"
+    "    int level = clamp(int(floor(lod)), 0, level_count - 1);\n"
+    "\n"
+    "    ivec2 page = clamp(ivec2(texel / (tile_size * exp2(float(level)))), ivec2(0), page_counts[level] - 1);\n"
+    "    vec4 entry = texelFetch(page_table_tex, ivec2(page.x, page_rows[level] + page.y), 0) * 255.0;\n"
+    "    if (entry.a < 128.0)\n"
+    "    {\n"
+    "        FragColor = vec4(0.22, 0.24, 0.25, 1.0);\n"
+    "        return;\n"
+    "    }\n"
+    "\n"
+    "    int resident = int(entry.b + 0.5);\n"
+    "    vec2 resident_texel = texel / exp2(float(resident));\n"
+    "    ivec2 resident_page = min(ivec2(resident_texel / tile_size), page_counts[resident] - 1);\n"
+    "    vec2 in_tile = resident_texel - vec2(resident_page) * tile_size;\n"
+    "    vec2 atlas_texel = floor(entry.rg + 0.5) * slot_size + tile_border + in_tile;\n"
+    "    FragColor = textureLod(atlas_tex, atlas_texel / atlas_size, 0.0);\n"
+    "}\n";
+
 void draw_pixel(uint32_t color_tex_id, int x, int y, float r, float g, float b, float a)
 {
     float pixel_data[] = { r, g, b, a };
@@ -86,8 +364,11 @@ void draw_pixel(uint32_t color_tex_id, int x, int y, float r, float g, float b,
     GL_ERR(glBindTexture(GL_TEXTURE_2D, 0))
 }
 
-void init_gpu_program(uint32_t* program_id)
+void init_gpu_program(uint32_t* program_id, const char* frag_source = frag_shader, bool raycast = false)
 {
+    const char* vert_source = raycast ? screen_vert_shader : vert_shader;
+    const char* frag_sources[2] = { raycast ? raycast_frag_input : mesh_frag_input, frag_source };
+
     uint32_t vert_id, frag_id;
 
     int success;
@@ -95,7 +376,7 @@ void init_gpu_program(uint32_t* program_id)
    
     // vertex Shader
     vert_id = glCreateShader(GL_VERTEX_SHADER);
-    GL_ERR(glShaderSource(vert_id, 1, &vert_shader, nullptr))
+    GL_ERR(glShaderSource(vert_id, 1, &vert_source, nullptr))
     GL_ERR(glCompileShader(vert_id))
  
     GL_ERR(glGetShaderiv(vert_id, GL_COMPILE_STATUS, &success))
@@ -107,7 +388,7 @@ void init_gpu_program(uint32_t* program_id)
   
     // fragment Shader
     frag_id = glCreateShader(GL_FRAGMENT_SHADER);
-    GL_ERR(glShaderSource(frag_id, 1, &frag_shader, nullptr))
+    GL_ERR(glShaderSource(frag_id, 2, frag_sources, nullptr))
     GL_ERR(glCompileShader(frag_id))
  
     GL_ERR(glGetShaderiv(frag_id, GL_COMPILE_STATUS, &success))
@@ -201,64 +482,52 @@ void init_framebuffer_object(uint32_t* fbo_id, uint32_t* color_tex_id, uint32_t*
     glBindFramebuffer(GL_FRAMEBUFFER, 0);  
 }
 
-auto generate_uvspehre(int lon_count, int lat_count)
+// Part of the sphere covering [u0, u1] x [v0, v1] of the equirectangular
+// frame, with texture coordinates spanning the whole patch. Indices start at
+// first_index so patches can share one buffer.
+auto generate_uvsphere_patch(int lon_count, int lat_count, float u0, float u1, float v0, float v1, uint32_t first_index)
     -> std::tuple<std::vector<uint32_t>, std::vector<glm::vec3>, std::vector<glm::vec2>>
-{   
+{
     std::vector<uint32_t>  indices;
     std::vector<glm::vec3> vertices;
     std::vector<glm::vec2> tex_coords;
 
-    float lon_step = 2 * M_PI / lon_count;
-    float lat_step = M_PI / lat_count;
-
-    float sectorAngle, stackAngle;
-
-    float x, y, z, xy;
-    float s, t;
-
     for(int i = 0; i <= lat_count; ++i)
     {
-        stackAngle = M_PI / 2 - i * lat_step; 
+        float t = (float)i / lat_count;
+        float stackAngle = M_PI / 2 - (v0 + t * (v1 - v0)) * M_PI;
 
-        xy = 1 * cosf(stackAngle);          
-        z = 1 * sinf(stackAngle);           
+        float xy = cosf(stackAngle);
+        float z = sinf(stackAngle);
 
         for(int j = 0; j <= lon_count; ++j)
         {
-            sectorAngle = j * lon_step;          
-
-            x = xy * cosf(sectorAngle);           
-            y = xy * sinf(sectorAngle);  
-                       
-            vertices.push_back(glm::vec3(x, y, z));
-
-            s = (float)j / lon_count;
-            t = (float)i / lat_count;
+            float s = (float)j / lon_count;
+            float sectorAngle = (u0 + s * (u1 - u0)) * 2 * M_PI;
 
+            vertices.push_back(glm::vec3(xy * cosf(sectorAngle), xy * sinf(sectorAngle), z));
             tex_coords.push_back(glm::vec2(s, t));
         }
     }
 
-    int k1, k2;
+    uint32_t k1, k2;
 
     for(int i = 0; i < lat_count; ++i)
     {
-        k1 = i * (lon_count + 1);     // beginning of current stack
-        k2 = k1 + lon_count + 1;      // beginning of next stack
+        k1 = first_index + i * (lon_count + 1);
+        k2 = k1 + lon_count + 1;
 
         for(int j = 0; j < lon_count; ++j, ++k1, ++k2)
         {
-            // 2 triangles per sector excluding first and last stacks
-            // k1 => k2 => k1+1
-            if(i != 0)
+            // Triangles collapsing onto a pole are left out
+            if(i != 0 || v0 > 0.0f)
             {
                 indices.push_back(k1);
                 indices.push_back(k2);
                 indices.push_back(k1 + 1);
             }
 
-            // k1+1 => k2 => k2+1
-            if(i != (lat_count-1))
+            if(i != (lat_count-1) || v1 < 1.0f)
             {
                 indices.push_back(k1 + 1);
                 indices.push_back(k2);
@@ -270,9 +539,12 @@ auto generate_uvspehre(int lon_count, int lat_count)
     return { indices, vertices, tex_coords };
 }
 
-void render_first_pass(uint32_t fbo_id, uint32_t color_tex_id)
+// The scene is drawn into the lower left width x height of the framebuffer
+// object, which is allocated at the largest size it is drawn at.
+void render_first_pass(uint32_t fbo_id, int width, int height)
 {
     glBindFramebuffer(GL_FRAMEBUFFER, fbo_id);
+    glViewport(0, 0, width, height);
 
     glEnable(GL_DEPTH_TEST);
 
@@ -280,16 +552,29 @@ void render_first_pass(uint32_t fbo_id, uint32_t color_tex_id)
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
-void render_second_pass(uint32_t program_id, uint32_t color_tex_id, uint32_t vao_id)
+// Upscales the part of the color attachment the first pass drew into,
+// source_width x source_height of texture_width x texture_height texels,
+// onto the whole window. The quad covers every pixel, nothing is cleared.
+void render_second_pass(uint32_t program_id, uint32_t color_tex_id, uint32_t vao_id,
+                        int source_width, int source_height, int texture_width, int texture_height,
+                        int window_width, int window_height)
 {
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, window_width, window_height);
 
+    // The screen quad faces the other way than the inside of the sphere.
+    GLboolean cull_face = glIsEnabled(GL_CULL_FACE);
     glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
 
-    glClearColor(1.0f, 1.0f, 1.0f, 1.0f); 
-    glClear(GL_COLOR_BUFFER_BIT);
-    
+    glm::mat4 identity(1.0f);
     glUseProgram(program_id);
+    glUniformMatrix4fv(glGetUniformLocation(program_id, "model_matrix"), 1, GL_FALSE, glm::value_ptr(identity));
+    glUniformMatrix4fv(glGetUniformLocation(program_id, "view_matrix"), 1, GL_FALSE, glm::value_ptr(identity));
+    glUniformMatrix4fv(glGetUniformLocation(program_id, "proj_matrix"), 1, GL_FALSE, glm::value_ptr(identity));
+    glUniform2f(glGetUniformLocation(program_id, "source_scale"),
+        (float)source_width / texture_width, (float)source_height / texture_height);
+    glUniform2f(glGetUniformLocation(program_id, "source_texel"), 1.0f / texture_width, 1.0f / texture_height);
 
     glBindVertexArray(vao_id);
     
@@ -297,8 +582,216 @@ void render_second_pass(uint32_t program_id, uint32_t color_tex_id, uint32_t vao
     glDrawArrays(GL_TRIANGLES, 0, 6);
 
     glBindTexture(GL_TEXTURE_2D, 0);
+    glBindVertexArray(0);
 
     glUseProgram(0); 
+
+    if (cull_face)
+        glEnable(GL_CULL_FACE);
+    glEnable(GL_DEPTH_TEST);
+}
+
+// Uploads rectangles of a frame (rows of frame_width texels) into the bound
+// texture from one slot of the upload ring: they are packed into it and GL
+// copies them from there while the CPU moves on.
+static void upload_slot(UploadRing& ring, const uint8_t* frame, int frame_width, int texel_size,
+                        GLenum format, GLenum type, const VideoRect* rects, int count, size_t size)
+{
+    uint8_t* slot = ring.Acquire(size);
+    if (!slot)
+    {
+        // No mapping, straight from the frame then
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, frame_width);
+        for (int i = 0; i < count; i++)
+            glTexSubImage2D(GL_TEXTURE_2D, 0, rects[i].x, rects[i].y, rects[i].width, rects[i].height, format, type,
+                frame + ((size_t)rects[i].y * frame_width + rects[i].x) * texel_size);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        return;
+    }
+
+    size_t offset = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const VideoRect& rect = rects[i];
+        size_t row_size = (size_t)rect.width * texel_size;
+        const uint8_t* src = frame + ((size_t)rect.y * frame_width + rect.x) * texel_size;
+        if (rect.width == frame_width)
+            memcpy(slot + offset, src, row_size * rect.height);
+        else
+            for (int y = 0; y < rect.height; y++)
+                memcpy(slot + offset + y * row_size, src + (size_t)y * frame_width * texel_size, row_size);
+        offset += row_size * rect.height;
+    }
+
+    ring.Bind();
+    offset = 0;
+    for (int i = 0; i < count; i++)
+    {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, rects[i].x, rects[i].y, rects[i].width, rects[i].height, format, type,
+            (const void*)offset);
+        offset += (size_t)rects[i].width * rects[i].height * texel_size;
+    }
+    ring.Submit();
+}
+
+// Uploads rectangles of a frame through as many slots as they take. A
+// rectangle too large for what is left of a slot is cut into bands of rows.
+void upload_rects(UploadRing& ring, const uint8_t* frame, int frame_width, int texel_size,
+                  GLenum format, GLenum type, const VideoRect* rects, int count)
+{
+    std::vector<VideoRect> bands;
+    size_t size = 0;
+    size_t max_size = ring.GetMaxSize();
+
+    for (int i = 0; i < count; i++)
+    {
+        const VideoRect& rect = rects[i];
+        if (rect.width <= 0 || rect.height <= 0)
+            continue;
+
+        size_t row_size = (size_t)rect.width * texel_size;
+        for (int y = 0; y < rect.height; )
+        {
+            // A row too wide for a whole slot is uploaded on its own, from the frame
+            size_t room = size < max_size ? max_size - size : 0;
+            int rows = (int)std::min(room / row_size, (size_t)(rect.height - y));
+            if (rows == 0 && size > 0)
+            {
+                upload_slot(ring, frame, frame_width, texel_size, format, type, bands.data(), (int)bands.size(), size);
+                bands.clear();
+                size = 0;
+                continue;
+            }
+            rows = std::max(rows, 1);
+
+            VideoRect band = { rect.x, rect.y + y, rect.width, rows };
+            bands.push_back(band);
+            size += row_size * rows;
+            y += rows;
+        }
+    }
+
+    if (!bands.empty())
+        upload_slot(ring, frame, frame_width, texel_size, format, type, bands.data(), (int)bands.size(), size);
+}
+
+void set_hdr_uniforms(uint32_t program_id, const HdrParams& params)
+{
+    glUniform1i(glGetUniformLocation(program_id, "luma_tex"), 0);
+    glUniform1i(glGetUniformLocation(program_id, "chroma_tex"), 1);
+    glUniform1f(glGetUniformLocation(program_id, "sample_scale"), params.sample_scale);
+    glUniform1f(glGetUniformLocation(program_id, "y_offset"), params.y_offset);
+    glUniform1f(glGetUniformLocation(program_id, "y_scale"), params.y_scale);
+    glUniform1f(glGetUniformLocation(program_id, "c_offset"), params.c_offset);
+    glUniform1f(glGetUniformLocation(program_id, "c_scale"), params.c_scale);
+    glUniformMatrix3fv(glGetUniformLocation(program_id, "yuv_to_rgb"), 1, GL_FALSE, glm::value_ptr(params.yuv_to_rgb));
+    glUniform1i(glGetUniformLocation(program_id, "transfer"), params.transfer);
+    glUniform1i(glGetUniformLocation(program_id, "bt2020"), params.bt2020);
+    glUniform1f(glGetUniformLocation(program_id, "peak_nits"), params.peak_nits);
+    glUniform1f(glGetUniformLocation(program_id, "sdr_white_nits"), params.sdr_white_nits);
+}
+
+void set_pano_uniforms(uint32_t program_id, const VirtualTextureState& pano)
+{
+    GLint page_rows[VT_MAX_LEVELS];
+    GLint page_counts[VT_MAX_LEVELS * 2];
+    for (int i = 0; i < pano.level_count; i++)
+    {
+        page_rows[i] = pano.levels[i].page_row;
+        page_counts[i * 2] = pano.levels[i].columns;
+        page_counts[i * 2 + 1] = pano.levels[i].rows;
+    }
+
+    glUniform1i(glGetUniformLocation(program_id, "atlas_tex"), 0);
+    glUniform1i(glGetUniformLocation(program_id, "page_table_tex"), 1);
+    glUniform2f(glGetUniformLocation(program_id, "virtual_size"), (float)pano.width, (float)pano.height);
+    glUniform1i(glGetUniformLocation(program_id, "level_count"), pano.level_count);
+    glUniform1iv(glGetUniformLocation(program_id, "page_rows"), pano.level_count, page_rows);
+    glUniform2iv(glGetUniformLocation(program_id, "page_counts"), pano.level_count, page_counts);
+    glUniform1f(glGetUniformLocation(program_id, "atlas_size"), (float)(pano.atlas_slots * VT_SLOT_SIZE));
+}
+
+// Runs the shader conversion of a frame flat into an offscreen framebuffer
+// of the frame's size and compares the result with the CPU reference. Meant
+// for checking drivers (llvmpipe in CI) against HdrColor.cpp. The frame is
+// mapped flat onto the quad, so the mesh variant of the shader is used
+// whichever one draws the sphere.
+bool verify_hdr_conversion(uint32_t luma_tex_id, uint32_t chroma_tex_id,
+                           const HdrParams& params, const uint8_t* frame_data, int width, int height)
+{
+    uint32_t program_id;
+    uint32_t fbo_id, color_tex_id, depth_tex_id;
+    uint32_t quad_vao_id, quad_vbo_id;
+    float* quad_vertices;
+
+    init_gpu_program(&program_id, hdr_frag_shader);
+    init_framebuffer_object(&fbo_id, &color_tex_id, &depth_tex_id, width, height);
+    init_screen_quad(&quad_vao_id, &quad_vbo_id, &quad_vertices);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLboolean cull_face = glIsEnabled(GL_CULL_FACE);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo_id);
+    glViewport(0, 0, width, height);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+
+    glm::mat4 identity(1.0f);
+    glUseProgram(program_id);
+    glUniformMatrix4fv(glGetUniformLocation(program_id, "model_matrix"), 1, GL_FALSE, glm::value_ptr(identity));
+    glUniformMatrix4fv(glGetUniformLocation(program_id, "view_matrix"), 1, GL_FALSE, glm::value_ptr(identity));
+    glUniformMatrix4fv(glGetUniformLocation(program_id, "proj_matrix"), 1, GL_FALSE, glm::value_ptr(identity));
+    set_hdr_uniforms(program_id, params);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, chroma_tex_id);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, luma_tex_id);
+
+    glBindVertexArray(quad_vao_id);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glBindVertexArray(0);
+
+    // The quad puts texture row 0 (the top of the frame) at the bottom,
+    // where glReadPixels starts, so rows come back in frame order
+    std::vector<uint8_t> gpu((size_t)width * height * 4);
+    std::vector<uint8_t> cpu((size_t)width * height * 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, gpu.data());
+    hdr_convert_frame(params, frame_data, width, height, cpu.data());
+
+    int max_error = 0;
+    double error_sum = 0.0;
+    for (size_t i = 0; i < gpu.size(); i++)
+    {
+        if (i % 4 == 3)
+            continue;
+        int error = abs((int)gpu[i] - (int)cpu[i]);
+        max_error = std::max(max_error, error);
+        error_sum += error;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glEnable(GL_DEPTH_TEST);
+    if (cull_face)
+        glEnable(GL_CULL_FACE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+
+    glDeleteProgram(program_id);
+    glDeleteFramebuffers(1, &fbo_id);
+    glDeleteTextures(1, &color_tex_id);
+    glDeleteTextures(1, &depth_tex_id);
+    glDeleteVertexArrays(1, &quad_vao_id);
+    glDeleteBuffers(1, &quad_vbo_id);
+    delete[] quad_vertices;
+
+    // A step of rounding and float precision differences are expected
+    bool passed = max_error <= 2;
+    printf("hdr verify: max error %d/255, mean error %.3f/255 over %dx%d: %s\n",
+        max_error, error_sum / (width * height * 3.0), width, height, passed ? "PASS" : "FAIL");
+    return passed;
 }
 
 bool load_frame(const char* path, uint8_t** data, uint32_t* width, uint32_t* height)
@@ -425,6 +918,22 @@ void mouse_cursor_callback(GLFWwindow *window, double xpos, double ypos)
     mouse_x_pos = xpos;
     mouse_y_pos = ypos;
 }
+int scrub_steps = 0;                    // Seek steps asked for since the last frame.
+
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    if(action != GLFW_PRESS && action != GLFW_REPEAT)
+        return;
+
+    if(key == GLFW_KEY_RIGHT)
+        scrub_steps += 1;
+    else if(key == GLFW_KEY_LEFT)
+        scrub_steps -= 1;
+    else if(key == GLFW_KEY_PAGE_DOWN)
+        scrub_steps += 10;
+    else if(key == GLFW_KEY_PAGE_UP)
+        scrub_steps -= 10;
+}
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 {
     if(action == GLFW_PRESS)
@@ -438,6 +947,14 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
         mouse_released = true;
     }
 }
+int resized_width = 0;                  // Framebuffer size the window was resized to last, 0 if it wasn't.
+int resized_height = 0;
+
+void resize_callback(GLFWwindow* window, int width, int height)
+{
+    resized_width = width;
+    resized_height = height;
+}
 
 glm::vec2 diff;
 glm::vec2 prev_mouse_pos;
@@ -472,18 +989,49 @@ void mouse_drag_rotate(void)
 int main(int argc, char** args)
 {
     uint32_t gpu_program_id          = 0;   // GPU program ID.
+    uint32_t hdr_program_id          = 0;   // GPU program converting P010 frames.
+    uint32_t pano_program_id         = 0;   // GPU program sampling the panorama virtual texture.
+    uint32_t tiled_program_id        = 0;   // GPU program sampling frames split into tiles.
+    uint32_t upscale_program_id      = 0;   // GPU program stretching the scene over the window.
     uint32_t screen_quad_vao_id      = 0;   // Screen quad vertex array object ID.
     uint32_t screen_quad_vbo_id      = 0;   // Screen quad vertex buffer object ID.
+    float* screen_quad_vertices      = nullptr;
     uint32_t framebuffer_object_id   = 0;   // Framebuffer Object ID.
     uint32_t color_buffer_texture_id = 0;   // Color buffer texture attachment ID.
     uint32_t depth_buffer_texture_id = 0;   // Depth buffer texture attachment ID.
+    int framebuffer_width            = 0;   // Size of the attachments, the largest the scene is drawn at.
+    int framebuffer_height           = 0;
 
     uint32_t uv_sphere_vao_id    = 0;       // UV Sphere vertex array object ID.
     uint32_t uv_sphere_ebo_id    = 0;       // UV Sphere index ebo ID.
-    uint32_t uv_sphere_vx_vbo_id = 0;       // UV Sphere vertex vbo ID.
-    uint32_t uv_sphere_uv_vbo_id = 0;       // UV Sphere texture coordinates vbo ID.
+    uint32_t uv_sphere_vbo_id    = 0;       // UV Sphere interleaved vertex vbo ID.
 
     uint32_t uv_sphere_tex_id = 0;          // UV Sphere texture ID.
+    uint32_t right_eye_tex_id = 0;          // Right eye texture in stereo mode.
+    uint32_t hdr_luma_tex_id   = 0;         // Luma plane of high bit depth frames.
+    uint32_t hdr_chroma_tex_id = 0;         // Chroma plane of high bit depth frames.
+    int hdr_tex_width          = 0;
+    int hdr_tex_height         = 0;
+    bool hdr_frame_shown       = false;     // The planes, not uv_sphere_tex_id, hold the frame.
+    HdrParams hdr_params;
+    bool frame_tiled           = false;     // Frames are over the size limit, frame_tiles holds them.
+    uint32_t pending_tex_id   = 0;          // Texture allocated ahead of a resolution switch.
+    int pending_tex_width     = 0;
+    int pending_tex_height    = 0;
+
+    uint32_t tile_vao_id    = 0;            // Tile patches vertex array object ID.
+    uint32_t tile_ebo_id    = 0;            // Tile patches index ebo ID.
+    uint32_t tile_vx_vbo_id = 0;            // Tile patches vertex vbo ID.
+    uint32_t tile_uv_vbo_id = 0;            // Tile patches texture coordinates vbo ID.
+
+    std::vector<uint32_t> tile_tex_ids;     // One texture per tile.
+
+    uint32_t pano_atlas_tex_id      = 0;    // Tile cache of the still panorama.
+    uint32_t pano_page_table_tex_id = 0;    // Where each panorama tile sits in the atlas.
+    std::vector<ViewFootprint> pano_footprints;
+    std::vector<VtUpload> pano_uploads;
+    std::vector<uint32_t> tile_index_offsets;
+    std::vector<uint32_t> tile_index_counts;
 
     glm::mat4 model = glm::mat4(1.0f);
     glm::mat4 view  = glm::mat4(1.0f);
@@ -495,127 +1043,1059 @@ int main(int argc, char** args)
     float camera_fov     = 45.0f;
     glm::vec3 camera_pos = {0.0f, 0.0f, 15.0f};
 
-    std::vector<uint32_t>  ind;
-    std::vector<glm::vec3> vxs;
-    std::vector<glm::vec2> uvs;
+    SphereMesh sphere_mesh;                 // Levels of detail of the sphere, for --mesh and tiles.
+    SphereMeshDraws sphere_draws;           // Bands of the level in view.
+    uint32_t mesh_time_query_id = 0;        // GPU time of drawing the mesh, if timer queries are there.
    
-    if(argc <= 1 || argc > 2)
+    bool live_mode     = false;             // Low latency live input instead of a playlist.
+    bool wallclock_pts = false;             // Live input pts are sender wall clock timestamps.
+    bool follow_mode   = false;             // Follow a file that is still being written.
+    double follow_latency = 2.0;            // Seconds to stay behind the live edge in follow mode.
+    const char* http_cache_dir = nullptr;   // On-disk chunk cache for http sources.
+    bool abr_mode      = false;             // Input is a manifest of renditions.
+    bool tiled_mode    = false;             // Input is a tile manifest.
+    float tile_margin  = 15.0f;             // Degrees around the view decoded ahead of head movement.
+    bool stereo_mode   = false;             // Input has a video stream per eye, shown side by side.
+    bool sequence_mode = false;             // Input is a numbered image sequence.
+    bool pano_mode     = false;             // Input is a still panorama, shown through a virtual texture.
+    bool scrub_mode    = false;             // Review playback, scrubbing through a low resolution proxy.
+    const char* proxy_path = nullptr;       // Proxy of the input, generated next to it if not given.
+    ScrubOptions scrub_options;             // Time the position has to settle before the master is shown.
+    ImageSequenceOptions sequence_options;  // Frame rate and first number of the image sequence.
+    const char* audio_sink_name = nullptr;  // "null" or a .wav file the audio track is played into.
+    bool hdr_mode      = false;             // Keep 10-bit frames and convert them on the GPU.
+    bool hdr_verify    = false;             // Check the GPU conversion against the CPU reference.
+    bool fit_to_view   = true;              // Convert only the part and resolution of frames the view shows.
+    bool mesh_mode     = false;             // Rasterize the sphere mesh instead of ray casting every pixel.
+    int gpu_queue_depth = 0;                // Frames uploaded ahead of when they are due, 0 for none.
+    bool upload_thread_mode = false;        // Decode and upload queued frames on a thread with a context of its own.
+    int max_texture_size = 0;               // Frames larger than this are split into tiles, 0 for the driver's limit.
+    bool dynamic_resolution_mode = false;   // Draw the scene offscreen at a scale that keeps frames within vsync.
+    float min_render_scale = 0.5f;          // Bounds of that scale, of the window's width and height.
+    float max_render_scale = 1.0f;
+    bool render_thread_mode = false;        // Render on a thread of its own, the main one only handles window events.
+
+    std::vector<const char*> inputs;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(args[i], "--live") == 0)
+            live_mode = true;
+        else if(strcmp(args[i], "--wallclock-pts") == 0)
+            wallclock_pts = true;
+        else if(strcmp(args[i], "--follow") == 0 && i + 1 < argc)
+        {
+            follow_mode = true;
+            follow_latency = atof(args[++i]);
+        }
+        else if(strcmp(args[i], "--abr") == 0)
+            abr_mode = true;
+        else if(strcmp(args[i], "--audio-sink") == 0 && i + 1 < argc)
+            audio_sink_name = args[++i];
+        else if(strcmp(args[i], "--hdr") == 0)
+            hdr_mode = true;
+        else if(strcmp(args[i], "--hdr-verify") == 0)
+            hdr_mode = hdr_verify = true;
+        else if(strcmp(args[i], "--full-res") == 0)
+            fit_to_view = false;
+        else if(strcmp(args[i], "--mesh") == 0)
+            mesh_mode = true;
+        else if(strcmp(args[i], "--gpu-frames") == 0 && i + 1 < argc)
+            gpu_queue_depth = atoi(args[++i]);
+        else if(strcmp(args[i], "--upload-thread") == 0)
+            upload_thread_mode = true;
+        else if(strcmp(args[i], "--max-texture-size") == 0 && i + 1 < argc)
+            max_texture_size = atoi(args[++i]);
+        else if(strcmp(args[i], "--dynamic-resolution") == 0 && i + 2 < argc)
+        {
+            dynamic_resolution_mode = true;
+            min_render_scale = atof(args[++i]);
+            max_render_scale = atof(args[++i]);
+        }
+        else if(strcmp(args[i], "--render-thread") == 0)
+            render_thread_mode = true;
+        else if(strcmp(args[i], "--stereo") == 0)
+            stereo_mode = true;
+        else if(strcmp(args[i], "--tiles") == 0)
+            tiled_mode = true;
+        else if(strcmp(args[i], "--sequence") == 0 && i + 1 < argc)
+        {
+            sequence_mode = true;
+            sequence_options.frame_rate = atof(args[++i]);
+        }
+        else if(strcmp(args[i], "--sequence-start") == 0 && i + 1 < argc)
+            sequence_options.start_number = atoi(args[++i]);
+        else if(strcmp(args[i], "--pano") == 0)
+            pano_mode = true;
+        else if(strcmp(args[i], "--scrub") == 0)
+            scrub_mode = true;
+        else if(strcmp(args[i], "--proxy") == 0 && i + 1 < argc)
+        {
+            scrub_mode = true;
+            proxy_path = args[++i];
+        }
+        else if(strcmp(args[i], "--scrub-settle") == 0 && i + 1 < argc)
+            scrub_options.settle_time = atof(args[++i]);
+        else if(strcmp(args[i], "--tile-margin") == 0 && i + 1 < argc)
+            tile_margin = atof(args[++i]);
+        else if(strcmp(args[i], "--http-cache") == 0 && i + 1 < argc)
+            http_cache_dir = args[++i];
+        else if(strcmp(args[i], "-") == 0)
+            inputs.push_back("pipe:0");
+        else
+            inputs.push_back(args[i]);
+    }
+
+    if(inputs.empty() || ((live_mode || follow_mode || abr_mode || tiled_mode || stereo_mode || sequence_mode || pano_mode || scrub_mode) && inputs.size() > 1))
     {
-        printf("Invalid Arguments\n");
+        printf("Usage: %s [--http-cache <dir>] [--audio-sink <null | wav file>] [--hdr | --hdr-verify] [--full-res] [--mesh] [--gpu-frames <count>] [--upload-thread] [--max-texture-size <texels>] [--dynamic-resolution <min scale> <max scale>] [--render-thread] <video> [video...]\n", args[0]);
+        printf("       %s --live [--wallclock-pts] <url | ->\n", args[0]);
+        printf("       %s --follow <latency seconds> <growing fmp4>\n", args[0]);
+        printf("       %s [--http-cache <dir>] --abr <m3u8 | mpd | rendition list>\n", args[0]);
+        printf("       %s [--audio-sink <null | wav file>] --stereo <video with a stream per eye>\n", args[0]);
+        printf("       %s [--http-cache <dir>] --tiles [--tile-margin <degrees>] <tile manifest>\n", args[0]);
+        printf("       %s --sequence <fps> [--sequence-start <number>] <image pattern, e.g. shot.%%04d.exr>\n", args[0]);
+        printf("       %s --pano <still panorama | tile file>\n", args[0]);
+        printf("       %s [--http-cache <dir>] --scrub | --proxy <proxy video> [--scrub-settle <seconds>] <video>\n", args[0]);
         return 1;
     }
 
-    const char* video_path = args[1];
-    
-    VideoReaderState vr_state;
-    if (!video_reader_open(&vr_state, video_path)){
+    VideoReaderOptions reader_options;
+    reader_options.follow = follow_mode;
+    reader_options.http_cache = http_cache_dir != nullptr;
+    reader_options.http_cache_config.disk_dir = http_cache_dir;
+
+    // Tiles are drawn as patches of the mesh, so tiled playback keeps the mesh.
+    bool raycast = !mesh_mode && !tiled_mode;
+
+    bool playlist_mode = !(live_mode || abr_mode || tiled_mode || stereo_mode || sequence_mode || pano_mode || scrub_mode);
+
+    // Only plain playback draws P010 frames, the other modes expect RGB0.
+    if(hdr_mode && !playlist_mode)
+        printf("High bit depth output is only used for plain playback\n");
+    else
+        reader_options.high_bit_depth = hdr_mode;
+
+    // The upload thread fills the queue.
+    if(upload_thread_mode && gpu_queue_depth == 0)
+        gpu_queue_depth = 3;
+
+    // Queued frames are whole RGB textures, so unchanged tiles can't be
+    // skipped for them, and following a live edge wants frames shown as
+    // soon as they arrive.
+    bool gpu_queue = gpu_queue_depth > 0 && playlist_mode && !follow_mode && !reader_options.high_bit_depth;
+    if(gpu_queue_depth > 0 && !gpu_queue)
+        printf("Frames are only queued on the GPU for plain 8-bit playback\n");
+
+    // Every input is a playlist entry, played back to back.
+    PlaylistState playlist;
+    LiveSourceState live_source;
+    AbrState abr;
+    TiledState tiled;
+    StereoState stereo;
+    ImageSequenceState sequence;
+    VirtualTextureState pano;
+    ScrubState scrub;
+
+    // Plain playback only uploads the tiles of a frame that changed.
+    DamageState damage;
+    std::vector<VideoRect> damage_rects;
+    damage_init(&damage);
+
+    if(live_mode)
+    {
+        if (!live_source_open(&live_source, inputs[0], wallclock_pts)){
+            printf("Couldn't open live input %s\n", inputs[0]);
+            return 1;
+        }
+    }
+    else if(abr_mode)
+    {
+        if (!abr_open(&abr, inputs[0], &reader_options)){
+            printf("Couldn't open renditions of %s\n", inputs[0]);
+            return 1;
+        }
+    }
+    else if(tiled_mode)
+    {
+        if (!tiled_open(&tiled, inputs[0], &reader_options)){
+            printf("Couldn't open tiles of %s\n", inputs[0]);
+            return 1;
+        }
+    }
+    else if(stereo_mode)
+    {
+        if (!stereo_open(&stereo, inputs[0], &reader_options)){
+            printf("Couldn't open both eyes of %s\n", inputs[0]);
+            return 1;
+        }
+    }
+    else if(pano_mode)
+    {
+        // Images are imported into a tile file next to them on first use.
+        std::string tile_path = inputs[0];
+        if (!virtual_texture_probe(inputs[0])) {
+            tile_path += ".vt";
+            if (!virtual_texture_probe(tile_path.c_str()) && !virtual_texture_build(inputs[0], tile_path.c_str())) {
+                printf("Couldn't import %s\n", inputs[0]);
+                return 1;
+            }
+        }
+        if (!virtual_texture_open(&pano, tile_path.c_str(), PANO_ATLAS_SLOTS)){
+            printf("Couldn't open panorama %s\n", tile_path.c_str());
+            return 1;
+        }
+    }
+    else if(sequence_mode)
+    {
+        if (!image_sequence_open(&sequence, inputs[0], &sequence_options)){
+            printf("Couldn't open image sequence %s\n", inputs[0]);
+            return 1;
+        }
+    }
+    else if(scrub_mode)
+    {
+        if (!scrub_open(&scrub, inputs[0], proxy_path, &reader_options, &scrub_options)){
+            printf("Couldn't open %s for review\n", inputs[0]);
+            return 1;
+        }
+    }
+    else if (!playlist_open(&playlist, inputs.data(), inputs.size(), &reader_options)){
         printf("Couldn't open video file (make sure you set a video file that exists)\n");
         return 1;
     }
 
-    constexpr int ALIGNMENT = 128;
-    const int frame_width = vr_state.width;
-    const int frame_height = vr_state.height;
-    uint8_t* frame_data = (uint8_t*)_aligned_malloc(frame_width * frame_height * 4, ALIGNMENT);
+    // The audio track, if played, is the master clock video follows.
+    AudioState audio;
+    AudioSink* audio_sink = nullptr;
+    MediaClock media_clock;
+
+    // Playlist times start at zero, audio runs on the file's own timestamps.
+    double media_offset = 0.0;
+
+    if(audio_sink_name)
+    {
+        if(live_mode || follow_mode || abr_mode || tiled_mode || sequence_mode || pano_mode || scrub_mode || inputs.size() > 1)
+            printf("Audio is only played for a single file or stereo input\n");
+        else
+        {
+            if(strcmp(audio_sink_name, "null") == 0)
+                audio_sink = new NullAudioSink();
+            else
+                audio_sink = new WavAudioSink(audio_sink_name);
+
+            if(audio_open(&audio, inputs[0], audio_sink))
+                media_clock.SetAudio(&audio);
+            else
+            {
+                printf("Playing without audio\n");
+                audio_close(&audio);
+                delete audio_sink;
+                audio_sink = nullptr;
+            }
+        }
+    }
+
+    // A panorama has no frames, its sphere texture is a placeholder.
+    int frame_width = pano_mode ? 1 : live_mode ? live_source.width : abr_mode ? abr.width : tiled_mode ? tiled.width : stereo_mode ? stereo.width :
+                      sequence_mode ? sequence.width : scrub_mode ? scrub.width : playlist.width;
+    int frame_height = pano_mode ? 1 : live_mode ? live_source.height : abr_mode ? abr.height : tiled_mode ? tiled.height : stereo_mode ? stereo.height :
+                       sequence_mode ? sequence.height : scrub_mode ? scrub.height : playlist.height;
+    uint8_t* frame_data = nullptr;
+    uint8_t* right_eye_data = nullptr;
 
-    std::tie(ind, vxs, uvs) = generate_uvspehre(32, 64);
+    // 256 cells around at the finest, 45 degrees at the coarsest.
+    sphere_mesh_build(&sphere_mesh, 256, 4);
+    if(!raycast)
+        printf("mesh: %d levels built in %.1f ms, %d vertices, %d indices\n", (int)sphere_mesh.lods.size(),
+            sphere_mesh.build_time * 1000.0, (int)sphere_mesh.vertices.size(), (int)sphere_mesh.indices.size());
 
     WindowDesc window_desc;
     Application app({3, 2});
 
-    app.OnStart([&]() -> void
+    // Frames reach their textures through pixel buffers, destroyed before the context.
+    UploadRing upload_ring;
+    GpuFrameQueue gpu_frames(gpu_queue_depth);
+    TiledTexture frame_tiles;
+    DynamicResolution dynamic_resolution(min_render_scale, max_render_scale);
+    std::unique_ptr<UploadThread> upload_thread;
+
+    // Target of the first pass of dynamic resolution, at the window size
+    // times the largest scale. Smaller scales draw into part of it.
+    auto allocate_render_target = [&]() -> void
         {
-            // Generate vertex buffer object for vertex positions.
-            GL_ERR(glGenBuffers(1, &uv_sphere_vx_vbo_id))
-            GL_ERR(glBindBuffer(GL_ARRAY_BUFFER, uv_sphere_vx_vbo_id))
-            GL_ERR(glBufferData(GL_ARRAY_BUFFER, vxs.size() * sizeof(glm::vec3), vxs.data(), GL_STATIC_DRAW))
-            GL_ERR(glBindBuffer(GL_ARRAY_BUFFER, 0))
+            if (framebuffer_object_id) {
+                glDeleteFramebuffers(1, &framebuffer_object_id);
+                glDeleteTextures(1, &color_buffer_texture_id);
+                glDeleteTextures(1, &depth_buffer_texture_id);
+            }
+
+            framebuffer_width = std::max((int)ceilf(window_desc.m_window_width * dynamic_resolution.GetMaxScale()), 1);
+            framebuffer_height = std::max((int)ceilf(window_desc.m_window_height * dynamic_resolution.GetMaxScale()), 1);
+            init_framebuffer_object(&framebuffer_object_id, &color_buffer_texture_id, &depth_buffer_texture_id,
+                framebuffer_width, framebuffer_height);
+        };
 
-            // Generate vertex buffer object for texture coordinates.
-            GL_ERR(glGenBuffers(1, &uv_sphere_uv_vbo_id))
-            GL_ERR(glBindBuffer(GL_ARRAY_BUFFER, uv_sphere_uv_vbo_id))
-            GL_ERR(glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), uvs.data(), GL_STATIC_DRAW))
+    app.OnStart([&]() -> void
+        {
+            // Generate vertex buffer object, positions and texture coordinates interleaved.
+            GL_ERR(glGenBuffers(1, &uv_sphere_vbo_id))
+            GL_ERR(glBindBuffer(GL_ARRAY_BUFFER, uv_sphere_vbo_id))
+            GL_ERR(glBufferData(GL_ARRAY_BUFFER, sphere_mesh.vertices.size() * sizeof(SphereVertex), sphere_mesh.vertices.data(), GL_STATIC_DRAW))
             GL_ERR(glBindBuffer(GL_ARRAY_BUFFER, 0))
 
-            // Generate index buffer object.
+            // Generate index buffer object, 16-bit indices of every level.
             GL_ERR(glGenBuffers(1, &uv_sphere_ebo_id))
             GL_ERR(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, uv_sphere_ebo_id))
-            GL_ERR(glBufferData(GL_ELEMENT_ARRAY_BUFFER, ind.size() * sizeof(uint32_t), ind.data(), GL_STATIC_DRAW))
+            GL_ERR(glBufferData(GL_ELEMENT_ARRAY_BUFFER, sphere_mesh.indices.size() * sizeof(uint16_t), sphere_mesh.indices.data(), GL_STATIC_DRAW))
 
             // Generate vertex array object.
             GL_ERR(glGenVertexArrays(1, &uv_sphere_vao_id))
             GL_ERR(glBindVertexArray(uv_sphere_vao_id))
 
-            // Set the layout of vertex positions.
-            GL_ERR(glBindBuffer(GL_ARRAY_BUFFER, uv_sphere_vx_vbo_id))
+            // Set the layout of vertex positions and texture coordinates.
+            GL_ERR(glBindBuffer(GL_ARRAY_BUFFER, uv_sphere_vbo_id))
             GL_ERR(glEnableVertexAttribArray(0))
-            GL_ERR(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0))
-            GL_ERR(glBindBuffer(GL_ARRAY_BUFFER, 0))
-
-            // Set the layout of texture coordinates.
-            GL_ERR(glBindBuffer(GL_ARRAY_BUFFER, uv_sphere_uv_vbo_id))
+            GL_ERR(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SphereVertex), (void*)offsetof(SphereVertex, position)))
             GL_ERR(glEnableVertexAttribArray(1))
-            GL_ERR(glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0))
+            GL_ERR(glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(SphereVertex), (void*)offsetof(SphereVertex, tex_coords)))
             GL_ERR(glBindBuffer(GL_ARRAY_BUFFER, 0))
 
             GL_ERR(glBindVertexArray(0))
 
+            if (!raycast && GLEW_ARB_timer_query)
+                GL_ERR(glGenQueries(1, &mesh_time_query_id))
+
+            // The quad the sphere is ray cast on instead, and the scene is upscaled with.
+            if (raycast || dynamic_resolution_mode)
+                init_screen_quad(&screen_quad_vao_id, &screen_quad_vbo_id, &screen_quad_vertices);
+
+            // The scene is drawn offscreen at a scale of the window that
+            // keeps the GPU within one refresh interval per frame.
+            if (dynamic_resolution_mode) {
+                allocate_render_target();
+
+                const GLFWvidmode* video_mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+                int refresh_rate = video_mode && video_mode->refreshRate > 0 ? video_mode->refreshRate : 60;
+                if (!dynamic_resolution.Init(1.0 / refresh_rate))
+                    printf("Timer queries aren't supported, the scene is drawn at a fixed scale of %.2f\n",
+                        dynamic_resolution.GetMaxScale());
+            }
+
+            // Frames the driver can't hold in one texture are split into
+            // tiles. Stereo pairs and the base layer under tile patches
+            // aren't, they are drawn with textures of their own.
+            GLint driver_max_size;
+            glGetIntegerv(GL_MAX_TEXTURE_SIZE, &driver_max_size);
+            max_texture_size = max_texture_size > 0 ? std::min(max_texture_size, (int)driver_max_size) : driver_max_size;
+            frame_tiled = !stereo_mode && !tiled_mode && TiledTexture::IsNeeded(frame_width, frame_height, max_texture_size);
+            if (frame_tiled) {
+                frame_tiles.Allocate(frame_width, frame_height, max_texture_size);
+                printf("Frames of %dx%d are over the texture size limit (%d), split into %d tiles\n",
+                    frame_width, frame_height, max_texture_size, frame_tiles.GetLayerCount());
+            }
+            if (frame_tiled && gpu_queue) {
+                printf("Frames over the texture size limit aren't queued on the GPU\n");
+                gpu_queue = false;
+            }
+
             // Generate texture for UV Shere.
             glGenTextures(1, &uv_sphere_tex_id);
             glBindTexture(GL_TEXTURE_2D, uv_sphere_tex_id);
             glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, frame_width, frame_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, frame_data);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, frame_tiled ? 1 : frame_width, frame_tiled ? 1 : frame_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
             glBindTexture(GL_TEXTURE_2D, 0);
 
+            if (stereo_mode) {
+                glGenTextures(1, &right_eye_tex_id);
+                glBindTexture(GL_TEXTURE_2D, right_eye_tex_id);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, frame_width, frame_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                glBindTexture(GL_TEXTURE_2D, 0);
+            }
+
+            if (tiled_mode) {
+                // All tile patches share one set of buffers, each drawn as a range of indices.
+                std::vector<uint32_t>  tile_ind;
+                std::vector<glm::vec3> tile_vxs;
+                std::vector<glm::vec2> tile_uvs;
+
+                int columns = tiled.manifest.columns;
+                int rows = tiled.manifest.rows;
+                int lon_count = std::max(2, 32 / columns);
+                int lat_count = std::max(2, 64 / rows);
+
+                for (const Tile& tile : tiled.tiles) {
+                    std::vector<uint32_t>  patch_ind;
+                    std::vector<glm::vec3> patch_vxs;
+                    std::vector<glm::vec2> patch_uvs;
+                    std::tie(patch_ind, patch_vxs, patch_uvs) = generate_uvsphere_patch(lon_count, lat_count,
+                        (float)tile.column / columns, (float)(tile.column + 1) / columns,
+                        (float)tile.row / rows, (float)(tile.row + 1) / rows, tile_vxs.size());
+
+                    tile_index_offsets.push_back(tile_ind.size());
+                    tile_index_counts.push_back(patch_ind.size());
+                    tile_ind.insert(tile_ind.end(), patch_ind.begin(), patch_ind.end());
+                    tile_vxs.insert(tile_vxs.end(), patch_vxs.begin(), patch_vxs.end());
+                    tile_uvs.insert(tile_uvs.end(), patch_uvs.begin(), patch_uvs.end());
+                }
+
+                GL_ERR(glGenVertexArrays(1, &tile_vao_id))
+                GL_ERR(glBindVertexArray(tile_vao_id))
+
+                GL_ERR(glGenBuffers(1, &tile_vx_vbo_id))
+                GL_ERR(glBindBuffer(GL_ARRAY_BUFFER, tile_vx_vbo_id))
+                GL_ERR(glBufferData(GL_ARRAY_BUFFER, tile_vxs.size() * sizeof(glm::vec3), tile_vxs.data(), GL_STATIC_DRAW))
+                GL_ERR(glEnableVertexAttribArray(0))
+                GL_ERR(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0))
+
+                GL_ERR(glGenBuffers(1, &tile_uv_vbo_id))
+                GL_ERR(glBindBuffer(GL_ARRAY_BUFFER, tile_uv_vbo_id))
+                GL_ERR(glBufferData(GL_ARRAY_BUFFER, tile_uvs.size() * sizeof(glm::vec2), tile_uvs.data(), GL_STATIC_DRAW))
+                GL_ERR(glEnableVertexAttribArray(1))
+                GL_ERR(glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0))
+                GL_ERR(glBindBuffer(GL_ARRAY_BUFFER, 0))
+
+                GL_ERR(glGenBuffers(1, &tile_ebo_id))
+                GL_ERR(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, tile_ebo_id))
+                GL_ERR(glBufferData(GL_ELEMENT_ARRAY_BUFFER, tile_ind.size() * sizeof(uint32_t), tile_ind.data(), GL_STATIC_DRAW))
+
+                GL_ERR(glBindVertexArray(0))
+
+                // Edges are clamped so neighbouring tiles don't bleed into each other.
+                tile_tex_ids.resize(tiled.tiles.size());
+                glGenTextures(tile_tex_ids.size(), tile_tex_ids.data());
+                for (size_t i = 0; i < tiled.tiles.size(); ++i) {
+                    glBindTexture(GL_TEXTURE_2D, tile_tex_ids[i]);
+                    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tiled.tiles[i].width, tiled.tiles[i].height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+                }
+                glBindTexture(GL_TEXTURE_2D, 0);
+            }
+
+            if (pano_mode) {
+                glGenTextures(1, &pano_atlas_tex_id);
+                glBindTexture(GL_TEXTURE_2D, pano_atlas_tex_id);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, pano.atlas_slots * VT_SLOT_SIZE, pano.atlas_slots * VT_SLOT_SIZE,
+                    0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+                glGenTextures(1, &pano_page_table_tex_id);
+                glBindTexture(GL_TEXTURE_2D, pano_page_table_tex_id);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, pano.page_width, pano.page_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                glBindTexture(GL_TEXTURE_2D, 0);
+            }
+
             GL_ERR(glFrontFace(GL_CW))
 
             GL_ERR(glPolygonMode(GL_FRONT_AND_BACK, GL_FILL))
 
-            GL_ERR(glEnable(GL_CULL_FACE))
+            // The screen quad faces the other way than the inside of the sphere.
+            if (!raycast)
+                GL_ERR(glEnable(GL_CULL_FACE))
             GL_ERR(glEnable(GL_DEPTH_TEST))
         }
     );
 
     app.Init(window_desc);
 
-    init_gpu_program(&gpu_program_id);
+    // Queued frames are decoded and uploaded on a thread of their own, with
+    // a context sharing the textures with the window's.
+    if(gpu_queue && upload_thread_mode)
+    {
+        GLFWwindow* upload_context = app.CreateSharedContext();
+        if(upload_context)
+            upload_thread.reset(new UploadThread(upload_context));
+        else
+            printf("Couldn't create an upload context, uploading on the render thread\n");
+    }
+
+    init_gpu_program(&gpu_program_id, frag_shader, raycast);
+    init_gpu_program(&tiled_program_id, tiled_frame_frag_shader, raycast);
+    if(hdr_mode)
+        init_gpu_program(&hdr_program_id, hdr_frag_shader, raycast);
+    if(pano_mode)
+        init_gpu_program(&pano_program_id, pano_frag_shader, raycast);
+    if(dynamic_resolution_mode)
+        init_gpu_program(&upscale_program_id, upscale_frag_shader);
 
     app.SetMouseScrollCallback(mouse_scroll_callback);
     app.SetMouseCursorCallback(mouse_cursor_callback);
     app.SetMouseButtonCallback(mouse_button_callback);
+    app.SetKeyboardCallback(key_callback);
+    app.SetResizeCallback(resize_callback);
 
     glm::vec2 curr_angle = glm::vec2(0.0f);
 
+    // Frames are uploaded as soon as they are decoded, ahead of when they
+    // are due. On the render thread the queue is only topped up while the
+    // next frame isn't due yet, so a slow decode or upload eats into the
+    // frames already on the GPU instead of making the next present late.
+    // The upload thread fills it all the way.
+    //
+    // With the upload thread, playlist.current may change or be released
+    // under the render thread at any time: what it reports from the
+    // playlist is copied here, after each read.
+    std::atomic<bool> fill_pending(false);
+    std::mutex queued_cache_mutex;
+    HttpCacheStats queued_cache_stats;
+    bool queued_cache_valid = false;
+    auto fill_gpu_frames = [&](bool until_due) -> void
+        {
+            uint8_t* data;
+            double pt_in_seconds;
+            while (!gpu_frames.IsFull() &&
+                   (!until_due || gpu_frames.GetReadyCount() == 0 || !media_clock.IsRunning() ||
+                    media_clock.Until(gpu_frames.Peek()->time + media_offset) > 0.0)) {
+                if (!playlist_read_frame(&playlist, &data, &pt_in_seconds)) {
+                    if (!playlist.eof) {
+                        printf("Couldn't load video frame\n");
+                    }
+                    break;
+                }
+
+                // Each queued texture last held a frame from a few reads ago,
+                // so it takes the whole frame, never just what changed
+                VideoReaderState* reader = &playlist.current->reader;
+                gpu_frames.Push(playlist.width, playlist.height, pt_in_seconds,
+                    playlist.current->first_pts * av_q2d(reader->time_base));
+                VideoRect whole_frame = { 0, 0, playlist.width, playlist.height };
+                upload_rects(upload_ring, data, playlist.width, 4, GL_RGBA, GL_UNSIGNED_BYTE, &whole_frame, 1);
+                gpu_frames.Commit();
+
+                if (http_cache_dir) {
+                    std::lock_guard<std::mutex> lock(queued_cache_mutex);
+                    queued_cache_valid = video_reader_http_cache_stats(reader, &queued_cache_stats);
+                }
+            }
+            glBindTexture(GL_TEXTURE_2D, 0);
+        };
+
+    // Frames are read one ahead of the one on screen and held until the
+    // media clock reaches them. The render loop doesn't wait for either: it
+    // draws every refresh with the latest input, and the sphere's texture
+    // only changes once the held frame is due. Reading happens on a thread
+    // of its own, so a decode falling behind makes frames late instead of
+    // the render loop. Live frames arrive on a thread already, queued ones
+    // are read by fill_gpu_frames, and tiles are read where they are drawn.
+    // A followed file's reads block until the writer appends to it (up to
+    // the idle timeout), so following always reads here.
+    std::unique_ptr<WorkerThread> decode_thread;
+    if(follow_mode || (!live_mode && !pano_mode && !tiled_mode && !gpu_queue))
+        decode_thread.reset(new WorkerThread());
+
+    std::atomic<bool> frame_reading(false); // The decode thread is reading the next frame.
+    bool frame_read   = false;              // A read was started, its result isn't picked up yet.
+    bool frame_held   = false;              // frame_data holds a frame that isn't due yet.
+    bool read_ok      = false;
+    bool read_eof     = false;
+    double held_time  = 0.0;                // pts of the frame read, in seconds.
+    int held_width    = 0;
+    int held_height   = 0;
+    int64_t render_ticks = 0;               // Frames rendered, video frames presented and of those
+    int64_t video_frames = 0;               // the ones shown a tick or more after they were due,
+    int64_t late_frames  = 0;               // since the last report.
+
+    auto read_frame = [&](int seek_steps) -> void
+        {
+            if (abr_mode) {
+                read_ok = abr_read_frame(&abr, &frame_data, &held_time);
+                read_eof = abr.eof;
+                held_width = abr.width;
+                held_height = abr.height;
+            } else if (tiled_mode) {
+                read_ok = tiled_read_frame(&tiled, &frame_data, &held_time);
+                read_eof = tiled.eof;
+                held_width = tiled.width;
+                held_height = tiled.height;
+            } else if (stereo_mode) {
+                // Both eyes come as one pair, they are never updated separately.
+                read_ok = stereo_read_frame(&stereo, &frame_data, &right_eye_data, &held_time);
+                read_eof = stereo.eof;
+                held_width = stereo.width;
+                held_height = stereo.height;
+            } else if (sequence_mode) {
+                read_ok = image_sequence_read_frame(&sequence, &frame_data, &held_time);
+                read_eof = sequence.eof;
+                held_width = sequence.width;
+                held_height = sequence.height;
+            } else if (scrub_mode) {
+                if (seek_steps != 0) {
+                    scrub_seek(&scrub, seek_steps * SCRUB_STEP_SECONDS);
+                }
+                read_ok = scrub_read_frame(&scrub, &frame_data, &held_time);
+                read_eof = scrub.eof;
+                held_width = scrub.width;
+                held_height = scrub.height;
+            } else {
+                read_ok = playlist_read_frame(&playlist, &frame_data, &held_time);
+                read_eof = playlist.eof;
+                held_width = playlist.width;
+                held_height = playlist.height;
+            }
+        };
+
+    // Starts reading the next frame, unless one is read or held already.
+    // Seeks asked for since the last read go along with it.
+    auto request_frame = [&]() -> void
+        {
+            if (frame_held || frame_read)
+                return;
+
+            int seek_steps = scrub_steps;
+            scrub_steps = 0;
+            frame_read = true;
+            if (!decode_thread) {
+                read_frame(seek_steps);
+                return;
+            }
+
+            frame_reading = true;
+            decode_thread->Post([&read_frame, &frame_reading, seek_steps]() -> void
+                {
+                    read_frame(seek_steps);
+                    frame_reading = false;
+                });
+        };
+
     app.OnUpdate([&]() -> void
         {
-            int64_t pts;
-            if (!video_reader_read_frame(&vr_state, &frame_data, &pts)) {
-                printf("Couldn't load video frame\n");
+            bool has_frame = false;
+            int width, height;
+
+            static double last_tick = glfwGetTime();
+            double tick_time = glfwGetTime() - last_tick;
+            last_tick += tick_time;
+            render_ticks++;
+
+            // Resizes come in through the callback, on this thread either
+            // way. A minimized window has no size, it keeps the last one.
+            if (resized_width > 0 && resized_height > 0 &&
+                (resized_width != window_desc.m_window_width || resized_height != window_desc.m_window_height)) {
+                window_desc.m_window_width = resized_width;
+                window_desc.m_window_height = resized_height;
+                GL_ERR(glViewport(0, 0, resized_width, resized_height))
+                if (dynamic_resolution_mode)
+                    allocate_render_target();
             }
 
-            static bool first_frame = true;
-            if (first_frame) {
-                glfwSetTime(0.0);
-                first_frame = false;
+            static int64_t dropped_events = 0;
+            if (app.GetDroppedEvents() != dropped_events) {
+                dropped_events = app.GetDroppedEvents();
+                printf("%lld window events dropped, the render thread fell behind\n", (long long)dropped_events);
             }
 
-            double pt_in_seconds = pts * (double)vr_state.time_base.num / (double)vr_state.time_base.den;
-            while (pt_in_seconds > glfwGetTime()) {
-                glfwWaitEventsTimeout(pt_in_seconds - glfwGetTime());
+            if (pano_mode) {
+                // A still, the tiles are brought in around the draw below
+            } else if (live_mode) {
+                // Latest frame wins, whatever arrived since the last tick is shown right away.
+                int64_t pts;
+                has_frame = live_source_acquire_frame(&live_source, &frame_data, &pts);
+                width = live_source.width;
+                height = live_source.height;
+            } else {
+                double pt_in_seconds;
+                bool fresh = false;     // the frame wasn't there on the tick before
+
+                if (gpu_queue) {
+                    if (!upload_thread)
+                        fill_gpu_frames(true);
+                    else if (!fill_pending.exchange(true))
+                        upload_thread->Post([&]() -> void { fill_gpu_frames(false); fill_pending = false; });
+
+                    // Failed reads are reported where they happen
+                    const GpuFrame* next = gpu_frames.Peek();
+                    has_frame = fresh = next != nullptr;
+                    pt_in_seconds = has_frame ? next->time : 0.0;
+                    width = has_frame ? next->width : playlist.width;
+                    height = has_frame ? next->height : playlist.height;
+                } else {
+                    request_frame();
+                    if (frame_read && !frame_reading) {
+                        frame_read = false;
+                        frame_held = fresh = read_ok;
+                        if (!read_ok && !read_eof) {
+                            printf("Couldn't load video frame\n");
+                        }
+                    }
+
+                    has_frame = frame_held;
+                    pt_in_seconds = held_time;
+                    width = held_width;
+                    height = held_height;
+                }
+
+                if (fresh && media_clock.IsAudioMaster() && !stereo_mode && media_clock.GetStats().frames == 0) {
+                    media_offset = gpu_queue ? gpu_frames.Peek()->entry_start :
+                                   playlist.current->first_pts * av_q2d(playlist.current->reader.time_base);
+                }
+                double media_time = pt_in_seconds + media_offset;
+
+                // Frames are presented when the media clock reaches them. Without
+                // audio the clock is the wall clock, started on the first frame
+                // and restarted wherever a seek lands.
+                if (fresh && !media_clock.IsAudioMaster() && (!media_clock.IsRunning() || (scrub_mode && scrub.discontinuity))) {
+                    media_clock.Anchor(media_time);
+                }
+
+                // When following a file that is still being written, frames
+                // are fast forwarded until the live edge is reached. From
+                // there on they are shown follow_latency seconds after the
+                // data arrived, so the writer has time to append the next
+                // fragment before it is needed. The clock is anchored on the
+                // first frame at the edge and only set back once the edge
+                // drifts away from that by more than FOLLOW_DRIFT_SECONDS,
+                // the jitter of the writer's appends doesn't move it.
+                static bool at_edge = !follow_mode;
+                if (fresh && follow_mode && playlist.live_edge &&
+                    (!at_edge || fabs(media_clock.Until(media_time) - follow_latency) > FOLLOW_DRIFT_SECONDS)) {
+                    media_clock.Anchor(media_time - follow_latency);
+                    at_edge = true;
+                }
+
+                // A frame that isn't due yet stays held, the sphere is drawn
+                // with the one before. Once the playlist is over the last
+                // frame simply stays on the sphere.
+                if (has_frame && at_edge) {
+                    double remaining = media_clock.IsRunning() ? media_clock.Until(media_time) : 1.0;
+                    if (remaining > 0.0) {
+                        has_frame = false;
+                    } else {
+                        media_clock.Presented(media_time);
+                        video_frames++;
+                        if (-remaining > tick_time)
+                            late_frames++;
+                    }
+                }
+                if (has_frame) {
+                    frame_held = false;
+                }
+
+                // Presenting a queued frame only swaps the texture drawn
+                if (has_frame && gpu_queue) {
+                    const GpuFrame* shown = gpu_frames.Present();
+                    frame_width = shown->width;
+                    frame_height = shown->height;
+
+                    static double last_report = 0.0;
+                    GpuFrameQueueStats queue_stats = gpu_frames.GetStats();
+                    if (glfwGetTime() - last_report > 5.0) {
+                        last_report = glfwGetTime();
+                        printf("gpu queue: %d of %d frames ready at the last present, %d at the fewest\n",
+                            queue_stats.last_ready, gpu_frames.GetDepth(), queue_stats.min_ready);
+                        gpu_frames.ResetMinReady();
+                    }
+                }
+
+                static double last_rate_report = glfwGetTime();
+                double report_time = glfwGetTime() - last_rate_report;
+                if (report_time > 5.0) {
+                    last_rate_report += report_time;
+                    printf("render: %.1f fps, video %.1f fps, %lld frames shown a tick or more late\n",
+                        render_ticks / report_time, video_frames / report_time, (long long)late_frames);
+                    render_ticks = video_frames = late_frames = 0;
+                }
+
+                static double last_drift_report = 0.0;
+                if (media_clock.IsAudioMaster() && glfwGetTime() - last_drift_report > 5.0) {
+                    last_drift_report = glfwGetTime();
+                    const MediaClockStats& clock_stats = media_clock.GetStats();
+                    printf("a/v drift %.1f ms (mean %.1f ms, max %.1f ms)\n",
+                        clock_stats.last_drift * 1000.0, clock_stats.mean_drift * 1000.0, clock_stats.max_drift * 1000.0);
+                }
+
+                // Not while the decode or upload thread reads from it, the
+                // upload thread leaves a copy of the stats
+                VideoReaderState* reader = frame_reading || upload_thread ? nullptr : abr_mode ? &abr.current->reader :
+                                           tiled_mode ? &tiled.base :
+                                           stereo_mode ? &stereo.eyes[0].reader : sequence_mode ? nullptr :
+                                           scrub_mode ? &scrub.master :
+                                           &playlist.current->reader;
+                HttpCacheStats cache_stats;
+                bool cache_valid = false;
+                if (upload_thread) {
+                    std::lock_guard<std::mutex> lock(queued_cache_mutex);
+                    cache_stats = queued_cache_stats;
+                    cache_valid = queued_cache_valid;
+                }
+                static double last_report = 0.0;
+                if (http_cache_dir && (cache_valid || reader) && glfwGetTime() - last_report > 5.0 &&
+                    (cache_valid || video_reader_http_cache_stats(reader, &cache_stats))) {
+                    last_report = glfwGetTime();
+                    printf("http cache: hit ratio %.2f (%lld disk hits), %.1f MiB fetched, %.1f MiB read\n",
+                        cache_stats.HitRatio(), (long long)cache_stats.disk_hits,
+                        cache_stats.bytes_fetched / 1048576.0, cache_stats.bytes_read / 1048576.0);
+                }
             }
 
-            glBindTexture(GL_TEXTURE_2D, uv_sphere_tex_id);
-            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frame_width, frame_height, GL_RGBA, GL_UNSIGNED_BYTE, frame_data);
+            // Allocate the texture for an upcoming rendition switch while
+            // the current one still plays, so the switch doesn't stall.
+            if (abr_mode && !frame_reading && abr.switch_pending &&
+                (abr.pending_width != pending_tex_width || abr.pending_height != pending_tex_height)) {
+                if (!pending_tex_id) {
+                    glGenTextures(1, &pending_tex_id);
+                }
+                pending_tex_width = abr.pending_width;
+                pending_tex_height = abr.pending_height;
+
+                glBindTexture(GL_TEXTURE_2D, pending_tex_id);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, pending_tex_width, pending_tex_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            }
+
+            // Same for the proxy: master and proxy frames take turns while
+            // scrubbing, each in its own texture.
+            if (scrub_mode && !frame_reading && scrub.proxy_width && !pending_tex_id) {
+                glGenTextures(1, &pending_tex_id);
+                pending_tex_width = scrub.proxy_width;
+                pending_tex_height = scrub.proxy_height;
+
+                glBindTexture(GL_TEXTURE_2D, pending_tex_id);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, pending_tex_width, pending_tex_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            }
+
+            bool hdr_frame = has_frame && reader_options.high_bit_depth && playlist.current->reader.high_bit_depth;
+            if (hdr_frame) {
+                // 16-bit planes, normalized by GL: luma as GL_R16, chroma as GL_RG16
+                int chroma_width = (width + 1) / 2;
+                int chroma_height = (height + 1) / 2;
+                if (width != hdr_tex_width || height != hdr_tex_height) {
+                    hdr_tex_width = width;
+                    hdr_tex_height = height;
+                    if (!hdr_luma_tex_id) {
+                        glGenTextures(1, &hdr_luma_tex_id);
+                        glGenTextures(1, &hdr_chroma_tex_id);
+                    }
+
+                    glBindTexture(GL_TEXTURE_2D, hdr_luma_tex_id);
+                    glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, width, height, 0, GL_RED, GL_UNSIGNED_SHORT, nullptr);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+                    glBindTexture(GL_TEXTURE_2D, hdr_chroma_tex_id);
+                    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16, chroma_width, chroma_height, 0, GL_RG, GL_UNSIGNED_SHORT, nullptr);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                }
+
+                // Only the parts the reader converted changed
+                const uint8_t* chroma_data = frame_data + (size_t)width * height * 2;
+                VideoRect chroma_rects[VIDEO_MAX_ROI];
+                for (int i = 0; i < playlist.updated_count; ++i) {
+                    const VideoRect& rect = playlist.updated[i];
+                    chroma_rects[i].x = rect.x / 2;
+                    chroma_rects[i].y = rect.y / 2;
+                    chroma_rects[i].width = (rect.x + rect.width + 1) / 2 - chroma_rects[i].x;
+                    chroma_rects[i].height = (rect.y + rect.height + 1) / 2 - chroma_rects[i].y;
+                }
+
+                glBindTexture(GL_TEXTURE_2D, hdr_luma_tex_id);
+                upload_rects(upload_ring, frame_data, width, 2, GL_RED, GL_UNSIGNED_SHORT, playlist.updated, playlist.updated_count);
+                glBindTexture(GL_TEXTURE_2D, hdr_chroma_tex_id);
+                upload_rects(upload_ring, chroma_data, chroma_width, 4, GL_RG, GL_UNSIGNED_SHORT, chroma_rects, playlist.updated_count);
+                glBindTexture(GL_TEXTURE_2D, 0);
+
+                hdr_params_from_frame(playlist.current->reader.av_frame, &hdr_params);
+                hdr_frame_shown = true;
+
+                static bool verified = false;
+                if (hdr_verify && !verified) {
+                    verified = true;
+                    verify_hdr_conversion(hdr_luma_tex_id, hdr_chroma_tex_id, hdr_params, frame_data, width, height);
+                }
+            } else if (has_frame && !gpu_queue) {
+                hdr_frame_shown = false;
+                VideoRect whole_frame = { 0, 0, width, height };
+                glBindTexture(GL_TEXTURE_2D, uv_sphere_tex_id);
+
+                // Frames over the texture size limit go into the tiles instead
+                auto upload_frame = [&](const VideoRect* rects, int count) -> void
+                {
+                    if (frame_tiled)
+                        frame_tiles.Upload(upload_ring, frame_data, rects, count);
+                    else
+                        upload_rects(upload_ring, frame_data, frame_width, 4, GL_RGBA, GL_UNSIGNED_BYTE, rects, count);
+                };
+
+                bool over_limit = !stereo_mode && !tiled_mode && TiledTexture::IsNeeded(width, height, max_texture_size);
+                if (width != frame_width || height != frame_height) {
+                    // Entries of a playlist don't have to share a resolution,
+                    // nor do the renditions of a title.
+                    if (pending_tex_id && pending_tex_width == width && pending_tex_height == height && !over_limit) {
+                        std::swap(uv_sphere_tex_id, pending_tex_id);
+                        pending_tex_width = frame_width;
+                        pending_tex_height = frame_height;
+                        frame_width = width;
+                        frame_height = height;
+                        frame_tiled = false;
+                        glBindTexture(GL_TEXTURE_2D, uv_sphere_tex_id);
+                        upload_frame(&whole_frame, 1);
+                    } else if (over_limit) {
+                        frame_width = width;
+                        frame_height = height;
+                        frame_tiled = true;
+                        frame_tiles.Allocate(frame_width, frame_height, max_texture_size);
+                        upload_frame(&whole_frame, 1);
+                        printf("Frames of %dx%d are over the texture size limit (%d), split into %d tiles\n",
+                            frame_width, frame_height, max_texture_size, frame_tiles.GetLayerCount());
+                    } else {
+                        frame_width = width;
+                        frame_height = height;
+                        frame_tiled = false;
+                        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, frame_width, frame_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, frame_data);
+                    }
+                } else if (playlist_mode) {
+                    // Only the parts the reader converted can have changed,
+                    // and of those only the tiles that differ are uploaded
+                    damage_update(&damage, frame_data, frame_width, frame_height,
+                        playlist.updated, playlist.updated_count, &damage_rects);
+                    upload_frame(damage_rects.data(), damage_rects.size());
+
+                    static double last_report = 0.0;
+                    if (glfwGetTime() - last_report > 5.0) {
+                        last_report = glfwGetTime();
+                        if (damage.stats.bypassed)
+                            printf("damage: frames change all over, not hashing them for now\n");
+                        else
+                            printf("damage: %d of %d tiles changed, hashing %.2f ms, %.1f MiB of uploads skipped\n",
+                                damage.stats.dirty_tiles, damage.stats.tiles, damage.stats.hash_time * 1000.0,
+                                damage.stats.skipped_bytes / 1048576.0);
+                    }
+                } else {
+                    upload_frame(&whole_frame, 1);
+                }
+
+                if (abr_mode) {
+                    static int switches = 0;
+                    if (abr.stats.switches != switches) {
+                        switches = abr.stats.switches;
+                        printf("abr: switched to rendition %d (%dx%d), frame cost %.1f ms, throughput %.1f Mbit/s\n",
+                            abr.rendition, abr.width, abr.height,
+                            abr.stats.frame_cost * 1000.0, abr.stats.throughput / 1000000.0);
+                    }
+                }
+
+                if (stereo_mode) {
+                    glBindTexture(GL_TEXTURE_2D, right_eye_tex_id);
+                    upload_rects(upload_ring, right_eye_data, frame_width, 4, GL_RGBA, GL_UNSIGNED_BYTE, &whole_frame, 1);
+
+                    static double last_report = 0.0;
+                    if (glfwGetTime() - last_report > 5.0) {
+                        last_report = glfwGetTime();
+                        printf("stereo: %lld pairs, %lld right eye frames dropped, %lld duplicated\n",
+                            (long long)stereo.stats.pairs, (long long)stereo.stats.dropped, (long long)stereo.stats.duplicated);
+                    }
+                }
+
+                if (scrub_mode) {
+                    static int64_t switches = 0;
+                    if (scrub.stats.master_switches != switches) {
+                        switches = scrub.stats.master_switches;
+                        printf("scrub: back on the master after %lld seeks (%lld proxy frames), switch took %.1f ms\n",
+                            (long long)scrub.stats.seeks, (long long)scrub.stats.proxy_frames,
+                            scrub.stats.last_switch_time * 1000.0);
+                    }
+                }
+
+                if (sequence_mode) {
+                    static double last_report = 0.0;
+                    if (glfwGetTime() - last_report > 5.0 && sequence.stats.decoded > 0) {
+                        last_report = glfwGetTime();
+                        double frame_time = sequence.stats.decode_time / sequence.stats.decoded;
+                        int threads = sequence.pool->GetThreadCount();
+                        printf("sequence: %.1f ms per image on %d threads (up to %.1f fps), %lld late frames\n",
+                            frame_time * 1000.0, threads, threads / frame_time, (long long)sequence.stats.stalls);
+                    }
+                }
+
+                if (tiled_mode) {
+                    for (size_t i = 0; i < tiled.tiles.size(); ++i) {
+                        const Tile& tile = tiled.tiles[i];
+                        if (tile.updated) {
+                            glBindTexture(GL_TEXTURE_2D, tile_tex_ids[i]);
+                            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tile.width, tile.height, GL_RGBA, GL_UNSIGNED_BYTE, tile.frame_buffer);
+                        }
+                    }
+
+                    static double last_report = 0.0;
+                    if (glfwGetTime() - last_report > 2.0) {
+                        last_report = glfwGetTime();
+                        printf("tiles: %d of %d active, %d pending, %.1f ms per frame\n",
+                            tiled.stats.active_tiles, (int)tiled.tiles.size(), tiled.stats.pending_tiles,
+                            tiled.stats.decode_time * 1000.0);
+                    }
+                }
+
+                if (live_mode) {
+                    live_source_frame_presented(&live_source);
+
+                    static double last_report = 0.0;
+                    if (wallclock_pts && glfwGetTime() - last_report > 2.0) {
+                        last_report = glfwGetTime();
+                        printf("glass-to-glass %.1f ms (max %.1f ms), decode-to-present %.1f ms, dropped %lld\n",
+                            live_source.stats.last_glass_to_glass * 1000.0,
+                            live_source.stats.max_glass_to_glass * 1000.0,
+                            live_source.stats.last_decode_to_present * 1000.0,
+                            (long long)live_source.stats.frames_dropped);
+                    }
+                }
+            }
             //glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, frame_width, frame_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, frame_data);
 
-            GL_ERR(glClearColor(0.22f, 0.24f, 0.25f, 1.0f))
-            GL_ERR(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT))
+            // The frame is uploaded, the decode thread may read over it
+            if (has_frame && decode_thread)
+                request_frame();
+
+            if (has_frame) {
+                static double last_report = 0.0;
+                const UploadRingStats& upload_stats = upload_ring.GetStats();
+                if (glfwGetTime() - last_report > 5.0) {
+                    last_report = glfwGetTime();
+                    if (upload_stats.persistent)
+                        printf("upload: %.2f ms on the CPU for the last frame, %lld of %lld uploads waited for a free buffer (%.1f ms)\n",
+                            upload_stats.write_time * 1000.0, (long long)upload_stats.stalls, (long long)upload_stats.uploads,
+                            upload_stats.stall_time * 1000.0);
+                    else
+                        printf("upload: %.2f ms on the CPU for the last frame, %lld uploads into orphaned buffers (waits not measured)\n",
+                            upload_stats.write_time * 1000.0, (long long)upload_stats.uploads);
+                }
+            }
+
+            // Everything below draws into render_width x render_height,
+            // offscreen with dynamic resolution.
+            int render_width = window_desc.m_window_width;
+            int render_height = window_desc.m_window_height;
+            if (dynamic_resolution_mode) {
+                float scale = dynamic_resolution.GetScale();
+                render_width = std::min(std::max((int)(window_desc.m_window_width * scale), 1), framebuffer_width);
+                render_height = std::min(std::max((int)(window_desc.m_window_height * scale), 1), framebuffer_height);
+
+                dynamic_resolution.BeginFrame();
+                render_first_pass(framebuffer_object_id, render_width, render_height);
+            } else {
+                GL_ERR(glClearColor(0.22f, 0.24f, 0.25f, 1.0f))
+                GL_ERR(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT))
+            }
 
             mouse_drag_rotate();
 
-            curr_angle += (diff * 0.025f);
+            // Turned by the time since the last tick, the render rate doesn't
+            // change how fast a drag turns the sphere.
+            curr_angle += diff * (DRAG_DEGREES_PER_SECOND * (float)std::min(tick_time, 0.1));
 
             model = glm::mat4(1.0f);
             model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
@@ -625,41 +2105,301 @@ int main(int argc, char** args)
 
             view = glm::lookAt(camera_pos, glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
             
-            camera_fov += mouse_y_offset;
+            // Scrolling zooms by a constant factor per step, so a gigapixel
+            // panorama can be zoomed into as quickly as a video.
+            camera_fov = glm::clamp(camera_fov * powf(0.9f, (float)mouse_y_offset), 1.0f, 90.0f);
 
-            proj = glm::perspective(glm::radians(45.0f), 
-                (float)window_desc.m_window_width / (float)window_desc.m_window_height, 
+            // Side by side, each eye gets half of the window.
+            float aspect = (float)window_desc.m_window_width / (float)window_desc.m_window_height;
+            if (stereo_mode)
+                aspect /= 2.0f;
+
+            proj = glm::perspective(glm::radians(camera_fov), 
+                aspect, 
                 0.1f, 1000.0f);
 
-            GL_ERR(glUseProgram(gpu_program_id))
+            uint32_t program_id = pano_mode ? pano_program_id : hdr_frame_shown ? hdr_program_id :
+                                  frame_tiled ? tiled_program_id : gpu_program_id;
+            GL_ERR(glUseProgram(program_id))
 
-            unsigned int model_matrix_id = glGetUniformLocation(gpu_program_id, "model_matrix");
+            unsigned int model_matrix_id = glGetUniformLocation(program_id, "model_matrix");
             GL_ERR(glUniformMatrix4fv(model_matrix_id, 1, GL_FALSE, glm::value_ptr(model)))
 
-            unsigned int view_matrix_id = glGetUniformLocation(gpu_program_id, "view_matrix");
+            unsigned int view_matrix_id = glGetUniformLocation(program_id, "view_matrix");
             GL_ERR(glUniformMatrix4fv(view_matrix_id, 1, GL_FALSE, glm::value_ptr(view)))
 
-            unsigned int proj_matrix_id = glGetUniformLocation(gpu_program_id, "proj_matrix");
+            unsigned int proj_matrix_id = glGetUniformLocation(program_id, "proj_matrix");
             GL_ERR(glUniformMatrix4fv(proj_matrix_id, 1, GL_FALSE, glm::value_ptr(proj)))
-            
-            GL_ERR(glBindVertexArray(uv_sphere_vao_id))
-            glBindTexture(GL_TEXTURE_2D, uv_sphere_tex_id);
-            GL_ERR(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, uv_sphere_ebo_id))
-            GL_ERR(glDrawElements(GL_TRIANGLES, ind.size(), GL_UNSIGNED_INT, nullptr))
+
+            if (hdr_frame_shown)
+                set_hdr_uniforms(program_id, hdr_params);
+            if (pano_mode)
+                set_pano_uniforms(program_id, pano);
+            if (program_id == tiled_program_id)
+                frame_tiles.SetUniforms(program_id);
+
+            // The mesh is drawn at the level of detail the zoom calls for,
+            // only the bands of it in view. The camera is camera_pos away
+            // from the sphere's center, in units of its radius.
+            static bool mesh_timed = false;
+            if (!raycast) {
+                float eye_distance = glm::length(camera_pos) / uv_sphere_scl.x;
+                int lod = sphere_mesh_pick_lod(&sphere_mesh, camera_fov, render_height, eye_distance, 24.0f);
+                sphere_mesh_cull(&sphere_mesh, lod, proj * view * model, &sphere_draws);
+
+                // The query of the last frame, waited for only once per report
+                GLuint64 gpu_time = 0;
+                static double last_report = 0.0;
+                if (glfwGetTime() - last_report > 5.0) {
+                    last_report = glfwGetTime();
+                    if (mesh_timed)
+                        glGetQueryObjectui64v(mesh_time_query_id, GL_QUERY_RESULT, &gpu_time);
+                    printf("mesh: level %d (%dx%d), %d of %d bands in %d draws, %d triangles, %.2f ms on the GPU\n",
+                        lod, sphere_mesh.lods[lod].lon_count, sphere_mesh.lods[lod].lat_count,
+                        sphere_draws.bands, (int)sphere_mesh.lods[lod].bands.size(), (int)sphere_draws.counts.size(),
+                        sphere_draws.triangles, gpu_time / 1000000.0);
+                }
+            }
+
+            // Either way the sphere covers what the same matrices put it on.
+            auto draw_sphere = [&]() -> void
+            {
+                if (raycast) {
+                    GL_ERR(glDrawArrays(GL_TRIANGLES, 0, 6))
+                    return;
+                }
+
+                if (mesh_time_query_id)
+                    glBeginQuery(GL_TIME_ELAPSED, mesh_time_query_id);
+                GL_ERR(glMultiDrawElementsBaseVertex(GL_TRIANGLES, sphere_draws.counts.data(), GL_UNSIGNED_SHORT,
+                    (void**)sphere_draws.offsets.data(), sphere_draws.counts.size(), sphere_draws.base_vertices.data()))
+                if (mesh_time_query_id) {
+                    glEndQuery(GL_TIME_ELAPSED);
+                    mesh_timed = true;
+                }
+            };
+
+            if (raycast) {
+                glm::mat4 inverse_mvp = glm::inverse(proj * view * model);
+                GL_ERR(glUniformMatrix4fv(glGetUniformLocation(program_id, "inverse_mvp"), 1, GL_FALSE, glm::value_ptr(inverse_mvp)))
+                GL_ERR(glBindVertexArray(screen_quad_vao_id))
+            } else {
+                GL_ERR(glBindVertexArray(uv_sphere_vao_id))
+                GL_ERR(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, uv_sphere_ebo_id))
+            }
+            if (stereo_mode) {
+                int half_width = render_width / 2;
+
+                GL_ERR(glViewport(0, 0, half_width, render_height))
+                glBindTexture(GL_TEXTURE_2D, uv_sphere_tex_id);
+                draw_sphere();
+
+                GL_ERR(glViewport(half_width, 0, half_width, render_height))
+                glBindTexture(GL_TEXTURE_2D, right_eye_tex_id);
+                draw_sphere();
+
+                GL_ERR(glViewport(0, 0, render_width, render_height))
+            } else if (pano_mode) {
+                // Tiles for this view go into the atlas before it is sampled.
+                // Footprints every 16 pixels are dense enough to hit every
+                // tile, which covers 128 to 256 pixels at the level picked.
+                sphere_view_footprints(proj * view * model, window_desc.m_window_width, window_desc.m_window_height, 16,
+                    pano.width, pano.height, &pano_footprints);
+                virtual_texture_update(&pano, pano_footprints, PANO_MAX_UPLOADS, &pano_uploads);
+
+                glBindTexture(GL_TEXTURE_2D, pano_atlas_tex_id);
+                for (const VtUpload& upload : pano_uploads)
+                    glTexSubImage2D(GL_TEXTURE_2D, 0, upload.slot_x * VT_SLOT_SIZE, upload.slot_y * VT_SLOT_SIZE,
+                        VT_SLOT_SIZE, VT_SLOT_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, upload.texels);
+
+                glActiveTexture(GL_TEXTURE1);
+                glBindTexture(GL_TEXTURE_2D, pano_page_table_tex_id);
+                if (pano.page_table_dirty) {
+                    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, pano.page_width, pano.page_height, GL_RGBA, GL_UNSIGNED_BYTE,
+                        pano.page_table.data());
+                    pano.page_table_dirty = false;
+                }
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, pano_atlas_tex_id);
+                draw_sphere();
+                glActiveTexture(GL_TEXTURE1);
+                glBindTexture(GL_TEXTURE_2D, 0);
+                glActiveTexture(GL_TEXTURE0);
+
+                static double last_report = 0.0;
+                if (glfwGetTime() - last_report > 5.0) {
+                    last_report = glfwGetTime();
+                    printf("pano: %d tiles needed, %d of %d cached, %lld loaded, %lld evicted\n",
+                        pano.stats.needed, pano.stats.resident, pano.atlas_slots * pano.atlas_slots,
+                        (long long)pano.stats.loads, (long long)pano.stats.evictions);
+                }
+            } else if (hdr_frame_shown) {
+                glActiveTexture(GL_TEXTURE1);
+                glBindTexture(GL_TEXTURE_2D, hdr_chroma_tex_id);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, hdr_luma_tex_id);
+                draw_sphere();
+                glActiveTexture(GL_TEXTURE1);
+                glBindTexture(GL_TEXTURE_2D, 0);
+                glActiveTexture(GL_TEXTURE0);
+            } else if (frame_tiled) {
+                glBindTexture(GL_TEXTURE_2D_ARRAY, frame_tiles.GetTexture());
+                draw_sphere();
+                glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+            } else {
+                const GpuFrame* shown = gpu_frames.GetShown();
+                glBindTexture(GL_TEXTURE_2D, shown ? shown->texture : uv_sphere_tex_id);
+                draw_sphere();
+            }
             glBindTexture(GL_TEXTURE_2D, 0);
             GL_ERR(glBindVertexArray(0))
 
+            // Later frames are converted at the smallest power of two fraction
+            // of their size that still gives every screen pixel at least one
+            // texel, judged from this view. Zooming in goes back to full size
+            // on the next frame, zooming out only once the smaller size fits
+            // with some room, so the size doesn't flip at the threshold.
+            //
+            // Of those frames only the part within ROI_GUARD_DEGREES of this
+            // view is converted and uploaded. The guard band has to cover
+            // how far the view turns in one frame. Queued frames are
+            // converted whole: they are shown frames after they were read,
+            // when the view may have turned past the part converted.
+            if (playlist_mode && fit_to_view) {
+                glm::mat4 mvp = proj * view * model;
+                int view_width = window_desc.m_window_width;
+                int view_height = window_desc.m_window_height;
+                bool whole_frames = gpu_queue;
+                auto fit_playlist = [&playlist, mvp, view_width, view_height, whole_frames]() -> void
+                {
+                    if (!playlist.current)
+                        return;
+
+                    static std::vector<ViewFootprint> footprints;
+                    sphere_view_footprints(mvp, view_width, view_height, 32,
+                        playlist.current->reader.width, playlist.current->reader.height, &footprints);
+
+                    bool decimation_changed = false;
+                    if (!footprints.empty()) {
+                        float texels_per_pixel = footprints[0].texels_per_pixel;
+                        for (const ViewFootprint& footprint : footprints)
+                            texels_per_pixel = std::min(texels_per_pixel, footprint.texels_per_pixel);
+
+                        static int decimation = 0;
+                        int fits = std::min(std::max((int)floorf(log2f(texels_per_pixel)), 0), MAX_DECIMATION);
+                        int fits_with_room = std::min(std::max((int)floorf(log2f(texels_per_pixel / 1.25f)), 0), MAX_DECIMATION);
+                        int next = fits < decimation ? fits : std::max(decimation, fits_with_room);
+                        if (next != decimation) {
+                            decimation = next;
+                            decimation_changed = true;
+                            playlist_set_decimation(&playlist, decimation);
+                            printf("decimation: converting frames at 1/%d of their size\n", 1 << decimation);
+                        }
+                    }
+
+                    // A texture of a new size starts from a whole frame
+                    glm::vec4 bounds[2];
+                    VideoRect rects[VIDEO_MAX_ROI];
+                    int bound_count = decimation_changed || whole_frames ? 0 : sphere_view_bounds(mvp, ROI_GUARD_DEGREES, bounds);
+                    for (int i = 0; i < bound_count; ++i) {
+                        int frame_w = playlist.current->reader.width;
+                        int frame_h = playlist.current->reader.height;
+                        rects[i].x = (int)(bounds[i].x * frame_w);
+                        rects[i].y = (int)(bounds[i].y * frame_h);
+                        rects[i].width = (int)ceilf(bounds[i].z * frame_w) - rects[i].x;
+                        rects[i].height = (int)ceilf(bounds[i].w * frame_h) - rects[i].y;
+                    }
+                    playlist_set_roi(&playlist, rects, bound_count);
+                };
+
+                // Frames read on another thread are fitted there, between two reads
+                static std::atomic<bool> fit_pending(false);
+                if (upload_thread) {
+                    if (!fit_pending.exchange(true))
+                        upload_thread->Post([fit_playlist]() -> void { fit_playlist(); fit_pending = false; });
+                } else if (decode_thread) {
+                    if (!fit_pending.exchange(true))
+                        decode_thread->Post([fit_playlist]() -> void { fit_playlist(); fit_pending = false; });
+                } else
+                    fit_playlist();
+            }
+
+            if (tiled_mode) {
+                // Active tiles on top of the base layer. They lie on the same
+                // sphere, so depth testing would only make them fight with it.
+                GL_ERR(glDisable(GL_DEPTH_TEST))
+                GL_ERR(glBindVertexArray(tile_vao_id))
+                for (size_t i = 0; i < tiled.tiles.size(); ++i) {
+                    if (tiled.tiles[i].status != TILE_ACTIVE)
+                        continue;
+
+                    glBindTexture(GL_TEXTURE_2D, tile_tex_ids[i]);
+                    GL_ERR(glDrawElements(GL_TRIANGLES, tile_index_counts[i], GL_UNSIGNED_INT,
+                        (void*)(tile_index_offsets[i] * sizeof(uint32_t))))
+                }
+                glBindTexture(GL_TEXTURE_2D, 0);
+                GL_ERR(glBindVertexArray(0))
+                GL_ERR(glEnable(GL_DEPTH_TEST))
+
+                // Tiles to decode for the next frame
+                std::vector<uint8_t> visible;
+                sphere_view_visible_cells(proj * view * model, tiled.manifest.columns, tiled.manifest.rows,
+                    tile_margin, &visible);
+                tiled_set_visible(&tiled, visible);
+            }
+
+            if (dynamic_resolution_mode) {
+                render_second_pass(upscale_program_id, color_buffer_texture_id, screen_quad_vao_id,
+                    render_width, render_height, framebuffer_width, framebuffer_height,
+                    window_desc.m_window_width, window_desc.m_window_height);
+                dynamic_resolution.EndFrame();
+
+                static double last_report = 0.0;
+                const DynamicResolutionStats& resolution_stats = dynamic_resolution.GetStats();
+                if (glfwGetTime() - last_report > 5.0) {
+                    last_report = glfwGetTime();
+                    printf("resolution: drawn at %.2f (%dx%d), %.2f ms on the GPU of %.2f ms, %lld of %lld frames over, %lld changes\n",
+                        dynamic_resolution.GetScale(), render_width, render_height,
+                        resolution_stats.average_time * 1000.0, resolution_stats.budget * 1000.0,
+                        (long long)resolution_stats.over_budget, (long long)resolution_stats.frames,
+                        (long long)resolution_stats.changes);
+                }
+            }
+
             mouse_y_offset = 0.0;
         }
     );
 
-    while(app.IsRunning())
+    // With a render thread, window moves and resizes blocking the event
+    // loop don't stop playback.
+    app.Run(render_thread_mode);
+
+    // Stopped first, they read from the playlist
+    upload_thread.reset();
+    decode_thread.reset();
+
+    if(live_mode)
+        live_source_close(&live_source);
+    else if(abr_mode)
+        abr_close(&abr);
+    else if(tiled_mode)
+        tiled_close(&tiled);
+    else if(stereo_mode)
+        stereo_close(&stereo);
+    else if(sequence_mode)
+        image_sequence_close(&sequence);
+    else if(pano_mode)
+        virtual_texture_close(&pano);
+    else if(scrub_mode)
+        scrub_close(&scrub);
+    else
+        playlist_close(&playlist);
+
+    if(audio_sink)
     {
-        app.Tick();
-        app.Poll();
+        audio_close(&audio);
+        delete audio_sink;
     }
 
-    video_reader_close(&vr_state);
-
     return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,407 @@
+#include "Core/Abr.hpp"
+#include "Core/Resource.hpp"
+
+#include <algorithm>
+
+// Share of the frame interval decoding may use before a rendition is
+// considered too expensive, and share of the measured throughput its
+// bandwidth may use.
+static constexpr double ABR_DECODE_HEADROOM = 0.75;
+static constexpr double ABR_FETCH_HEADROOM = 0.8;
+
+// Consecutive decisions that must agree before switching up.
+static constexpr int ABR_UPSWITCH_VOTES = 3;
+
+// Value of NAME=value in an HLS attribute list.
+static std::string hls_attribute(const std::string& line, const char* name) {
+    std::string key = std::string(name) + "=";
+    size_t pos = 0;
+    while ((pos = line.find(key, pos)) != std::string::npos) {
+        if (pos == 0 || line[pos - 1] == ',' || line[pos - 1] == ':') {
+            size_t begin = pos + key.size();
+            size_t end = line.find(',', begin);
+            return line.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+        }
+        pos += key.size();
+    }
+    return "";
+}
+
+static void parse_hls(const std::string& url, const std::string& text, std::vector<Rendition>* renditions) {
+    size_t pos = 0;
+    bool pending = false;
+    Rendition rendition;
+
+    while (pos < text.size()) {
+        size_t end = text.find('\n', pos);
+        std::string line = resource_trim(text.substr(pos, end == std::string::npos ? std::string::npos : end - pos));
+        pos = end == std::string::npos ? text.size() : end + 1;
+
+        if (line.compare(0, 18, "#EXT-X-STREAM-INF:") == 0) {
+            rendition = Rendition();
+            rendition.bandwidth = atoll(hls_attribute(line, "BANDWIDTH").c_str());
+            sscanf(hls_attribute(line, "RESOLUTION").c_str(), "%dx%d", &rendition.width, &rendition.height);
+            pending = true;
+        } else if (pending && !line.empty() && line[0] != '#') {
+            rendition.url = resource_resolve_url(url, line);
+            renditions->push_back(rendition);
+            pending = false;
+        }
+    }
+
+    // A media playlist rather than a master playlist: a single rendition
+    if (renditions->empty()) {
+        Rendition single = Rendition();
+        single.url = url;
+        renditions->push_back(single);
+    }
+}
+
+// Value of name="value" inside an XML tag.
+static std::string xml_attribute(const std::string& tag, const char* name) {
+    std::string key = std::string(" ") + name + "=\"";
+    size_t begin = tag.find(key);
+    if (begin == std::string::npos) {
+        return "";
+    }
+    begin += key.size();
+    return tag.substr(begin, tag.find('"', begin) - begin);
+}
+
+static void parse_dash(const std::string& url, const std::string& text, std::vector<Rendition>* renditions) {
+    size_t pos = 0;
+    while ((pos = text.find("<Representation", pos)) != std::string::npos) {
+        size_t tag_end = text.find('>', pos);
+        if (tag_end == std::string::npos) {
+            break;
+        }
+        std::string tag = text.substr(pos, tag_end - pos);
+
+        size_t body_end = text.find("</Representation>", tag_end);
+        std::string body = tag[tag.size() - 1] == '/' || body_end == std::string::npos
+            ? "" : text.substr(tag_end + 1, body_end - tag_end - 1);
+        pos = tag_end;
+
+        size_t base_begin = body.find("<BaseURL>");
+        size_t base_end = body.find("</BaseURL>");
+        if (base_begin == std::string::npos || base_end == std::string::npos) {
+            // Segment templates would need the dash demuxer to play
+            continue;
+        }
+
+        Rendition rendition = Rendition();
+        rendition.url = resource_resolve_url(url, resource_trim(body.substr(base_begin + 9, base_end - base_begin - 9)));
+        rendition.width = atoi(xml_attribute(tag, "width").c_str());
+        rendition.height = atoi(xml_attribute(tag, "height").c_str());
+        rendition.bandwidth = atoll(xml_attribute(tag, "bandwidth").c_str());
+
+        // Audio representations have no size
+        if (rendition.width > 0 && rendition.height > 0) {
+            renditions->push_back(rendition);
+        }
+    }
+}
+
+static void parse_list(const std::string& url, const std::string& text, std::vector<Rendition>* renditions) {
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find('\n', pos);
+        std::string line = resource_trim(text.substr(pos, end == std::string::npos ? std::string::npos : end - pos));
+        pos = end == std::string::npos ? text.size() : end + 1;
+
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        Rendition rendition = Rendition();
+        long long bandwidth;
+        char ref[1024];
+        if (sscanf(line.c_str(), "%dx%d %lld %1023s", &rendition.width, &rendition.height, &bandwidth, ref) != 4) {
+            printf("Ignoring malformed rendition line: %s\n", line.c_str());
+            continue;
+        }
+        rendition.bandwidth = bandwidth;
+        rendition.url = resource_resolve_url(url, ref);
+        renditions->push_back(rendition);
+    }
+}
+
+bool abr_load_manifest(const char* url, std::vector<Rendition>* renditions) {
+    std::string text;
+    if (!resource_read_text(url, &text)) {
+        return false;
+    }
+
+    renditions->clear();
+    if (text.compare(0, 7, "#EXTM3U") == 0) {
+        parse_hls(url, text, renditions);
+    } else if (text.find("<MPD") != std::string::npos) {
+        parse_dash(url, text, renditions);
+    } else {
+        parse_list(url, text, renditions);
+    }
+
+    if (renditions->empty()) {
+        printf("No playable rendition in %s\n", url);
+        return false;
+    }
+
+    std::stable_sort(renditions->begin(), renditions->end(), [](const Rendition& a, const Rendition& b) {
+        return (int64_t)a.width * a.height < (int64_t)b.width * b.height;
+    });
+
+    return true;
+}
+
+static void close_item(AbrItem* item) {
+    video_reader_close(&item->reader);
+    av_free(item->frame_buffer);
+    delete item;
+}
+
+static AbrItem* open_item(AbrState* state, int index) {
+    const Rendition& rendition = state->renditions[index];
+
+    AbrItem* item = new AbrItem();
+    item->index = index;
+    item->frame_buffer = NULL;
+
+    if (!video_reader_open(&item->reader, rendition.url.c_str(), &state->options)) {
+        printf("Couldn't open rendition %s\n", rendition.url.c_str());
+        close_item(item);
+        return NULL;
+    }
+
+    item->frame_buffer = (uint8_t*)av_malloc(item->reader.width * item->reader.height * 4);
+    if (!item->frame_buffer) {
+        printf("Couldn't allocate frame buffer for %s\n", rendition.url.c_str());
+        close_item(item);
+        return NULL;
+    }
+
+    return item;
+}
+
+// Opens a rendition and decodes its first keyframe at or after position
+// (seconds), so the switch itself costs nothing.
+static AbrItem* prepare_item(AbrState* state, int index, double position) {
+    AbrItem* item = open_item(state, index);
+    if (!item) {
+        return NULL;
+    }
+
+    int64_t ts = (int64_t)(position / av_q2d(item->reader.time_base));
+    if (!video_reader_seek_keyframe(&item->reader, ts, &item->preroll_pts) ||
+        !video_reader_convert_frame(&item->reader, item->frame_buffer)) {
+        close_item(item);
+        return NULL;
+    }
+
+    return item;
+}
+
+static void start_switch(AbrState* state, int index, double position) {
+    state->target_index = index;
+    state->target_started = true;
+    state->target_done = false;
+    state->target_thread = std::thread([state, index, position]() {
+        state->target = prepare_item(state, index, position);
+        state->target_done = true;
+    });
+}
+
+static void release_item(AbrState* state, AbrItem* item) {
+    state->releaser->Post([item]() { close_item(item); });
+}
+
+static void reset_window(AbrState* state) {
+    state->window_frames = 0;
+    state->window_cost = 0.0;
+    state->window_demux_time = 0.0;
+    state->window_start_bytes = state->current ? state->current->reader.demuxed_bytes : 0;
+}
+
+// Picks the rendition to play from about a second of measurements.
+static void decide(AbrState* state, double position) {
+    AbrItem* item = state->current;
+
+    double cost = state->window_cost / state->window_frames;
+    double cost_per_pixel = cost / ((double)item->reader.width * item->reader.height);
+    int64_t bytes = item->reader.demuxed_bytes - state->window_start_bytes;
+    double throughput = state->window_demux_time > 0.0 ? bytes * 8.0 / state->window_demux_time : 0.0;
+
+    state->stats.frame_cost = cost;
+    state->stats.throughput = throughput;
+
+    int best = 0;
+    for (int i = (int)state->renditions.size() - 1; i > 0; --i) {
+        const Rendition& rendition = state->renditions[i];
+        int width = rendition.width > 0 ? rendition.width : item->reader.width;
+        int height = rendition.height > 0 ? rendition.height : item->reader.height;
+
+        bool decodable = cost_per_pixel * width * height <= state->frame_interval * ABR_DECODE_HEADROOM;
+        bool fetchable = rendition.bandwidth <= 0 || throughput <= 0.0 ||
+                         rendition.bandwidth <= throughput * ABR_FETCH_HEADROOM;
+        if (decodable && fetchable) {
+            best = i;
+            break;
+        }
+    }
+
+    if (state->target_started) {
+        return;
+    }
+
+    if (best < state->rendition) {
+        // Falling behind: go down right away
+        state->upswitch_votes = 0;
+        start_switch(state, best, position);
+    } else if (best > state->rendition) {
+        // Climb one step at a time, once there was headroom for a while
+        if (++state->upswitch_votes >= ABR_UPSWITCH_VOTES) {
+            state->upswitch_votes = 0;
+            start_switch(state, state->rendition + 1, position);
+        }
+    } else {
+        state->upswitch_votes = 0;
+    }
+}
+
+bool abr_open(AbrState* state, const char* manifest_url, const VideoReaderOptions* options) {
+
+    state->options = options ? *options : VideoReaderOptions();
+    state->current = NULL;
+    state->target = NULL;
+    state->target_started = false;
+    state->target_done = false;
+    state->switch_pending = false;
+    state->eof = false;
+    state->upswitch_votes = 0;
+    state->stats = AbrStats();
+    state->releaser = NULL;
+    reset_window(state);
+
+    if (!abr_load_manifest(manifest_url, &state->renditions)) {
+        return false;
+    }
+
+    // Start from the smallest rendition and climb from measurements
+    state->current = open_item(state, 0);
+    if (!state->current) {
+        return false;
+    }
+
+    VideoReaderState* reader = &state->current->reader;
+    AVRational frame_rate = reader->av_format_ctx->streams[reader->video_stream_index]->avg_frame_rate;
+    state->frame_interval = frame_rate.num > 0 && frame_rate.den > 0 ? av_q2d(av_inv_q(frame_rate)) : 1.0 / 30.0;
+
+    state->rendition = 0;
+    state->width = reader->width;
+    state->height = reader->height;
+    state->releaser = new WorkerThread();
+    reset_window(state);
+
+    return true;
+}
+
+bool abr_read_frame(AbrState* state, uint8_t** frame_buffer, double* pt_seconds) {
+
+    if (!state->current || state->eof) {
+        return false;
+    }
+
+    AbrItem* item = state->current;
+
+    int64_t pts;
+    if (!video_reader_decode_frame(&item->reader, &pts)) {
+        state->eof = item->reader.eof;
+        return false;
+    }
+    double position = pts * av_q2d(item->reader.time_base);
+
+    if (state->target_started && state->target_done) {
+        state->target_thread.join();
+        state->target_started = false;
+        state->switch_pending = state->target != NULL;
+        if (state->target) {
+            state->pending_width = state->target->reader.width;
+            state->pending_height = state->target->reader.height;
+        }
+    }
+
+    // Hand over to the prepared rendition on its keyframe. The switch
+    // thread writes target until it is joined, so it is only read after.
+    if (!state->target_started && state->target) {
+        AbrItem* target = state->target;
+        double switch_position = target->preroll_pts * av_q2d(target->reader.time_base);
+        double half_frame = state->frame_interval / 2.0;
+
+        if (position >= switch_position - half_frame) {
+            state->target = NULL;
+            state->switch_pending = false;
+
+            if (position <= switch_position + half_frame) {
+                release_item(state, item);
+                state->current = target;
+                state->rendition = target->index;
+                state->width = target->reader.width;
+                state->height = target->reader.height;
+                state->stats.switches++;
+                reset_window(state);
+
+                *frame_buffer = target->frame_buffer;
+                *pt_seconds = switch_position;
+                return true;
+            }
+
+            // The keyframe went by before the target was ready, try the next one
+            release_item(state, target);
+            start_switch(state, state->target_index, position);
+        }
+    }
+
+    if (!video_reader_convert_frame(&item->reader, item->frame_buffer)) {
+        return false;
+    }
+
+    VideoReaderState* reader = &item->reader;
+    state->window_frames++;
+    state->window_cost += reader->demux_time + reader->decode_time + reader->convert_time;
+    state->window_demux_time += reader->demux_time;
+
+    if (state->window_frames * state->frame_interval >= 1.0) {
+        decide(state, position);
+        reset_window(state);
+    }
+
+    state->width = reader->width;
+    state->height = reader->height;
+
+    *frame_buffer = item->frame_buffer;
+    *pt_seconds = position;
+
+    return true;
+}
+
+void abr_close(AbrState* state) {
+    if (state->target_started) {
+        state->target_thread.join();
+        state->target_started = false;
+    }
+
+    if (state->releaser) {
+        if (state->target) {
+            release_item(state, state->target);
+        }
+        if (state->current) {
+            release_item(state, state->current);
+        }
+
+        // Waits for the pending teardowns
+        delete state->releaser;
+        state->releaser = NULL;
+    }
+
+    state->target = NULL;
+    state->current = NULL;
+}
@@ -15,6 +15,13 @@ Application::Application(ApplicationHints application_hints)
     m_on_start_callback = nullptr;
     m_on_update_callback = nullptr;
     m_on_terminate_callback = nullptr;
+
+    m_key_callback = nullptr;
+    m_cursor_callback = nullptr;
+    m_scroll_callback = nullptr;
+    m_button_callback = nullptr;
+    m_resize_callback = nullptr;
+    m_dropped_events = 0;
 }
 
 Application::~Application(void)
@@ -36,20 +43,29 @@ bool Application::IsRunning(void)
 
 void Application::SetKeyboardCallback(GLFWkeyfun fn)
 {
+    m_key_callback = fn;
     glfwSetKeyCallback(m_window, fn);
 }
 void Application::SetMouseCursorCallback(GLFWcursorposfun fn)
 {
+    m_cursor_callback = fn;
     glfwSetCursorPosCallback(m_window, fn);
 }
 void Application::SetMouseScrollCallback(GLFWscrollfun fn)
 {
+    m_scroll_callback = fn;
     glfwSetScrollCallback(m_window, fn);
 }
 void Application::SetMouseButtonCallback(GLFWmousebuttonfun fn)
 {
+    m_button_callback = fn;
     glfwSetMouseButtonCallback(m_window, fn);
 }
+void Application::SetResizeCallback(GLFWframebuffersizefun fn)
+{
+    m_resize_callback = fn;
+    glfwSetFramebufferSizeCallback(m_window, fn);
+}
 
 void Application::Init(WindowDesc window_description)
 {
@@ -72,8 +88,10 @@ void Application::Init(WindowDesc window_description)
         exit(EXIT_FAILURE);
     }
 
-    glfwSwapInterval(1);    
+    // Swapping waits for vertical blank, which paces the render loop. The
+    // interval applies to the current context, so it is set once it is.
     glfwMakeContextCurrent(m_window);
+    glfwSwapInterval(1);
 
     if(glewInit() != GLEW_OK)
     {
@@ -88,6 +106,25 @@ void Application::Init(WindowDesc window_description)
     if(m_on_start_callback)
         m_on_start_callback();
 }
+GLFWwindow* Application::CreateSharedContext(void)
+{
+    // The version hints of the main context still apply
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(1, 1, "", NULL, m_window);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+
+    if (!window) 
+    {
+        const char* description;
+        int code = glfwGetError(&description);
+
+        if (description)
+            std::cerr << "ERROR::GLFW::code: " 
+                      << code << " description: " << description << std::endl;
+    }
+
+    return window;
+}
 void Application::Tick(void)
 {
     if(m_on_update_callback)
@@ -99,6 +136,120 @@ void Application::Poll(void)
 {
     glfwPollEvents();
 }
+void Application::Run(bool render_thread)
+{
+    if(!render_thread)
+    {
+        while(IsRunning())
+        {
+            Tick();
+            Poll();
+        }
+        return;
+    }
+
+    // From now on the callbacks run on the render thread, the GLFW ones
+    // only queue the events for it
+    glfwSetWindowUserPointer(m_window, this);
+    glfwSetKeyCallback(m_window, QueueKey);
+    glfwSetCursorPosCallback(m_window, QueueCursor);
+    glfwSetScrollCallback(m_window, QueueScroll);
+    glfwSetMouseButtonCallback(m_window, QueueButton);
+    glfwSetFramebufferSizeCallback(m_window, QueueResize);
+
+    glfwMakeContextCurrent(NULL);
+    m_render_thread = std::thread(&Application::RenderLoop, this);
+
+    while(IsRunning())
+        glfwWaitEvents();
+
+    m_render_thread.join();
+    glfwMakeContextCurrent(m_window);
+
+    glfwSetKeyCallback(m_window, m_key_callback);
+    glfwSetCursorPosCallback(m_window, m_cursor_callback);
+    glfwSetScrollCallback(m_window, m_scroll_callback);
+    glfwSetMouseButtonCallback(m_window, m_button_callback);
+    glfwSetFramebufferSizeCallback(m_window, m_resize_callback);
+}
+int64_t Application::GetDroppedEvents(void) const
+{
+    return m_dropped_events;
+}
+
+void Application::RenderLoop(void)
+{
+    glfwMakeContextCurrent(m_window);
+
+    while(IsRunning())
+    {
+        DispatchEvents();
+        Tick();
+    }
+
+    glfwMakeContextCurrent(NULL);
+}
+void Application::DispatchEvents(void)
+{
+    WindowEvent event;
+    while(m_events.Pop(&event))
+    {
+        switch(event.type)
+        {
+        case WindowEvent::KEY:
+            if(m_key_callback)
+                m_key_callback(m_window, event.args[0], event.args[1], event.args[2], event.args[3]);
+            break;
+        case WindowEvent::CURSOR:
+            if(m_cursor_callback)
+                m_cursor_callback(m_window, event.x, event.y);
+            break;
+        case WindowEvent::SCROLL:
+            if(m_scroll_callback)
+                m_scroll_callback(m_window, event.x, event.y);
+            break;
+        case WindowEvent::BUTTON:
+            if(m_button_callback)
+                m_button_callback(m_window, event.args[0], event.args[1], event.args[2]);
+            break;
+        case WindowEvent::RESIZE:
+            if(m_resize_callback)
+                m_resize_callback(m_window, event.args[0], event.args[1]);
+            break;
+        }
+    }
+}
+void Application::QueueEvent(const WindowEvent& event)
+{
+    if(!m_events.Push(event))
+        m_dropped_events++;
+}
+
+void Application::QueueKey(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    Application* app = (Application*)glfwGetWindowUserPointer(window);
+    app->QueueEvent(WindowEvent{ WindowEvent::KEY, { key, scancode, action, mods }, 0.0, 0.0 });
+}
+void Application::QueueCursor(GLFWwindow* window, double xpos, double ypos)
+{
+    Application* app = (Application*)glfwGetWindowUserPointer(window);
+    app->QueueEvent(WindowEvent{ WindowEvent::CURSOR, { 0, 0, 0, 0 }, xpos, ypos });
+}
+void Application::QueueScroll(GLFWwindow* window, double xoffset, double yoffset)
+{
+    Application* app = (Application*)glfwGetWindowUserPointer(window);
+    app->QueueEvent(WindowEvent{ WindowEvent::SCROLL, { 0, 0, 0, 0 }, xoffset, yoffset });
+}
+void Application::QueueButton(GLFWwindow* window, int button, int action, int mods)
+{
+    Application* app = (Application*)glfwGetWindowUserPointer(window);
+    app->QueueEvent(WindowEvent{ WindowEvent::BUTTON, { button, action, mods, 0 }, 0.0, 0.0 });
+}
+void Application::QueueResize(GLFWwindow* window, int width, int height)
+{
+    Application* app = (Application*)glfwGetWindowUserPointer(window);
+    app->QueueEvent(WindowEvent{ WindowEvent::RESIZE, { width, height, 0, 0 }, 0.0, 0.0 });
+}
 
 void Application::OnStart(DefaultCallback fn)
 {
@@ -0,0 +1,273 @@
+#include "Core/AudioPlayer.hpp"
+
+#include <algorithm>
+
+// Seconds of audio queued ahead of the sink
+#define AUDIO_QUEUE_SECONDS 1
+
+static float sample_to_float(const uint8_t* data, AVSampleFormat format, int index) {
+    switch (format) {
+        case AV_SAMPLE_FMT_U8:  return (data[index] - 128) / 128.0f;
+        case AV_SAMPLE_FMT_S16: return ((const int16_t*)data)[index] / 32768.0f;
+        case AV_SAMPLE_FMT_S32: return ((const int32_t*)data)[index] / 2147483648.0f;
+        case AV_SAMPLE_FMT_FLT: return ((const float*)data)[index];
+        case AV_SAMPLE_FMT_DBL: return (float)((const double*)data)[index];
+        default:                return 0.0f;
+    }
+}
+
+// Appends the frame to the resampler input as interleaved float.
+static void append_frame(AudioState* state, AVFrame* frame) {
+    AVSampleFormat format = (AVSampleFormat)frame->format;
+    AVSampleFormat packed = av_get_packed_sample_fmt(format);
+    bool planar = av_sample_fmt_is_planar(format);
+    int channels = state->channels;
+
+    std::vector<float>& input = state->resample_input;
+    size_t offset = input.size();
+    input.resize(offset + (size_t)frame->nb_samples * channels);
+
+    for (int i = 0; i < frame->nb_samples; ++i) {
+        for (int c = 0; c < channels; ++c) {
+            input[offset + i * channels + c] = planar
+                ? sample_to_float(frame->extended_data[c], packed, i)
+                : sample_to_float(frame->extended_data[0], packed, i * channels + c);
+        }
+    }
+}
+
+// Blocks until the sink made room for frames more frames (or quitting).
+static bool wait_for_room(AudioState* state, int frames) {
+    int64_t capacity = state->queue.size() / state->channels;
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv.wait(lock, [state, capacity, frames]() {
+        return state->quit || state->queue_write - state->queue_read + frames <= capacity;
+    });
+    return !state->quit;
+}
+
+// Resamples what the input holds into the queue. The last input frame is
+// kept, it is needed to interpolate towards the next input.
+static bool resample_into_queue(AudioState* state) {
+    std::vector<float>& input = state->resample_input;
+    int channels = state->channels;
+    int64_t input_frames = input.size() / channels;
+    if (input_frames < 2) {
+        return true;
+    }
+
+    int64_t capacity = state->queue.size() / channels;
+    std::vector<float> output;
+    while (state->resample_pos + 1.0 < input_frames) {
+        int64_t i = (int64_t)state->resample_pos;
+        float t = (float)(state->resample_pos - i);
+        for (int c = 0; c < channels; ++c) {
+            output.push_back(input[i * channels + c] * (1.0f - t) + input[(i + 1) * channels + c] * t);
+        }
+        state->resample_pos += state->resample_step;
+    }
+
+    int64_t consumed = std::min<int64_t>((int64_t)state->resample_pos, input_frames - 1);
+    state->resample_pos -= consumed;
+    input.erase(input.begin(), input.begin() + consumed * channels);
+
+    int frames = output.size() / channels;
+    for (int done = 0; done < frames;) {
+        int chunk = std::min<int>(frames - done, capacity / 2);
+        if (!wait_for_room(state, chunk)) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(state->mutex);
+        for (int i = 0; i < chunk; ++i) {
+            int64_t slot = (state->queue_write + i) % capacity;
+            for (int c = 0; c < channels; ++c) {
+                state->queue[slot * channels + c] = output[(done + i) * channels + c];
+            }
+        }
+        state->queue_write += chunk;
+        done += chunk;
+    }
+
+    return true;
+}
+
+static void decode_loop(AudioState* state) {
+    auto& av_format_ctx = state->av_format_ctx;
+    auto& av_codec_ctx = state->av_codec_ctx;
+    auto& av_frame = state->av_frame;
+    auto& av_packet = state->av_packet;
+
+    bool draining = false;
+    while (!state->quit) {
+        int response = avcodec_receive_frame(av_codec_ctx, av_frame);
+        if (response == 0) {
+            if (!state->started) {
+                int64_t pts = av_frame->best_effort_timestamp;
+                AVRational time_base = av_format_ctx->streams[state->audio_stream_index]->time_base;
+                state->start_time = pts != AV_NOPTS_VALUE ? pts * av_q2d(time_base) : 0.0;
+                state->started = true;
+            }
+            append_frame(state, av_frame);
+            av_frame_unref(av_frame);
+            if (!resample_into_queue(state)) {
+                break;
+            }
+            continue;
+        } else if (response == AVERROR_EOF) {
+            break;
+        } else if (response != AVERROR(EAGAIN)) {
+            printf("Failed to decode audio packet\n");
+            break;
+        }
+
+        if (draining) {
+            break;
+        }
+
+        response = av_read_frame(av_format_ctx, av_packet);
+        if (response < 0) {
+            avcodec_send_packet(av_codec_ctx, NULL);
+            draining = true;
+            continue;
+        }
+        if (av_packet->stream_index == state->audio_stream_index) {
+            avcodec_send_packet(av_codec_ctx, av_packet);
+        }
+        av_packet_unref(av_packet);
+    }
+
+    state->decoder_done = true;
+}
+
+// Called by the sink: hands it queued samples.
+static int pull_samples(AudioState* state, float* samples, int frames) {
+    int channels = state->channels;
+    int64_t capacity = state->queue.size() / channels;
+
+    std::lock_guard<std::mutex> lock(state->mutex);
+    int available = (int)std::min<int64_t>(frames, state->queue_write - state->queue_read);
+    for (int i = 0; i < available; ++i) {
+        int64_t slot = (state->queue_read + i) % capacity;
+        for (int c = 0; c < channels; ++c) {
+            samples[i * channels + c] = state->queue[slot * channels + c];
+        }
+    }
+    state->queue_read += available;
+    state->cv.notify_all();
+
+    if (available == 0 && state->decoder_done) {
+        state->eof = true;
+    }
+
+    return available;
+}
+
+bool audio_open(AudioState* state, const char* filename, AudioSink* sink) {
+
+    // Unpack members of state
+    auto& av_format_ctx = state->av_format_ctx;
+    auto& av_codec_ctx = state->av_codec_ctx;
+    auto& audio_stream_index = state->audio_stream_index;
+    auto& av_frame = state->av_frame;
+    auto& av_packet = state->av_packet;
+
+    av_format_ctx = NULL;
+    av_codec_ctx = NULL;
+    av_frame = NULL;
+    av_packet = NULL;
+    state->sink = sink;
+    state->quit = false;
+    state->decoder_done = false;
+    state->eof = false;
+    state->queue_read = 0;
+    state->queue_write = 0;
+    state->resample_pos = 0.0;
+    state->resample_input.clear();
+    state->start_time = 0.0;
+    state->started = false;
+
+    if (avformat_open_input(&av_format_ctx, filename, NULL, NULL) != 0) {
+        printf("Couldn't open %s for audio\n", filename);
+        return false;
+    }
+    if (avformat_find_stream_info(av_format_ctx, NULL) < 0) {
+        printf("Couldn't find stream info\n");
+        return false;
+    }
+
+    const AVCodec* av_codec = NULL;
+    audio_stream_index = av_find_best_stream(av_format_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, &av_codec, 0);
+    if (audio_stream_index < 0 || !av_codec) {
+        printf("Couldn't find an audio stream inside file\n");
+        return false;
+    }
+
+    av_codec_ctx = avcodec_alloc_context3(av_codec);
+    if (!av_codec_ctx) {
+        printf("Couldn't create AVCodecContext\n");
+        return false;
+    }
+    if (avcodec_parameters_to_context(av_codec_ctx, av_format_ctx->streams[audio_stream_index]->codecpar) < 0) {
+        printf("Couldn't initialize AVCodecContext\n");
+        return false;
+    }
+    if (avcodec_open2(av_codec_ctx, av_codec, NULL) < 0) {
+        printf("Couldn't open audio codec\n");
+        return false;
+    }
+
+    av_frame = av_frame_alloc();
+    av_packet = av_packet_alloc();
+    if (!av_frame || !av_packet) {
+        printf("Couldn't allocate audio frame\n");
+        return false;
+    }
+
+    state->channels = av_codec_ctx->ch_layout.nb_channels;
+    state->sample_rate = sink->GetSampleRate();
+    if (state->channels <= 0 || av_codec_ctx->sample_rate <= 0) {
+        printf("Couldn't determine audio format\n");
+        return false;
+    }
+    state->resample_step = (double)av_codec_ctx->sample_rate / state->sample_rate;
+    state->queue.assign((size_t)state->sample_rate * AUDIO_QUEUE_SECONDS * state->channels, 0.0f);
+
+    if (!sink->Start(state->channels, [state](float* samples, int frames) {
+            return pull_samples(state, samples, frames);
+        })) {
+        return false;
+    }
+
+    state->decode_thread = std::thread(decode_loop, state);
+
+    return true;
+}
+
+double audio_clock(AudioState* state) {
+    if (!state->started) {
+        return -1.0;
+    }
+
+    return state->start_time + (double)state->sink->GetPlayedFrames() / state->sample_rate;
+}
+
+void audio_close(AudioState* state) {
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->quit = true;
+        state->cv.notify_all();
+    }
+
+    if (state->decode_thread.joinable()) {
+        state->decode_thread.join();
+    }
+    if (state->sink) {
+        state->sink->Stop();
+    }
+
+    avformat_close_input(&state->av_format_ctx);
+    av_frame_free(&state->av_frame);
+    av_packet_free(&state->av_packet);
+    avcodec_free_context(&state->av_codec_ctx);
+}
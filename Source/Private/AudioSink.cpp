@@ -0,0 +1,165 @@
+#include <Core/AudioSink.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+extern "C" {
+#include <libavutil/time.h>
+}
+
+// Samples pulled at once by the real time sinks
+#define AUDIO_SINK_PERIOD_MS 10
+
+// WAV headers are little endian whatever the host is.
+static void write_le(FILE* file, int bytes, uint32_t value)
+{
+    for(int i = 0; i < bytes; i++)
+        fputc((value >> (8 * i)) & 0xff, file);
+}
+
+AudioSink::AudioSink(int sample_rate)
+    : m_sample_rate(sample_rate), m_channels(0), m_quit(false),
+      m_played_frames(0), m_block_frames(0), m_block_start_us(0)
+{
+}
+
+AudioSink::~AudioSink(void)
+{
+}
+
+int AudioSink::GetSampleRate(void) const
+{
+    return m_sample_rate;
+}
+
+bool AudioSink::Start(int channels, PullCallback pull)
+{
+    m_channels = channels;
+    m_pull = pull;
+    m_quit = false;
+    m_played_frames = 0;
+    m_block_frames = 0;
+    m_block_start_us = av_gettime_relative();
+
+    if(!Open())
+        return false;
+
+    m_thread = std::thread(&AudioSink::Run, this);
+    return true;
+}
+
+void AudioSink::Stop(void)
+{
+    m_quit = true;
+    if(!m_thread.joinable())
+        return;
+
+    m_thread.join();
+    Close();
+}
+
+int64_t AudioSink::GetPlayedFrames(void)
+{
+    std::lock_guard<std::mutex> lock(m_position_mutex);
+
+    // A block plays out over one period, the real samples at its start
+    int64_t elapsed = (av_gettime_relative() - m_block_start_us) * m_sample_rate / 1000000;
+    return m_played_frames + std::max<int64_t>(0, std::min(elapsed, m_block_frames));
+}
+
+void AudioSink::Run(void)
+{
+    int period = m_sample_rate * AUDIO_SINK_PERIOD_MS / 1000;
+    std::vector<float> samples(period * m_channels);
+
+    auto deadline = std::chrono::steady_clock::now();
+    while(!m_quit)
+    {
+        int filled = m_pull(samples.data(), period);
+        std::fill(samples.begin() + filled * m_channels, samples.end(), 0.0f);
+        Consume(samples.data(), period);
+
+        {
+            std::lock_guard<std::mutex> lock(m_position_mutex);
+            m_played_frames += m_block_frames;
+            m_block_frames = filled;
+            m_block_start_us = av_gettime_relative();
+        }
+
+        deadline += std::chrono::milliseconds(AUDIO_SINK_PERIOD_MS);
+        std::this_thread::sleep_until(deadline);
+    }
+}
+
+NullAudioSink::NullAudioSink(int sample_rate)
+    : AudioSink(sample_rate)
+{
+}
+
+bool NullAudioSink::Open(void)
+{
+    return true;
+}
+
+void NullAudioSink::Consume(const float*, int)
+{
+}
+
+void NullAudioSink::Close(void)
+{
+}
+
+WavAudioSink::WavAudioSink(const char* path, int sample_rate)
+    : AudioSink(sample_rate), m_path(path), m_file(nullptr), m_data_bytes(0)
+{
+}
+
+bool WavAudioSink::Open(void)
+{
+    m_file = fopen(m_path, "wb");
+    if(!m_file)
+    {
+        printf("Couldn't open %s for writing\n", m_path);
+        return false;
+    }
+
+    m_data_bytes = 0;
+    WriteHeader();
+    return true;
+}
+
+void WavAudioSink::Consume(const float* samples, int frames)
+{
+    m_data_bytes += fwrite(samples, sizeof(float) * m_channels, frames, m_file) * sizeof(float) * m_channels;
+}
+
+void WavAudioSink::Close(void)
+{
+    // Now that the size is known
+    fseek(m_file, 0, SEEK_SET);
+    WriteHeader();
+    fclose(m_file);
+    m_file = nullptr;
+}
+
+void WavAudioSink::WriteHeader(void)
+{
+    uint32_t data_bytes = (uint32_t)std::min<int64_t>(m_data_bytes, UINT32_MAX - 36);
+
+    fwrite("RIFF", 1, 4, m_file);
+    write_le(m_file, 4, 36 + data_bytes);
+    fwrite("WAVE", 1, 4, m_file);
+
+    fwrite("fmt ", 1, 4, m_file);
+    write_le(m_file, 4, 16);
+    write_le(m_file, 2, 3);                                   // IEEE float
+    write_le(m_file, 2, m_channels);
+    write_le(m_file, 4, m_sample_rate);
+    write_le(m_file, 4, m_sample_rate * m_channels * sizeof(float));
+    write_le(m_file, 2, m_channels * sizeof(float));
+    write_le(m_file, 2, 32);
+
+    fwrite("data", 1, 4, m_file);
+    write_le(m_file, 4, data_bytes);
+}
@@ -0,0 +1,244 @@
+#include "Core/Damage.hpp"
+
+#include <algorithm>
+#include <string.h>
+
+extern "C" {
+#include <libavutil/time.h>
+}
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DAMAGE_SSE2 1
+#endif
+
+// A frame with more than this share of its tiles changed is mostly motion,
+// hashing is skipped for DAMAGE_BYPASS_FRAMES frames after it
+#define DAMAGE_BYPASS_RATIO 0.9
+#define DAMAGE_BYPASS_FRAMES 30
+
+static const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint32_t PRIME32_1 = 0x9E3779B1U;
+static const uint32_t KEY_STEP = 0x61C88647U;
+
+static uint64_t avalanche(uint64_t h) {
+    h ^= h >> 37;
+    h *= 0x165667919E3779F9ULL;
+    h ^= h >> 32;
+    return h;
+}
+
+// XXH3 style: every 16 bytes are keyed by their position in the row and
+// folded into two 64-bit lanes with a 32x32 bit multiply, and the lanes are
+// scrambled after every row so rows can't trade places unnoticed.
+static uint64_t hash_tile(const uint8_t* data, int stride, int row_bytes, int rows) {
+#ifdef DAMAGE_SSE2
+    const __m128i key = _mm_set_epi32(0x27D4EB2F, 0x165667B1, 0x85EBCA77, 0xC2B2AE3D);
+    const __m128i key_step = _mm_set1_epi32(KEY_STEP);
+    const __m128i prime = _mm_set1_epi32(PRIME32_1);
+    __m128i acc = _mm_set_epi64x(PRIME64_1, PRIME64_2);
+
+    for (int y = 0; y < rows; ++y) {
+        const uint8_t* row = data + (size_t)y * stride;
+        __m128i lane_key = key;
+        int x = 0;
+        for (; x + 16 <= row_bytes; x += 16) {
+            __m128i d = _mm_loadu_si128((const __m128i*)(row + x));
+            __m128i dk = _mm_xor_si128(d, lane_key);
+            __m128i product = _mm_mul_epu32(dk, _mm_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1)));
+            acc = _mm_add_epi64(acc, _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2)));
+            acc = _mm_add_epi64(acc, product);
+            lane_key = _mm_add_epi32(lane_key, key_step);
+        }
+        // Only tiles cut off by the right edge have rows that end mid-chunk
+        uint64_t tail = 0;
+        for (; x < row_bytes; ++x) {
+            tail = tail * 31 + row[x];
+        }
+        acc = _mm_xor_si128(acc, _mm_set1_epi64x(tail));
+
+        acc = _mm_xor_si128(acc, _mm_srli_epi64(acc, 47));
+        acc = _mm_xor_si128(acc, key);
+        __m128i product_low = _mm_mul_epu32(acc, prime);
+        __m128i product_high = _mm_mul_epu32(_mm_shuffle_epi32(acc, _MM_SHUFFLE(3, 3, 1, 1)), prime);
+        acc = _mm_add_epi64(product_low, _mm_slli_epi64(product_high, 32));
+    }
+
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+#else
+    const uint64_t key[2] = { 0x85EBCA77C2B2AE3DULL, 0x27D4EB2F165667B1ULL };
+    uint64_t lanes[2] = { PRIME64_2, PRIME64_1 };
+
+    for (int y = 0; y < rows; ++y) {
+        const uint8_t* row = data + (size_t)y * stride;
+        uint64_t lane_key[2] = { key[0], key[1] };
+        int x = 0;
+        for (; x + 16 <= row_bytes; x += 16) {
+            uint64_t d[2];
+            memcpy(d, row + x, 16);
+            for (int i = 0; i < 2; ++i) {
+                uint64_t dk = d[i] ^ lane_key[i];
+                lanes[i] += d[1 - i] + (dk & 0xFFFFFFFF) * (dk >> 32);
+                lane_key[i] = ((lane_key[i] & 0xFFFFFFFF00000000ULL) + ((uint64_t)KEY_STEP << 32)) |
+                              (uint32_t)((uint32_t)lane_key[i] + KEY_STEP);
+            }
+        }
+        uint64_t tail = 0;
+        for (; x < row_bytes; ++x) {
+            tail = tail * 31 + row[x];
+        }
+
+        for (int i = 0; i < 2; ++i) {
+            uint64_t a = lanes[i] ^ tail;
+            a ^= a >> 47;
+            a ^= key[i];
+            lanes[i] = (a & 0xFFFFFFFF) * PRIME32_1 + (((a >> 32) * PRIME32_1) << 32);
+        }
+    }
+#endif
+
+    return avalanche(lanes[0] ^ (lanes[1] * PRIME64_1) ^ ((uint64_t)rows << 32 | (uint32_t)row_bytes));
+}
+
+void damage_init(DamageState* state) {
+    state->stats = DamageStats();
+    state->width = 0;
+    state->height = 0;
+    state->columns = 0;
+    state->rows = 0;
+    state->hashes.clear();
+    state->known.clear();
+    state->bypass_frames = 0;
+}
+
+void damage_update(DamageState* state, const uint8_t* frame, int width, int height,
+                   const VideoRect* regions, int count, std::vector<VideoRect>* damage) {
+
+    int64_t start = av_gettime_relative();
+    damage->clear();
+
+    if (width != state->width || height != state->height) {
+        state->width = width;
+        state->height = height;
+        state->columns = (width + DAMAGE_TILE_SIZE - 1) / DAMAGE_TILE_SIZE;
+        state->rows = (height + DAMAGE_TILE_SIZE - 1) / DAMAGE_TILE_SIZE;
+        state->hashes.assign(state->columns * state->rows, 0);
+        state->known.assign(state->columns * state->rows, 0);
+    }
+
+    state->stats.tiles = 0;
+    state->stats.dirty_tiles = 0;
+    state->stats.bypassed = false;
+    state->stats.hash_time = 0.0;
+
+    if (state->bypass_frames > 0) {
+        // Uploads go on without hashes, which are stale from here on
+        state->bypass_frames--;
+        state->stats.bypassed = true;
+        std::fill(state->known.begin(), state->known.end(), 0);
+        damage->assign(regions, regions + count);
+        return;
+    }
+
+    // 0: not written this frame, 1: unchanged, 2: changed
+    std::vector<uint8_t> tiles(state->columns * state->rows, 0);
+    for (int i = 0; i < count; ++i) {
+        const VideoRect& region = regions[i];
+        if (region.width <= 0 || region.height <= 0) {
+            continue;
+        }
+        int first_column = region.x / DAMAGE_TILE_SIZE;
+        int first_row = region.y / DAMAGE_TILE_SIZE;
+        int last_column = std::min((region.x + region.width - 1) / DAMAGE_TILE_SIZE, state->columns - 1);
+        int last_row = std::min((region.y + region.height - 1) / DAMAGE_TILE_SIZE, state->rows - 1);
+        for (int row = first_row; row <= last_row; ++row) {
+            for (int column = first_column; column <= last_column; ++column) {
+                tiles[row * state->columns + column] = 1;
+            }
+        }
+    }
+
+    // Tiles without a hash to compare against don't tell whether frames change
+    int compared = 0, changed = 0;
+    int stride = width * 4;
+    for (int row = 0; row < state->rows; ++row) {
+        for (int column = 0; column < state->columns; ++column) {
+            int index = row * state->columns + column;
+            if (!tiles[index]) {
+                continue;
+            }
+
+            int x = column * DAMAGE_TILE_SIZE;
+            int y = row * DAMAGE_TILE_SIZE;
+            int tile_width = std::min(DAMAGE_TILE_SIZE, width - x);
+            int tile_height = std::min(DAMAGE_TILE_SIZE, height - y);
+            uint64_t hash = hash_tile(frame + (size_t)y * stride + x * 4, stride, tile_width * 4, tile_height);
+
+            state->stats.tiles++;
+            if (state->known[index]) {
+                compared++;
+                if (state->hashes[index] == hash) {
+                    state->stats.skipped_bytes += (int64_t)tile_width * tile_height * 4;
+                    continue;
+                }
+                changed++;
+            }
+
+            tiles[index] = 2;
+            state->hashes[index] = hash;
+            state->known[index] = 1;
+            state->stats.dirty_tiles++;
+        }
+    }
+
+    // Runs of changed tiles along a row become one rectangle, which grows
+    // downwards while the rows below have the same run
+    size_t previous_row_start = 0;
+    for (int row = 0; row < state->rows; ++row) {
+        size_t row_start = damage->size();
+        int y = row * DAMAGE_TILE_SIZE;
+        int tile_height = std::min(DAMAGE_TILE_SIZE, height - y);
+
+        for (int column = 0; column < state->columns;) {
+            if (tiles[row * state->columns + column] != 2) {
+                column++;
+                continue;
+            }
+            int end = column;
+            while (end < state->columns && tiles[row * state->columns + end] == 2) {
+                end++;
+            }
+
+            VideoRect rect = { column * DAMAGE_TILE_SIZE, y, std::min(end * DAMAGE_TILE_SIZE, width) - column * DAMAGE_TILE_SIZE, tile_height };
+            bool merged = false;
+            for (size_t i = previous_row_start; i < row_start; ++i) {
+                VideoRect& above = (*damage)[i];
+                if (above.x == rect.x && above.width == rect.width && above.y + above.height == rect.y) {
+                    above.height += rect.height;
+                    merged = true;
+                    break;
+                }
+            }
+            if (!merged) {
+                damage->push_back(rect);
+            }
+            column = end;
+        }
+
+        // Rectangles that grew this row count as part of it for the next one
+        previous_row_start = row_start;
+        for (size_t i = 0; i < row_start; ++i) {
+            if ((*damage)[i].y + (*damage)[i].height == y + tile_height) {
+                previous_row_start = std::min(previous_row_start, i);
+            }
+        }
+    }
+
+    if (compared > 0 && changed > DAMAGE_BYPASS_RATIO * compared) {
+        state->bypass_frames = DAMAGE_BYPASS_FRAMES;
+    }
+
+    state->stats.hash_time = (av_gettime_relative() - start) / 1000000.0;
+}
@@ -0,0 +1,148 @@
+#include <Core/DynamicResolution.hpp>
+
+#include <math.h>
+
+#include <algorithm>
+
+// Share of the budget frames are scaled to take, the rest is left for
+// uploads and for the time varying from frame to frame
+#define TARGET_SHARE 0.8
+
+// Frames in a row the average has to stay under this share of the budget
+// before the scale goes up again, and the most it goes up by at once
+#define RAISE_SHARE 0.65
+#define RAISE_FRAMES 30
+#define RAISE_STEP 1.1f
+
+// Scales are multiples of this, so render sizes don't change by a pixel
+#define SCALE_STEP (1.0f / 64.0f)
+
+DynamicResolution::DynamicResolution(float min_scale, float max_scale)
+    : m_current(0), m_timed(false), m_calm_frames(0), m_stats()
+{
+    m_max_scale = max_scale > 0.0f ? max_scale : 1.0f;
+    m_min_scale = min_scale > 0.0f ? std::min(min_scale, m_max_scale) : m_max_scale;
+    m_scale = m_max_scale;
+
+    for(Measure& measure : m_measures)
+        measure = Measure{ { 0, 0 }, 0.0f, false };
+}
+
+DynamicResolution::~DynamicResolution(void)
+{
+    if(m_timed)
+    {
+        for(Measure& measure : m_measures)
+            glDeleteQueries(2, measure.queries);
+    }
+}
+
+bool DynamicResolution::Init(double budget)
+{
+    m_stats.budget = budget;
+    m_timed = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+    if(!m_timed)
+        return false;
+
+    for(Measure& measure : m_measures)
+        glGenQueries(2, measure.queries);
+
+    return true;
+}
+
+void DynamicResolution::BeginFrame(void)
+{
+    if(!m_timed)
+        return;
+
+    // A frame the GPU is still this far behind on goes unmeasured
+    m_current = (m_current + 1) % MEASURE_COUNT;
+    Measure& measure = m_measures[m_current];
+    measure.scale = m_scale;
+    measure.pending = true;
+    glQueryCounter(measure.queries[0], GL_TIMESTAMP);
+}
+
+void DynamicResolution::EndFrame(void)
+{
+    if(!m_timed)
+        return;
+
+    glQueryCounter(m_measures[m_current].queries[1], GL_TIMESTAMP);
+
+    // Oldest first, the frame just ended can't be done yet
+    for(int i = 1; i < MEASURE_COUNT; i++)
+    {
+        Measure& measure = m_measures[(m_current + i) % MEASURE_COUNT];
+        if(!measure.pending)
+            continue;
+
+        GLint available = 0;
+        glGetQueryObjectiv(measure.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available)
+            break;
+
+        GLuint64 start, end;
+        glGetQueryObjectui64v(measure.queries[0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(measure.queries[1], GL_QUERY_RESULT, &end);
+        measure.pending = false;
+
+        if(measure.scale == m_scale)
+            Adjust((end - start) / 1000000000.0);
+    }
+}
+
+void DynamicResolution::Adjust(double time)
+{
+    double budget = m_stats.budget;
+    double target = budget * TARGET_SHARE;
+
+    m_stats.frames++;
+    m_stats.last_time = time;
+    m_stats.average_time = m_stats.frames == 1 ? time : m_stats.average_time * 0.9 + time * 0.1;
+    if(time > budget)
+        m_stats.over_budget++;
+
+    // The time goes with the pixel count, the square of the scale
+    float scale = m_scale;
+    double average = std::max(m_stats.average_time, 1e-6);
+    if(time > budget || average > budget * 0.9)
+    {
+        scale = m_scale * (float)sqrt(target / std::max(time, average));
+        scale = std::max(floorf(scale / SCALE_STEP) * SCALE_STEP, m_min_scale);
+        m_calm_frames = 0;
+    }
+    else if(average < budget * RAISE_SHARE && m_scale < m_max_scale)
+    {
+        if(++m_calm_frames < RAISE_FRAMES)
+            return;
+        scale = m_scale * std::min((float)sqrt(target / average), RAISE_STEP);
+        scale = std::min(floorf(scale / SCALE_STEP) * SCALE_STEP, m_max_scale);
+        m_calm_frames = 0;
+    }
+    else
+        m_calm_frames = 0;
+
+    if(scale == m_scale)
+        return;
+
+    // What the average would have been at the new scale
+    m_stats.average_time *= (scale * scale) / (m_scale * m_scale);
+    m_stats.changes++;
+    m_scale = scale;
+}
+
+float DynamicResolution::GetScale(void) const
+{
+    return m_scale;
+}
+
+float DynamicResolution::GetMaxScale(void) const
+{
+    return m_max_scale;
+}
+
+const DynamicResolutionStats& DynamicResolution::GetStats(void) const
+{
+    return m_stats;
+}
@@ -0,0 +1,178 @@
+#include "Core/FollowIO.hpp"
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <thread>
+
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+extern "C" {
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+}
+
+#ifdef _WIN32
+#define follow_fseek _fseeki64
+#define follow_ftell _ftelli64
+#else
+#define follow_fseek fseeko
+#define follow_ftell ftello
+#endif
+
+static constexpr int FOLLOW_IO_BUFFER_SIZE = 64 * 1024;
+
+struct FollowIOState {
+    FILE* file;
+    double idle_timeout;
+    bool waited;
+
+    // inotify instance watching the file for writes, -1 if unavailable
+    int inotify_fd;
+};
+
+static void free_state(FollowIOState* state) {
+#ifdef __linux__
+    if (state->inotify_fd >= 0) {
+        close(state->inotify_fd);
+    }
+#endif
+    fclose(state->file);
+    delete state;
+}
+
+static int64_t file_size(FollowIOState* state) {
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_fstat64(_fileno(state->file), &st) != 0) {
+        return -1;
+    }
+#else
+    struct stat st;
+    if (fstat(fileno(state->file), &st) != 0) {
+        return -1;
+    }
+#endif
+    return st.st_size;
+}
+
+// Blocks until the file is larger than pos. Returns false once the file
+// hasn't grown for idle_timeout seconds.
+static bool wait_for_growth(FollowIOState* state, int64_t pos) {
+    using clock = std::chrono::steady_clock;
+    auto deadline = clock::now() + std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(state->idle_timeout));
+
+    while (file_size(state) <= pos) {
+        auto now = clock::now();
+        if (now >= deadline) {
+            return false;
+        }
+
+#ifdef __linux__
+        if (state->inotify_fd >= 0) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now);
+            struct pollfd pfd = { state->inotify_fd, POLLIN, 0 };
+            if (poll(&pfd, 1, (int)remaining.count() + 1) > 0) {
+                // Drain the events, the size check above is what matters
+                char events[4096];
+                while (read(state->inotify_fd, events, sizeof(events)) > 0) {}
+            }
+            continue;
+        }
+#endif
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    return true;
+}
+
+static int read_packet(void* opaque, uint8_t* buf, int buf_size) {
+    FollowIOState* state = (FollowIOState*)opaque;
+
+    while (true) {
+        size_t n = fread(buf, 1, buf_size, state->file);
+        if (n > 0) {
+            return (int)n;
+        }
+        if (ferror(state->file)) {
+            return AVERROR(EIO);
+        }
+
+        // At the current end of the file: wait for the writer
+        clearerr(state->file);
+        if (!wait_for_growth(state, follow_ftell(state->file))) {
+            return AVERROR_EOF;
+        }
+        state->waited = true;
+    }
+}
+
+static int64_t seek(void* opaque, int64_t offset, int whence) {
+    FollowIOState* state = (FollowIOState*)opaque;
+
+    if (whence & AVSEEK_SIZE) {
+        return file_size(state);
+    }
+
+    if (follow_fseek(state->file, offset, whence & ~AVSEEK_FORCE) != 0) {
+        return AVERROR(EIO);
+    }
+    return follow_ftell(state->file);
+}
+
+AVIOContext* follow_io_open(const char* filename, double idle_timeout) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        printf("Couldn't open %s for following\n", filename);
+        return NULL;
+    }
+
+    FollowIOState* state = new FollowIOState();
+    state->file = file;
+    state->idle_timeout = idle_timeout;
+    state->waited = false;
+    state->inotify_fd = -1;
+
+#ifdef __linux__
+    state->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (state->inotify_fd >= 0 && inotify_add_watch(state->inotify_fd, filename, IN_MODIFY | IN_CLOSE_WRITE) < 0) {
+        close(state->inotify_fd);
+        state->inotify_fd = -1;
+    }
+#endif
+
+    uint8_t* buffer = (uint8_t*)av_malloc(FOLLOW_IO_BUFFER_SIZE);
+    AVIOContext* io = buffer ? avio_alloc_context(buffer, FOLLOW_IO_BUFFER_SIZE, 0, state, read_packet, NULL, seek) : NULL;
+    if (!io) {
+        printf("Couldn't allocate AVIOContext\n");
+        av_free(buffer);
+        free_state(state);
+        return NULL;
+    }
+
+    return io;
+}
+
+bool follow_io_waited(AVIOContext* io) {
+    FollowIOState* state = (FollowIOState*)io->opaque;
+    bool waited = state->waited;
+    state->waited = false;
+    return waited;
+}
+
+void follow_io_close(AVIOContext** io) {
+    if (!*io) {
+        return;
+    }
+
+    free_state((FollowIOState*)(*io)->opaque);
+
+    av_freep(&(*io)->buffer);
+    avio_context_free(io);
+}
@@ -0,0 +1,142 @@
+#include <Core/GpuFrameQueue.hpp>
+
+GpuFrameQueue::GpuFrameQueue(int depth)
+    : m_depth(depth > 1 ? depth : 1), m_first(0), m_count(0), m_shown(-1), m_stats()
+{
+    m_slots.resize(m_depth + 1, GpuFrame{ 0, 0, 0, 0.0, 0.0, nullptr });
+    m_stats.min_ready = m_depth;
+}
+
+GpuFrameQueue::~GpuFrameQueue(void)
+{
+    for(GpuFrame& slot : m_slots)
+    {
+        if(slot.fence)
+            glDeleteSync(slot.fence);
+        if(slot.texture)
+            glDeleteTextures(1, &slot.texture);
+    }
+}
+
+bool GpuFrameQueue::Push(int width, int height, double time, double entry_start)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if(m_count == m_depth)
+        return false;
+
+    // Only this thread touches the slot until Commit()
+    GpuFrame& slot = m_slots[(m_first + m_count) % m_slots.size()];
+    lock.unlock();
+
+    // The renderer may still draw with it
+    if(slot.fence)
+    {
+        glWaitSync(slot.fence, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+    }
+
+    if(!slot.texture)
+        glGenTextures(1, &slot.texture);
+    glBindTexture(GL_TEXTURE_2D, slot.texture);
+
+    if(slot.width != width || slot.height != height)
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        slot.width = width;
+        slot.height = height;
+    }
+
+    slot.time = time;
+    slot.entry_start = entry_start;
+
+    return true;
+}
+
+void GpuFrameQueue::Commit(void)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    GpuFrame& slot = m_slots[(m_first + m_count) % m_slots.size()];
+
+    // Flushed, a fence another context waits for has to reach the GPU
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    m_count++;
+}
+
+const GpuFrame* GpuFrameQueue::Peek(void)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_count > 0 ? &m_slots[m_first] : nullptr;
+}
+
+const GpuFrame* GpuFrameQueue::Present(void)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.presents++;
+    m_stats.last_ready = m_count;
+    if(m_count < m_stats.min_ready)
+        m_stats.min_ready = m_count;
+
+    if(m_count == 0)
+    {
+        m_stats.empty_presents++;
+        return nullptr;
+    }
+
+    if(m_shown >= 0)
+    {
+        GpuFrame& released = m_slots[m_shown];
+        released.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+    }
+
+    m_shown = m_first;
+    m_first = (m_first + 1) % m_slots.size();
+    m_count--;
+
+    // Draws from here on wait for the upload, the CPU doesn't
+    GpuFrame& shown = m_slots[m_shown];
+    glWaitSync(shown.fence, 0, GL_TIMEOUT_IGNORED);
+    glDeleteSync(shown.fence);
+    shown.fence = nullptr;
+
+    return &shown;
+}
+
+const GpuFrame* GpuFrameQueue::GetShown(void)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_shown >= 0 ? &m_slots[m_shown] : nullptr;
+}
+
+bool GpuFrameQueue::IsFull(void)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_count == m_depth;
+}
+
+int GpuFrameQueue::GetReadyCount(void)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_count;
+}
+
+int GpuFrameQueue::GetDepth(void) const
+{
+    return m_depth;
+}
+
+GpuFrameQueueStats GpuFrameQueue::GetStats(void)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void GpuFrameQueue::ResetMinReady(void)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.min_ready = m_depth;
+}
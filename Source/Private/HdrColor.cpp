@@ -0,0 +1,164 @@
+#include "Core/HdrColor.hpp"
+
+#include <math.h>
+
+#include <algorithm>
+
+extern "C" {
+#include <libavutil/mastering_display_metadata.h>
+}
+
+// BT.2100 reference white for HDR content shown on an SDR display
+#define HDR_SDR_WHITE_NITS 203.0f
+#define HDR_DEFAULT_PEAK_NITS 1000.0f
+
+// Fraction of SDR white where highlight compression starts, must match the shader
+#define HDR_KNEE 0.75f
+
+void hdr_params_from_frame(const AVFrame* frame, HdrParams* params) {
+    // P010 keeps a 10-bit code value in the top bits of each 16-bit sample
+    params->sample_scale = 65535.0f / (64.0f * 1023.0f);
+
+    float k = 4.0f / 1023.0f;
+    if (frame->color_range == AVCOL_RANGE_JPEG) {
+        params->y_offset = 0.0f;
+        params->y_scale = 1.0f;
+        params->c_offset = 128.0f * k;
+        params->c_scale = 1.0f;
+    } else {
+        params->y_offset = 16.0f * k;
+        params->y_scale = 1.0f / (219.0f * k);
+        params->c_offset = 128.0f * k;
+        params->c_scale = 1.0f / (224.0f * k);
+    }
+
+    float kr, kb;
+    switch (frame->colorspace) {
+        case AVCOL_SPC_BT2020_NCL:
+        case AVCOL_SPC_BT2020_CL:    kr = 0.2627f; kb = 0.0593f; break;
+        case AVCOL_SPC_BT470BG:
+        case AVCOL_SPC_SMPTE170M:    kr = 0.299f;  kb = 0.114f;  break;
+        case AVCOL_SPC_UNSPECIFIED:
+            // 10-bit 360 footage without tags is almost always BT.2020
+            if (frame->color_trc == AVCOL_TRC_SMPTE2084 || frame->color_trc == AVCOL_TRC_ARIB_STD_B67) {
+                kr = 0.2627f; kb = 0.0593f;
+            } else {
+                kr = 0.2126f; kb = 0.0722f;
+            }
+            break;
+        default:                     kr = 0.2126f; kb = 0.0722f; break;
+    }
+    float kg = 1.0f - kr - kb;
+
+    // Columns are the contributions of Y', Cb and Cr
+    params->yuv_to_rgb = glm::mat3(
+        1.0f, 1.0f, 1.0f,
+        0.0f, -2.0f * (1.0f - kb) * kb / kg, 2.0f * (1.0f - kb),
+        2.0f * (1.0f - kr), -2.0f * (1.0f - kr) * kr / kg, 0.0f);
+
+    switch (frame->color_trc) {
+        case AVCOL_TRC_SMPTE2084:    params->transfer = HDR_TRANSFER_PQ;  break;
+        case AVCOL_TRC_ARIB_STD_B67: params->transfer = HDR_TRANSFER_HLG; break;
+        default:                     params->transfer = HDR_TRANSFER_SDR; break;
+    }
+    params->bt2020 = frame->color_primaries == AVCOL_PRI_BT2020 ||
+                     (frame->color_primaries == AVCOL_PRI_UNSPECIFIED && params->transfer != HDR_TRANSFER_SDR);
+
+    params->sdr_white_nits = HDR_SDR_WHITE_NITS;
+    params->peak_nits = HDR_DEFAULT_PEAK_NITS;
+    AVFrameSideData* side_data = av_frame_get_side_data(frame, AV_FRAME_DATA_CONTENT_LIGHT_LEVEL);
+    if (side_data && params->transfer == HDR_TRANSFER_PQ) {
+        const AVContentLightMetadata* light = (const AVContentLightMetadata*)side_data->data;
+        if (light->MaxCLL > 0) {
+            params->peak_nits = (float)light->MaxCLL;
+        }
+    }
+}
+
+// SMPTE ST 2084 EOTF, to nits
+static float pq_to_nits(float e) {
+    const float m1 = 2610.0f / 16384.0f;
+    const float m2 = 2523.0f / 4096.0f * 128.0f;
+    const float c1 = 3424.0f / 4096.0f;
+    const float c2 = 2413.0f / 4096.0f * 32.0f;
+    const float c3 = 2392.0f / 4096.0f * 32.0f;
+
+    float p = powf(std::max(e, 0.0f), 1.0f / m2);
+    return 10000.0f * powf(std::max(p - c1, 0.0f) / (c2 - c3 * p), 1.0f / m1);
+}
+
+// ARIB STD-B67 inverse OETF, to scene light in [0, 1]
+static float hlg_to_scene(float e) {
+    const float a = 0.17883277f;
+    const float b = 0.28466892f;
+    const float c = 0.55991073f;
+
+    e = std::max(e, 0.0f);
+    return e <= 0.5f ? e * e / 3.0f : (expf((e - c) / a) + b) / 12.0f;
+}
+
+glm::vec3 hdr_convert_pixel(const HdrParams& params, uint16_t y, uint16_t cb, uint16_t cr) {
+    float scale = params.sample_scale / 65535.0f;
+    glm::vec3 ycc((y * scale - params.y_offset) * params.y_scale,
+                  (cb * scale - params.c_offset) * params.c_scale,
+                  (cr * scale - params.c_offset) * params.c_scale);
+    glm::vec3 rgb = params.yuv_to_rgb * ycc;
+
+    if (params.transfer == HDR_TRANSFER_SDR) {
+        return glm::clamp(rgb, 0.0f, 1.0f);
+    }
+
+    // Linear light in nits
+    glm::vec3 nits;
+    if (params.transfer == HDR_TRANSFER_PQ) {
+        nits = glm::vec3(pq_to_nits(rgb.r), pq_to_nits(rgb.g), pq_to_nits(rgb.b));
+    } else {
+        // HLG system gamma for a 1000 nit display
+        glm::vec3 scene(hlg_to_scene(rgb.r), hlg_to_scene(rgb.g), hlg_to_scene(rgb.b));
+        float luminance = 0.2627f * scene.r + 0.6780f * scene.g + 0.0593f * scene.b;
+        nits = 1000.0f * powf(std::max(luminance, 1e-6f), 0.2f) * scene;
+    }
+
+    if (params.bt2020) {
+        const glm::mat3 bt2020_to_bt709(
+             1.6605f, -0.1246f, -0.0182f,
+            -0.5876f,  1.1329f, -0.1006f,
+            -0.0728f, -0.0083f,  1.1187f);
+        nits = bt2020_to_bt709 * nits;
+    }
+
+    // Levels up to the knee are left alone, the ones above are compressed
+    // with a Reinhard shoulder that puts the content peak on display white.
+    // Applied to the brightest component so hues are kept.
+    glm::vec3 x = glm::max(nits, 0.0f) / params.sdr_white_nits;
+    float peak = params.peak_nits / params.sdr_white_nits;
+    float m = std::max(std::max(x.r, x.g), x.b);
+    if (m > HDR_KNEE && peak > 1.0f) {
+        float t = (m - HDR_KNEE) / (1.0f - HDR_KNEE);
+        float t_peak = (peak - HDR_KNEE) / (1.0f - HDR_KNEE);
+        float mapped = HDR_KNEE + (1.0f - HDR_KNEE) * t * (1.0f + t / (t_peak * t_peak)) / (1.0f + t);
+        x *= mapped / m;
+    }
+
+    x = glm::clamp(x, 0.0f, 1.0f);
+    return glm::vec3(powf(x.r, 1.0f / 2.2f), powf(x.g, 1.0f / 2.2f), powf(x.b, 1.0f / 2.2f));
+}
+
+void hdr_convert_frame(const HdrParams& params, const uint8_t* frame_buffer, int width, int height, uint8_t* rgb0) {
+    const uint16_t* luma = (const uint16_t*)frame_buffer;
+    const uint16_t* chroma = luma + (size_t)width * height;
+    int chroma_width = (width + 1) / 2;
+
+    for (int row = 0; row < height; ++row) {
+        for (int column = 0; column < width; ++column) {
+            const uint16_t* c = chroma + ((size_t)(row / 2) * chroma_width + column / 2) * 2;
+            glm::vec3 rgb = hdr_convert_pixel(params, luma[(size_t)row * width + column], c[0], c[1]);
+
+            uint8_t* out = rgb0 + ((size_t)row * width + column) * 4;
+            out[0] = (uint8_t)lrintf(rgb.r * 255.0f);
+            out[1] = (uint8_t)lrintf(rgb.g * 255.0f);
+            out[2] = (uint8_t)lrintf(rgb.b * 255.0f);
+            out[3] = 255;
+        }
+    }
+}
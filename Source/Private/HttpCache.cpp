@@ -0,0 +1,538 @@
+#include "Core/HttpCache.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+extern "C" {
+#include <libavutil/dict.h>
+#include <libavutil/error.h>
+#include <libavutil/mem.h>
+#include <libavutil/opt.h>
+}
+
+static constexpr int HTTP_CACHE_IO_BUFFER_SIZE = 64 * 1024;
+
+struct MemoryChunk {
+    std::vector<uint8_t> data;
+    std::list<int64_t>::iterator lru;
+};
+
+struct DiskChunk {
+    std::list<std::string>::iterator lru;
+    int64_t bytes;
+};
+
+// The chunk files of every source in a cache directory, most recently used
+// first. Sources open on the same directory share it, so disk_bytes bounds
+// the directory rather than each source.
+struct DiskIndex {
+    std::mutex mutex;
+    std::list<std::string> lru;     // file names
+    std::unordered_map<std::string, DiskChunk> chunks;
+    int64_t bytes;
+};
+
+struct HttpCacheState {
+    std::string url;
+    HttpCacheConfig config;
+    std::string disk_prefix;    // path prefix of this url's chunk files, empty without disk cache
+    int64_t size;               // size of the resource, -1 while unknown
+    int64_t pos;
+    int64_t last_index;         // chunk the previous read came from
+
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    // Most recently used chunks at the front
+    std::list<int64_t> memory_lru;
+    std::unordered_map<int64_t, MemoryChunk> memory;
+    std::shared_ptr<DiskIndex> disk;   // NULL without disk cache
+
+    std::set<int64_t> in_flight;        // chunks being loaded by either thread
+    std::deque<int64_t> prefetch_queue;
+    std::thread prefetch_thread;
+    bool quit;
+
+    HttpCacheStats stats;
+};
+
+static int64_t chunk_begin(HttpCacheState* state, int64_t index) {
+    return index * state->config.chunk_size;
+}
+
+static int64_t chunk_end(HttpCacheState* state, int64_t index) {
+    int64_t end = chunk_begin(state, index) + state->config.chunk_size;
+    return state->size >= 0 && end > state->size ? state->size : end;
+}
+
+static std::string chunk_path(HttpCacheState* state, int64_t index) {
+    return state->disk_prefix + "_" + std::to_string(index) + ".chunk";
+}
+
+// Fetches one chunk with a range request. Learns the size of the resource
+// on the way if it isn't known yet. Anything short of the whole chunk, from
+// where it starts, fails: a partial chunk would be cached as if complete.
+static bool fetch_chunk(HttpCacheState* state, int64_t index, std::vector<uint8_t>* data, int64_t* size) {
+    int64_t begin = chunk_begin(state, index);
+    int64_t end = chunk_end(state, index);
+
+    AVDictionary* opts = NULL;
+    av_dict_set_int(&opts, "offset", begin, 0);
+    av_dict_set_int(&opts, "end_offset", end, 0);
+
+    AVIOContext* io = NULL;
+    int response = avio_open2(&io, state->url.c_str(), AVIO_FLAG_READ, NULL, &opts);
+    av_dict_free(&opts);
+    if (response < 0) {
+        char error[AV_ERROR_MAX_STRING_SIZE];
+        av_make_error_string(error, sizeof(error), response);
+        printf("Couldn't fetch chunk %lld of %s: %s\n", (long long)index, state->url.c_str(), error);
+        return false;
+    }
+
+    // The http protocol's offset is where the reply's Content-Range starts,
+    // and 0 without one: an origin ignoring the Range header answers 200
+    // with the body from its start. That is only this chunk for chunk 0.
+    int64_t reply_begin;
+    if (av_opt_get_int(io, "offset", AV_OPT_SEARCH_CHILDREN, &reply_begin) >= 0 && reply_begin != begin) {
+        printf("Couldn't fetch chunk %lld of %s: the reply starts at %lld (no range support?)\n",
+               (long long)index, state->url.c_str(), (long long)reply_begin);
+        avio_closep(&io);
+        return false;
+    }
+
+    int64_t resource_size = avio_size(io);
+    if (size) {
+        *size = resource_size;
+    }
+
+    // Before the size is known, the first chunk may be all there is
+    if (state->size < 0 && resource_size >= 0 && end > resource_size) {
+        end = std::max(resource_size, begin);
+    }
+
+    data->resize(end - begin);
+    int64_t got = 0;
+    while (got < (int64_t)data->size()) {
+        int n = avio_read(io, data->data() + got, (int)(data->size() - got));
+        if (n <= 0) {
+            break;
+        }
+        got += n;
+    }
+
+    avio_closep(&io);
+
+    if (got != end - begin) {
+        printf("Couldn't fetch chunk %lld of %s: got %lld of %lld bytes\n",
+               (long long)index, state->url.c_str(), (long long)got, (long long)(end - begin));
+        return false;
+    }
+    return true;
+}
+
+static bool load_disk_chunk(HttpCacheState* state, int64_t index, std::vector<uint8_t>* data) {
+    if (state->disk_prefix.empty()) {
+        return false;
+    }
+
+    std::string path = chunk_path(state, index);
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+
+    data->resize(chunk_end(state, index) - chunk_begin(state, index));
+    size_t got = fread(data->data(), 1, data->size(), file);
+    fclose(file);
+    if (got != data->size()) {
+        return false;
+    }
+
+    // The modification time is when the chunk was last used, for the next
+    // run's open_disk_index
+    std::error_code error;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+    return true;
+}
+
+static void store_disk_chunk(HttpCacheState* state, int64_t index, const std::vector<uint8_t>& data) {
+    if (state->disk_prefix.empty()) {
+        return;
+    }
+
+    // Write to a temporary file first so a crash never leaves a truncated chunk
+    std::string path = chunk_path(state, index);
+    std::string tmp_path = path + ".tmp";
+
+    FILE* file = fopen(tmp_path.c_str(), "wb");
+    if (!file) {
+        return;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+    ok = fclose(file) == 0 && ok;
+
+    remove(path.c_str());
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        remove(tmp_path.c_str());
+    }
+}
+
+// Moves a chunk file to the front of the directory's LRU, adding it if it
+// isn't there, and removes the least recently used files of any source
+// until the directory is within disk_bytes. A source whose file goes
+// fetches the chunk again when it next needs it.
+static void touch_disk_file(DiskIndex* disk, const std::string& dir, const std::string& name, int64_t bytes,
+                            int64_t capacity) {
+    auto it = disk->chunks.find(name);
+    if (it != disk->chunks.end()) {
+        disk->lru.erase(it->second.lru);
+        disk->bytes -= it->second.bytes;
+    }
+    disk->lru.push_front(name);
+    disk->chunks[name] = DiskChunk{ disk->lru.begin(), bytes };
+    disk->bytes += bytes;
+
+    while (disk->bytes > capacity && disk->lru.size() > 1) {
+        std::string evicted = disk->lru.back();
+        disk->lru.pop_back();
+        disk->bytes -= disk->chunks[evicted].bytes;
+        disk->chunks.erase(evicted);
+        remove((dir + "/" + evicted).c_str());
+    }
+}
+
+static void touch_disk_chunk(HttpCacheState* state, int64_t index, int64_t bytes) {
+    if (!state->disk) {
+        return;
+    }
+
+    std::string path = chunk_path(state, index);
+    std::string name = std::filesystem::path(path).filename().string();
+    std::lock_guard<std::mutex> lock(state->disk->mutex);
+    touch_disk_file(state->disk.get(), state->config.disk_dir, name, bytes, state->config.disk_bytes);
+}
+
+// Gets the index of a cache directory, shared with the sources already open
+// on it. The first to open it scans the chunk files earlier runs left there,
+// of any source, least recently used first, so they count against
+// disk_bytes and get evicted like the ones fetched by this run.
+static std::shared_ptr<DiskIndex> open_disk_index(const HttpCacheConfig* config) {
+    static std::mutex mutex;
+    static std::map<std::string, std::weak_ptr<DiskIndex>> indices;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<DiskIndex> disk = indices[config->disk_dir].lock();
+    if (disk) {
+        return disk;
+    }
+    disk = std::make_shared<DiskIndex>();
+    disk->bytes = 0;
+    indices[config->disk_dir] = disk;
+
+    struct Found {
+        std::filesystem::file_time_type time;
+        std::string name;
+        int64_t bytes;
+        bool operator<(const Found& other) const { return time < other.time; }
+    };
+    std::vector<Found> found;
+
+    std::error_code error;
+    std::filesystem::directory_iterator it(config->disk_dir, error);
+    for (; !error && it != std::filesystem::directory_iterator(); it.increment(error)) {
+        if (it->path().extension() != ".chunk") {
+            continue;
+        }
+
+        std::error_code file_error;
+        Found file = { it->last_write_time(file_error), it->path().filename().string(), 0 };
+        if (!file_error) {
+            file.bytes = (int64_t)it->file_size(file_error);
+        }
+        if (!file_error) {
+            found.push_back(file);
+        }
+    }
+
+    std::sort(found.begin(), found.end());
+    for (const Found& file : found) {
+        touch_disk_file(disk.get(), config->disk_dir, file.name, file.bytes, config->disk_bytes);
+    }
+    return disk;
+}
+
+// Must be called with the lock held.
+static void insert_memory_chunk(HttpCacheState* state, int64_t index, std::vector<uint8_t> data) {
+    state->memory_lru.push_front(index);
+    MemoryChunk& chunk = state->memory[index];
+    chunk.data = std::move(data);
+    chunk.lru = state->memory_lru.begin();
+
+    while ((int)state->memory_lru.size() > state->config.memory_chunks && state->memory_lru.size() > 1) {
+        state->memory.erase(state->memory_lru.back());
+        state->memory_lru.pop_back();
+    }
+}
+
+// Loads a chunk from disk or from the origin. Called with the lock held and
+// the chunk marked in flight; the lock is released during the I/O.
+static bool load_chunk(HttpCacheState* state, int64_t index, std::unique_lock<std::mutex>& lock, bool* fetched) {
+    lock.unlock();
+
+    std::vector<uint8_t> data;
+    bool from_disk = load_disk_chunk(state, index, &data);
+    bool ok = from_disk || fetch_chunk(state, index, &data, NULL);
+    if (ok && !from_disk) {
+        store_disk_chunk(state, index, data);
+    }
+
+    lock.lock();
+    state->in_flight.erase(index);
+
+    if (ok) {
+        if (from_disk) {
+            state->stats.disk_hits++;
+        } else {
+            state->stats.bytes_fetched += data.size();
+        }
+        touch_disk_chunk(state, index, data.size());
+        insert_memory_chunk(state, index, std::move(data));
+    }
+    *fetched = ok && !from_disk;
+
+    state->cv.notify_all();
+
+    return ok;
+}
+
+static void prefetch_loop(HttpCacheState* state) {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    while (true) {
+        state->cv.wait(lock, [state]() {
+            return state->quit || !state->prefetch_queue.empty();
+        });
+        if (state->quit) {
+            return;
+        }
+
+        int64_t index = state->prefetch_queue.front();
+        state->prefetch_queue.pop_front();
+
+        if (state->memory.count(index) || state->in_flight.count(index)) {
+            continue;
+        }
+
+        bool fetched;
+        state->in_flight.insert(index);
+        load_chunk(state, index, lock, &fetched);
+    }
+}
+
+static int read_packet(void* opaque, uint8_t* buf, int buf_size) {
+    HttpCacheState* state = (HttpCacheState*)opaque;
+    std::unique_lock<std::mutex> lock(state->mutex);
+
+    if (state->pos >= state->size) {
+        return AVERROR_EOF;
+    }
+
+    int64_t index = state->pos / state->config.chunk_size;
+
+    bool waited = false;
+    auto it = state->memory.find(index);
+    while (it == state->memory.end()) {
+        if (state->in_flight.count(index)) {
+            // Already being prefetched, don't fetch it twice
+            waited = true;
+            state->cv.wait(lock);
+        } else {
+            bool fetched;
+            state->in_flight.insert(index);
+            if (!load_chunk(state, index, lock, &fetched)) {
+                return AVERROR(EIO);
+            }
+            waited = waited || fetched;
+        }
+        it = state->memory.find(index);
+    }
+
+    if (index != state->last_index) {
+        state->last_index = index;
+        if (waited) {
+            state->stats.misses++;
+        } else {
+            state->stats.hits++;
+        }
+    }
+
+    MemoryChunk& chunk = it->second;
+    state->memory_lru.erase(chunk.lru);
+    state->memory_lru.push_front(index);
+    chunk.lru = state->memory_lru.begin();
+
+    int64_t offset = state->pos - chunk_begin(state, index);
+    int n = (int)std::min((int64_t)buf_size, (int64_t)chunk.data.size() - offset);
+    if (n <= 0) {
+        return AVERROR_EOF;
+    }
+    memcpy(buf, chunk.data.data() + offset, n);
+
+    state->pos += n;
+    state->stats.bytes_read += n;
+
+    // Keep the chunks ahead of the read position coming
+    for (int i = 1; i <= state->config.prefetch_chunks; ++i) {
+        int64_t next = index + i;
+        if (chunk_begin(state, next) >= state->size) {
+            break;
+        }
+        if (!state->memory.count(next) && !state->in_flight.count(next) &&
+            std::find(state->prefetch_queue.begin(), state->prefetch_queue.end(), next) == state->prefetch_queue.end()) {
+            state->prefetch_queue.push_back(next);
+        }
+    }
+    state->cv.notify_all();
+
+    return n;
+}
+
+static int64_t seek(void* opaque, int64_t offset, int whence) {
+    HttpCacheState* state = (HttpCacheState*)opaque;
+    std::lock_guard<std::mutex> lock(state->mutex);
+
+    if (whence & AVSEEK_SIZE) {
+        return state->size;
+    }
+
+    int64_t pos;
+    switch (whence & ~AVSEEK_FORCE) {
+        case SEEK_SET: pos = offset; break;
+        case SEEK_CUR: pos = state->pos + offset; break;
+        case SEEK_END: pos = state->size + offset; break;
+        default:       return AVERROR(EINVAL);
+    }
+    if (pos < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    // Read-ahead for the old position is no longer useful
+    state->prefetch_queue.clear();
+    state->pos = pos;
+
+    return pos;
+}
+
+// The size of the resource is remembered next to the chunks so a fully
+// cached resource opens without touching the network.
+static int64_t load_disk_size(HttpCacheState* state) {
+    long long size = -1;
+    if (!state->disk_prefix.empty()) {
+        FILE* file = fopen((state->disk_prefix + ".size").c_str(), "r");
+        if (file) {
+            if (fscanf(file, "%lld", &size) != 1) {
+                size = -1;
+            }
+            fclose(file);
+        }
+    }
+    return size;
+}
+
+static void store_disk_size(HttpCacheState* state) {
+    if (!state->disk_prefix.empty()) {
+        FILE* file = fopen((state->disk_prefix + ".size").c_str(), "w");
+        if (file) {
+            fprintf(file, "%lld\n", (long long)state->size);
+            fclose(file);
+        }
+    }
+}
+
+AVIOContext* http_cache_io_open(const char* url, const HttpCacheConfig* config) {
+    HttpCacheState* state = new HttpCacheState();
+    state->url = url;
+    state->config = *config;
+    state->size = -1;
+    state->pos = 0;
+    state->last_index = -1;
+    state->quit = false;
+    state->stats = HttpCacheStats();
+
+    if (config->disk_dir) {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx", (unsigned long long)std::hash<std::string>()(state->url));
+        state->disk_prefix = std::string(config->disk_dir) + "/" + name;
+        state->disk = open_disk_index(config);
+    }
+
+    // The first chunk tells the size of the resource
+    state->size = load_disk_size(state);
+    if (state->size < 0) {
+        std::vector<uint8_t> data;
+        if (!fetch_chunk(state, 0, &data, &state->size) || state->size < 0) {
+            printf("Couldn't open %s (the origin has to support range requests)\n", url);
+            delete state;
+            return NULL;
+        }
+        store_disk_size(state);
+        store_disk_chunk(state, 0, data);
+        touch_disk_chunk(state, 0, data.size());
+        state->stats.bytes_fetched += data.size();
+        insert_memory_chunk(state, 0, std::move(data));
+    }
+
+    uint8_t* buffer = (uint8_t*)av_malloc(HTTP_CACHE_IO_BUFFER_SIZE);
+    AVIOContext* io = buffer ? avio_alloc_context(buffer, HTTP_CACHE_IO_BUFFER_SIZE, 0, state, read_packet, NULL, seek) : NULL;
+    if (!io) {
+        printf("Couldn't allocate AVIOContext\n");
+        av_free(buffer);
+        delete state;
+        return NULL;
+    }
+
+    state->prefetch_thread = std::thread(prefetch_loop, state);
+
+    return io;
+}
+
+HttpCacheStats http_cache_io_stats(AVIOContext* io) {
+    HttpCacheState* state = (HttpCacheState*)io->opaque;
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->stats;
+}
+
+void http_cache_io_close(AVIOContext** io) {
+    if (!*io) {
+        return;
+    }
+
+    HttpCacheState* state = (HttpCacheState*)(*io)->opaque;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->quit = true;
+    }
+    state->cv.notify_all();
+    state->prefetch_thread.join();
+    delete state;
+
+    av_freep(&(*io)->buffer);
+    avio_context_free(io);
+}
@@ -0,0 +1,244 @@
+#include "Core/ImageRows.hpp"
+
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The row decoders need libjpeg and libpng (-DIMAGE_ROWS_CODECS -ljpeg
+// -lpng). Without them every image goes through FFmpeg, whole.
+#ifdef IMAGE_ROWS_CODECS
+#include <jpeglib.h>
+#include <png.h>
+
+// libjpeg reports errors through error_exit, which mustn't return
+struct JpegRows {
+    jpeg_decompress_struct decompress;
+    jpeg_error_mgr error;
+    jmp_buf jump;
+};
+
+struct PngRows {
+    png_structp png;
+    png_infop info;
+};
+
+static void jpeg_error_exit(j_common_ptr decompress) {
+    JpegRows* jpeg = (JpegRows*)decompress;
+    char message[JMSG_LENGTH_MAX];
+    (*decompress->err->format_message)(decompress, message);
+    printf("Couldn't decode JPEG: %s\n", message);
+    longjmp(jpeg->jump, 1);
+}
+
+static bool open_jpeg(ImageRowsState* state) {
+    JpegRows* jpeg = new JpegRows();
+    state->jpeg = jpeg;
+
+    jpeg->decompress.err = jpeg_std_error(&jpeg->error);
+    jpeg->error.error_exit = jpeg_error_exit;
+    if (setjmp(jpeg->jump)) {
+        return false;
+    }
+
+    jpeg_create_decompress(&jpeg->decompress);
+    jpeg_stdio_src(&jpeg->decompress, state->file);
+    jpeg_read_header(&jpeg->decompress, TRUE);
+    jpeg->decompress.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&jpeg->decompress);
+
+    state->width = jpeg->decompress.output_width;
+    state->height = jpeg->decompress.output_height;
+    state->scanline = (uint8_t*)malloc((size_t)state->width * 3);
+    return state->scanline != NULL;
+}
+
+static bool read_jpeg(ImageRowsState* state, uint8_t* row) {
+    JpegRows* jpeg = state->jpeg;
+    if (setjmp(jpeg->jump)) {
+        return false;
+    }
+
+    JSAMPROW scanline = state->scanline;
+    if (jpeg_read_scanlines(&jpeg->decompress, &scanline, 1) != 1) {
+        return false;
+    }
+    for (int x = 0; x < state->width; ++x) {
+        row[x * 4 + 0] = state->scanline[x * 3 + 0];
+        row[x * 4 + 1] = state->scanline[x * 3 + 1];
+        row[x * 4 + 2] = state->scanline[x * 3 + 2];
+        row[x * 4 + 3] = 0xff;
+    }
+    return true;
+}
+
+// Interlaced images only come whole, they are left to FFmpeg
+static bool open_png(ImageRowsState* state, bool* interlaced) {
+    PngRows* png = new PngRows();
+    state->png = png;
+    *interlaced = false;
+
+    png->png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png->info = png->png ? png_create_info_struct(png->png) : NULL;
+    if (!png->info) {
+        return false;
+    }
+    if (setjmp(png_jmpbuf(png->png))) {
+        printf("Couldn't decode PNG\n");
+        return false;
+    }
+
+    png_init_io(png->png, state->file);
+    png_read_info(png->png, png->info);
+    if (png_get_interlace_type(png->png, png->info) != PNG_INTERLACE_NONE) {
+        *interlaced = true;
+        return false;
+    }
+
+    // Whatever the pixel format, rows come out as 8-bit RGBA
+    png_set_expand(png->png);
+    png_set_strip_16(png->png);
+    png_set_gray_to_rgb(png->png);
+    png_set_filler(png->png, 0xff, PNG_FILLER_AFTER);
+    png_read_update_info(png->png, png->info);
+
+    state->width = png_get_image_width(png->png, png->info);
+    state->height = png_get_image_height(png->png, png->info);
+    return png_get_rowbytes(png->png, png->info) == (size_t)state->width * 4;
+}
+
+static bool read_png(ImageRowsState* state, uint8_t* row) {
+    PngRows* png = state->png;
+    if (setjmp(png_jmpbuf(png->png))) {
+        printf("Couldn't decode PNG\n");
+        return false;
+    }
+
+    png_read_row(png->png, row, NULL);
+    return true;
+}
+#endif
+
+static void close_decoders(ImageRowsState* state) {
+#ifdef IMAGE_ROWS_CODECS
+    if (state->jpeg) {
+        jpeg_destroy_decompress(&state->jpeg->decompress);
+        delete state->jpeg;
+        state->jpeg = NULL;
+    }
+    if (state->png) {
+        png_destroy_read_struct(&state->png->png, &state->png->info, NULL);
+        delete state->png;
+        state->png = NULL;
+    }
+#endif
+    if (state->file) {
+        fclose(state->file);
+        state->file = NULL;
+    }
+    free(state->scanline);
+    state->scanline = NULL;
+}
+
+static bool open_reader(ImageRowsState* state, const char* path, const VideoReaderOptions* options) {
+    state->reader_open = true;
+    if (!video_reader_open(&state->reader, path, options)) {
+        printf("Couldn't open %s\n", path);
+        return false;
+    }
+
+    state->width = state->reader.width;
+    state->height = state->reader.height;
+    state->pixels = (uint8_t*)malloc((size_t)state->width * state->height * 4);
+    int64_t pts;
+    if (!state->pixels || !video_reader_decode_frame(&state->reader, &pts) ||
+        !video_reader_convert_frame(&state->reader, state->pixels)) {
+        printf("Couldn't decode %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+bool image_rows_open(ImageRowsState* state, const char* path, const VideoReaderOptions* options) {
+    state->width = 0;
+    state->height = 0;
+    state->file = NULL;
+    state->jpeg = NULL;
+    state->png = NULL;
+    state->scanline = NULL;
+    state->reader_open = false;
+    state->pixels = NULL;
+    state->next_row = 0;
+
+    state->file = fopen(path, "rb");
+    if (!state->file) {
+        printf("Couldn't open %s\n", path);
+        return false;
+    }
+
+    uint8_t magic[8] = { 0 };
+    size_t magic_size = fread(magic, 1, sizeof(magic), state->file);
+    rewind(state->file);
+
+    static const uint8_t JPEG_MAGIC[3] = { 0xff, 0xd8, 0xff };
+    static const uint8_t PNG_MAGIC[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    bool jpeg = magic_size >= sizeof(JPEG_MAGIC) && memcmp(magic, JPEG_MAGIC, sizeof(JPEG_MAGIC)) == 0;
+    bool png = magic_size == sizeof(PNG_MAGIC) && memcmp(magic, PNG_MAGIC, sizeof(PNG_MAGIC)) == 0;
+#ifdef IMAGE_ROWS_CODECS
+    if (jpeg) {
+        return open_jpeg(state);
+    }
+    if (png) {
+        bool interlaced;
+        if (open_png(state, &interlaced)) {
+            return true;
+        }
+        if (!interlaced) {
+            return false;
+        }
+    }
+#else
+    if (jpeg || png) {
+        printf("Couldn't stream %s a row at a time: built without IMAGE_ROWS_CODECS (libjpeg and libpng), "
+               "decoding it whole through FFmpeg, which takes at most about 268M pixels\n", path);
+    }
+#endif
+
+    close_decoders(state);
+    return open_reader(state, path, options);
+}
+
+bool image_rows_read(ImageRowsState* state, uint8_t* row) {
+    if (state->next_row >= state->height) {
+        return false;
+    }
+
+    bool ok;
+#ifdef IMAGE_ROWS_CODECS
+    if (state->jpeg) {
+        ok = read_jpeg(state, row);
+    } else if (state->png) {
+        ok = read_png(state, row);
+    } else
+#endif
+    {
+        // RGB0 from the converter, the fourth byte is made opaque like the decoders' rows
+        memcpy(row, state->pixels + (size_t)state->next_row * state->width * 4, (size_t)state->width * 4);
+        for (int x = 0; x < state->width; ++x) {
+            row[x * 4 + 3] = 0xff;
+        }
+        ok = true;
+    }
+
+    state->next_row++;
+    return ok;
+}
+
+void image_rows_close(ImageRowsState* state) {
+    close_decoders(state);
+    if (state->reader_open) {
+        video_reader_close(&state->reader);
+        state->reader_open = false;
+    }
+    free(state->pixels);
+    state->pixels = NULL;
+}
@@ -0,0 +1,240 @@
+#include "Core/ImageSequence.hpp"
+
+#include <algorithm>
+
+extern "C" {
+#include <libavutil/time.h>
+}
+
+// Turns the file name pattern into a printf format with a single integer
+// conversion. A literal '%' has to be written as "%%".
+static bool parse_pattern(const char* pattern, std::string* format) {
+    int conversions = 0;
+    format->clear();
+
+    for (const char* c = pattern; *c; ++c) {
+        if (*c == '#') {
+            int digits = 0;
+            while (c[digits] == '#') {
+                digits++;
+            }
+            *format += "%0" + std::to_string(digits) + "d";
+            c += digits - 1;
+            conversions++;
+        } else if (*c == '%' && c[1] == '%') {
+            *format += "%%";
+            ++c;
+        } else if (*c == '%') {
+            const char* end = c + 1;
+            while (*end >= '0' && *end <= '9') {
+                end++;
+            }
+            if (*end != 'd') {
+                return false;
+            }
+            format->append(c, end + 1);
+            c = end;
+            conversions++;
+        } else {
+            *format += *c;
+        }
+    }
+
+    return conversions == 1;
+}
+
+static std::string frame_path(ImageSequenceState* state, int position) {
+    char path[4096];
+    snprintf(path, sizeof(path), state->format.c_str(), state->first_number + position);
+    return path;
+}
+
+static bool frame_exists(ImageSequenceState* state, int position) {
+    FILE* file = fopen(frame_path(state, position).c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    fclose(file);
+    return true;
+}
+
+static VideoReaderOptions image_reader_options() {
+    VideoReaderOptions options;
+    // EXR holds linear light, the decoder applies the sRGB curve for display.
+    // Decoders of other formats ignore the option.
+    options.decoder_options = "apply_trc=iec61966_2_1";
+    return options;
+}
+
+// Runs on the pool: decodes one image into its slot.
+static void decode_frame(ImageSequenceState* state, SequenceFrame* slot, int position) {
+    bool ok = false;
+    int64_t start = av_gettime_relative();
+
+    if (!state->quit) {
+        std::string path = frame_path(state, position);
+        VideoReaderOptions options = image_reader_options();
+        VideoReaderState reader;
+        int64_t pts;
+
+        if (!video_reader_open(&reader, path.c_str(), &options)) {
+            printf("Couldn't open %s\n", path.c_str());
+        } else if (reader.width != state->width || reader.height != state->height) {
+            printf("%s is %dx%d, the sequence is %dx%d\n", path.c_str(),
+                   reader.width, reader.height, state->width, state->height);
+        } else if (!video_reader_read_frame(&reader, &slot->data, &pts)) {
+            printf("Couldn't decode %s\n", path.c_str());
+        } else {
+            ok = true;
+        }
+        video_reader_close(&reader);
+    }
+
+    std::lock_guard<std::mutex> lock(state->mutex);
+    slot->done = true;
+    slot->ok = ok;
+    if (ok) {
+        state->decode_stats.decoded++;
+        state->decode_stats.decode_time += (av_gettime_relative() - start) / 1000000.0;
+    }
+    state->cv.notify_all();
+}
+
+// Queues the decode of the frame at position into its slot, which must not
+// be in use. Called with the mutex held.
+static void schedule_frame(ImageSequenceState* state, int position) {
+    if (position >= state->frame_count) {
+        return;
+    }
+
+    SequenceFrame* slot = &state->slots[position % state->slots.size()];
+    slot->position = position;
+    slot->done = false;
+    slot->ok = false;
+    state->pool->Submit([state, slot, position]() { decode_frame(state, slot, position); });
+}
+
+bool image_sequence_open(ImageSequenceState* state, const char* pattern, const ImageSequenceOptions* options) {
+
+    ImageSequenceOptions default_options;
+    if (!options) {
+        options = &default_options;
+    }
+
+    state->width = 0;
+    state->height = 0;
+    state->frame_count = 0;
+    state->eof = false;
+    state->stats = SequenceStats();
+    state->decode_stats = SequenceStats();
+    state->frame_rate = options->frame_rate > 0.0 ? options->frame_rate : 24.0;
+    state->position = 0;
+    state->quit = false;
+    state->pool = NULL;
+
+    if (!parse_pattern(pattern, &state->format)) {
+        printf("Couldn't parse image sequence pattern %s (expected one %%d or run of #)\n", pattern);
+        return false;
+    }
+
+    // Like ffmpeg's image2 demuxer, look for the first frame among 0 to 4
+    state->first_number = std::max(options->start_number, 0);
+    if (options->start_number < 0) {
+        while (state->first_number < 5 && !frame_exists(state, 0)) {
+            state->first_number++;
+        }
+    }
+
+    // The sequence ends at the first missing number
+    while (frame_exists(state, state->frame_count)) {
+        state->frame_count++;
+    }
+    if (state->frame_count == 0) {
+        printf("Couldn't find the images of %s\n", pattern);
+        return false;
+    }
+
+    // The first image sets the size of the whole sequence
+    std::string first_path = frame_path(state, 0);
+    VideoReaderOptions reader_options = image_reader_options();
+    VideoReaderState reader;
+    bool opened = video_reader_open(&reader, first_path.c_str(), &reader_options);
+    state->width = reader.width;
+    state->height = reader.height;
+    video_reader_close(&reader);
+    if (!opened) {
+        printf("Couldn't open %s\n", first_path.c_str());
+        return false;
+    }
+
+    state->pool = new ThreadPool(options->thread_count);
+
+    // One slot for the frame on display plus the ones decoded ahead. A bit
+    // more than one frame per thread keeps every thread busy while frames
+    // are handed out.
+    int read_ahead = options->read_ahead > 0 ? options->read_ahead : state->pool->GetThreadCount() + 2;
+    state->slots.resize(std::min(read_ahead + 1, state->frame_count));
+    for (SequenceFrame& slot : state->slots) {
+        slot.position = -1;
+        slot.done = true;
+        slot.ok = false;
+        slot.data = (uint8_t*)av_malloc(state->width * state->height * 4);
+        if (!slot.data) {
+            printf("Couldn't allocate image sequence frame buffers\n");
+            return false;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(state->mutex);
+    for (int i = 0; i < (int)state->slots.size(); ++i) {
+        schedule_frame(state, i);
+    }
+
+    return true;
+}
+
+bool image_sequence_read_frame(ImageSequenceState* state, uint8_t** frame_buffer, double* pt_seconds) {
+
+    if (state->eof || state->position >= state->frame_count) {
+        state->eof = true;
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+
+    // The frame handed out last is off the screen now, its slot takes the
+    // frame at the far end of the window
+    if (state->position > 0) {
+        schedule_frame(state, state->position - 1 + (int)state->slots.size());
+    }
+
+    SequenceFrame* slot = &state->slots[state->position % state->slots.size()];
+    if (!slot->done) {
+        state->decode_stats.stalls++;
+        state->cv.wait(lock, [slot]() { return slot->done; });
+    }
+    state->stats = state->decode_stats;
+
+    // A broken image is skipped, the previous frame stays on display
+    int position = state->position++;
+    if (!slot->ok) {
+        return false;
+    }
+
+    *frame_buffer = slot->data;
+    *pt_seconds = position / state->frame_rate;
+
+    return true;
+}
+
+void image_sequence_close(ImageSequenceState* state) {
+    // Decodes still queued see quit and return right away
+    state->quit = true;
+    delete state->pool;
+    state->pool = NULL;
+
+    for (SequenceFrame& slot : state->slots) {
+        av_free(slot.data);
+    }
+    state->slots.clear();
+}
@@ -0,0 +1,147 @@
+#include "Core/LiveSource.hpp"
+
+#include <algorithm>
+
+extern "C" {
+#include <libavutil/time.h>
+}
+
+// Reads that fail without reaching the end are retried after a pause that
+// doubles up to the maximum, until this many fail in a row.
+#define LIVE_RETRY_MIN_US 10000
+#define LIVE_RETRY_MAX_US 200000
+#define LIVE_MAX_READ_ERRORS 50
+
+// Lets av_read_frame() give up on a stalled pipe or socket when closing.
+static int interrupt_callback(void* opaque) {
+    return ((LiveSourceState*)opaque)->quit ? 1 : 0;
+}
+
+static void decode_loop(LiveSourceState* state) {
+    int failures = 0;
+    int64_t retry_us = LIVE_RETRY_MIN_US;
+    while (!state->quit) {
+        LiveFrame& frame = state->frames.GetBack();
+
+        if (!video_reader_read_frame(&state->reader, &frame.data, &frame.pts)) {
+            if (state->reader.eof) {
+                break;
+            }
+            // A corrupt packet fails once, a broken stream fails every read
+            if (++failures == LIVE_MAX_READ_ERRORS) {
+                printf("Couldn't read the live stream, stopping after %d failed reads in a row\n", failures);
+                break;
+            }
+            av_usleep(retry_us);
+            retry_us = std::min(retry_us * 2, (int64_t)LIVE_RETRY_MAX_US);
+            continue;
+        }
+        failures = 0;
+        retry_us = LIVE_RETRY_MIN_US;
+        frame.received_us = av_gettime_relative();
+
+        state->frames_decoded++;
+        if (state->frames.Publish()) {
+            state->frames_dropped++;
+        }
+    }
+
+    state->eof = true;
+}
+
+bool live_source_open(LiveSourceState* state, const char* url, bool wallclock_pts) {
+
+    state->wallclock_pts = wallclock_pts;
+    state->stats = LiveSourceStats();
+    state->quit = false;
+    state->eof = false;
+    state->frames_decoded = 0;
+    state->frames_dropped = 0;
+
+    for (int i = 0; i < 3; ++i) {
+        state->frames.GetBuffer(i).data = NULL;
+    }
+
+    VideoReaderOptions options;
+    options.low_latency = true;
+    if (!video_reader_open(&state->reader, url, &options)) {
+        video_reader_close(&state->reader);
+        return false;
+    }
+
+    state->width = state->reader.width;
+    state->height = state->reader.height;
+
+    for (int i = 0; i < 3; ++i) {
+        state->frames.GetBuffer(i).data = (uint8_t*)av_malloc(state->width * state->height * 4);
+        if (!state->frames.GetBuffer(i).data) {
+            printf("Couldn't allocate live frame buffers\n");
+            live_source_close(state);
+            return false;
+        }
+    }
+
+    state->reader.av_format_ctx->interrupt_callback.callback = interrupt_callback;
+    state->reader.av_format_ctx->interrupt_callback.opaque = state;
+
+    state->decode_thread = std::thread(decode_loop, state);
+
+    return true;
+}
+
+bool live_source_acquire_frame(LiveSourceState* state, uint8_t** frame_buffer, int64_t* pts) {
+    if (!state->frames.Update()) {
+        return false;
+    }
+
+    LiveFrame& frame = state->frames.GetFront();
+    *frame_buffer = frame.data;
+    *pts = frame.pts;
+
+    return true;
+}
+
+// Called once the frame returned by live_source_acquire_frame() has been
+// handed to the GPU, to account for the latency it accumulated.
+void live_source_frame_presented(LiveSourceState* state) {
+    auto& stats = state->stats;
+    LiveFrame& frame = state->frames.GetFront();
+
+    stats.frames_decoded = state->frames_decoded;
+    stats.frames_dropped = state->frames_dropped;
+    stats.frames_presented++;
+    stats.last_decode_to_present = (av_gettime_relative() - frame.received_us) / 1000000.0;
+
+    if (state->wallclock_pts && frame.pts != AV_NOPTS_VALUE) {
+        AVStream* stream = state->reader.av_format_ctx->streams[state->reader.video_stream_index];
+        int64_t now = av_rescale_q(av_gettime(), AV_TIME_BASE_Q, stream->time_base);
+        int64_t latency = now - frame.pts;
+
+        // Transport streams only carry 33 bits of timestamp
+        if (stream->pts_wrap_bits < 64) {
+            latency &= (INT64_C(1) << stream->pts_wrap_bits) - 1;
+        }
+
+        stats.last_glass_to_glass = latency * av_q2d(stream->time_base);
+        if (stats.last_glass_to_glass > stats.max_glass_to_glass) {
+            stats.max_glass_to_glass = stats.last_glass_to_glass;
+        }
+    }
+}
+
+bool live_source_eof(LiveSourceState* state) {
+    return state->eof;
+}
+
+void live_source_close(LiveSourceState* state) {
+    state->quit = true;
+    if (state->decode_thread.joinable()) {
+        state->decode_thread.join();
+    }
+
+    video_reader_close(&state->reader);
+
+    for (int i = 0; i < 3; ++i) {
+        av_freep(&state->frames.GetBuffer(i).data);
+    }
+}
@@ -0,0 +1,79 @@
+#include <Core/MediaClock.hpp>
+
+#include <math.h>
+
+extern "C" {
+#include <libavutil/time.h>
+}
+
+MediaClock::MediaClock(void)
+    : m_audio(nullptr), m_audio_master(false), m_anchor_us(0), m_anchor_time(0.0), m_anchored(false),
+      m_stats(), m_drift_sum(0.0)
+{
+}
+
+void MediaClock::SetAudio(AudioState* audio)
+{
+    m_audio = audio;
+    m_audio_master = audio != nullptr;
+}
+
+void MediaClock::Anchor(double media_time)
+{
+    if(m_audio_master)
+        return;
+
+    m_anchor_us = av_gettime_relative();
+    m_anchor_time = media_time;
+    m_anchored = true;
+}
+
+bool MediaClock::IsRunning(void)
+{
+    Now();
+    return m_audio_master ? audio_clock(m_audio) >= 0.0 : m_anchored;
+}
+
+double MediaClock::Now(void)
+{
+    if(m_audio_master)
+    {
+        double audio_time = audio_clock(m_audio);
+        if(!m_audio->eof)
+            return audio_time;
+
+        // Audio ended before the video, carry on from where it stopped.
+        m_audio_master = false;
+        Anchor(audio_time >= 0.0 ? audio_time : 0.0);
+    }
+
+    return m_anchor_time + (av_gettime_relative() - m_anchor_us) / 1000000.0;
+}
+
+double MediaClock::Until(double media_time)
+{
+    return media_time - Now();
+}
+
+void MediaClock::Presented(double media_time)
+{
+    double drift = Now() - media_time;
+
+    m_stats.frames++;
+    m_stats.last_drift = drift;
+    if(fabs(drift) > fabs(m_stats.max_drift))
+        m_stats.max_drift = drift;
+
+    m_drift_sum += drift;
+    m_stats.mean_drift = m_drift_sum / m_stats.frames;
+}
+
+const MediaClockStats& MediaClock::GetStats(void) const
+{
+    return m_stats;
+}
+
+bool MediaClock::IsAudioMaster(void) const
+{
+    return m_audio_master;
+}
@@ -0,0 +1,220 @@
+#include "Core/Playlist.hpp"
+
+#include <algorithm>
+
+// Duration of the frame currently held by the reader, in stream time base.
+static int64_t current_frame_duration(VideoReaderState* reader) {
+    if (reader->av_frame->duration > 0) {
+        return reader->av_frame->duration;
+    }
+
+    AVRational frame_rate = reader->av_format_ctx->streams[reader->video_stream_index]->avg_frame_rate;
+    if (frame_rate.num > 0 && frame_rate.den > 0) {
+        return av_rescale_q(1, av_inv_q(frame_rate), reader->time_base);
+    }
+
+    return 0;
+}
+
+static void close_item(PlaylistItem* item) {
+    video_reader_close(&item->reader);
+    av_free(item->frame_buffer);
+    delete item;
+}
+
+// Opens an entry and decodes its first frame, so switching to it later
+// costs nothing but a pointer swap.
+static PlaylistItem* open_item(const std::string& path, int index, const VideoReaderOptions* options) {
+    PlaylistItem* item = new PlaylistItem();
+    item->index = index;
+    item->frame_buffer = NULL;
+
+    if (!video_reader_open(&item->reader, path.c_str(), options)) {
+        printf("Couldn't open playlist entry %s\n", path.c_str());
+        close_item(item);
+        return NULL;
+    }
+
+    item->frame_buffer = (uint8_t*)av_malloc(item->reader.width * item->reader.height * 4);
+    if (!item->frame_buffer) {
+        printf("Couldn't allocate frame buffer for %s\n", path.c_str());
+        close_item(item);
+        return NULL;
+    }
+
+    if (!video_reader_read_frame(&item->reader, &item->frame_buffer, &item->first_pts)) {
+        printf("Couldn't decode first frame of %s\n", path.c_str());
+        close_item(item);
+        return NULL;
+    }
+
+    item->end_pts = item->first_pts;
+    item->has_preroll = true;
+
+    return item;
+}
+
+// Opens the first entry after the current one that can be opened.
+static PlaylistItem* open_next_item(PlaylistState* state, int index) {
+    for (int i = index + 1; i < (int)state->paths.size(); ++i) {
+        PlaylistItem* item = open_item(state->paths[i], i, &state->options);
+        if (item) {
+            return item;
+        }
+    }
+    return NULL;
+}
+
+static void start_preload(PlaylistState* state) {
+    state->preload_started = true;
+    state->preload_thread = std::thread([state, index = state->current->index]() {
+        state->next = open_next_item(state, index);
+    });
+}
+
+static void release_item(PlaylistState* state, PlaylistItem* item) {
+    state->releaser->Post([item]() { close_item(item); });
+}
+
+// Hands the display over to the pre-opened next entry. The next entry's first
+// frame starts exactly where the last frame of the current one ends.
+static bool switch_to_next(PlaylistState* state) {
+    if (!state->preload_started) {
+        start_preload(state);
+    }
+
+    // Normally finished long ago, unless the entry was shorter than preload_lead
+    state->preload_thread.join();
+    state->preload_started = false;
+
+    PlaylistItem* next = state->next;
+    state->next = NULL;
+    if (!next) {
+        return false;
+    }
+
+    PlaylistItem* prev = state->current;
+    state->entry_offset += (prev->end_pts - prev->first_pts) * av_q2d(prev->reader.time_base);
+    state->current = next;
+    state->index = next->index;
+
+    release_item(state, prev);
+
+    return true;
+}
+
+bool playlist_open(PlaylistState* state, const char* const* paths, int count,
+                   const VideoReaderOptions* options, double preload_lead) {
+
+    state->paths.assign(paths, paths + count);
+    state->options = options ? *options : VideoReaderOptions();
+    state->decimation = 0;
+    state->roi_count = 0;
+    state->updated_count = 0;
+    state->preload_lead = preload_lead;
+    state->entry_offset = 0.0;
+    state->current = NULL;
+    state->next = NULL;
+    state->preload_started = false;
+    state->eof = false;
+    state->live_edge = false;
+
+    state->releaser = new WorkerThread();
+
+    state->current = open_next_item(state, -1);
+    if (!state->current) {
+        printf("Couldn't open any playlist entry\n");
+        return false;
+    }
+
+    state->index = state->current->index;
+    state->width = state->current->reader.width;
+    state->height = state->current->reader.height;
+
+    return true;
+}
+
+bool playlist_read_frame(PlaylistState* state, uint8_t** frame_buffer, double* pt_seconds) {
+
+    if (!state->current || state->eof) {
+        return false;
+    }
+
+    PlaylistItem* item = state->current;
+    video_reader_set_decimation(&item->reader, state->decimation);
+    video_reader_set_roi(&item->reader, state->roi, state->roi_count);
+
+    int64_t pts;
+    if (item->has_preroll) {
+        pts = item->first_pts;
+    } else if (!video_reader_read_frame(&item->reader, &item->frame_buffer, &pts)) {
+        if (!item->reader.eof) {
+            return false;
+        }
+        if (!switch_to_next(state)) {
+            state->eof = true;
+            return false;
+        }
+
+        item = state->current;
+        pts = item->first_pts;
+    }
+
+    item->has_preroll = false;
+    item->end_pts = pts + current_frame_duration(&item->reader);
+
+    double tb = av_q2d(item->reader.time_base);
+    double position = (pts - item->first_pts) * tb;
+
+    // Start opening the next entry once the current one is about to end
+    if (!state->preload_started) {
+        int64_t duration = item->reader.av_format_ctx->duration;
+        if (duration == AV_NOPTS_VALUE || position >= duration / (double)AV_TIME_BASE - state->preload_lead) {
+            start_preload(state);
+        }
+    }
+
+    state->width = item->reader.output_width;
+    state->height = item->reader.output_height;
+    state->live_edge = item->reader.live_edge;
+    state->updated_count = item->reader.converted_count;
+    for (int i = 0; i < item->reader.converted_count; ++i) {
+        state->updated[i] = item->reader.converted[i];
+    }
+
+    *frame_buffer = item->frame_buffer;
+    *pt_seconds = state->entry_offset + position;
+
+    return true;
+}
+
+void playlist_set_decimation(PlaylistState* state, int shift) {
+    state->decimation = shift;
+}
+
+void playlist_set_roi(PlaylistState* state, const VideoRect* rects, int count) {
+    state->roi_count = std::min(count, VIDEO_MAX_ROI);
+    for (int i = 0; i < state->roi_count; ++i) {
+        state->roi[i] = rects[i];
+    }
+}
+
+void playlist_close(PlaylistState* state) {
+    if (state->preload_started) {
+        state->preload_thread.join();
+        state->preload_started = false;
+    }
+
+    if (state->next) {
+        release_item(state, state->next);
+        state->next = NULL;
+    }
+    if (state->current) {
+        release_item(state, state->current);
+        state->current = NULL;
+    }
+
+    // Waits for the pending teardowns
+    delete state->releaser;
+    state->releaser = NULL;
+}
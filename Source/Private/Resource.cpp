@@ -0,0 +1,54 @@
+#include "Core/Resource.hpp"
+
+#include <stdio.h>
+
+extern "C" {
+#include <libavformat/avio.h>
+}
+
+bool resource_read_text(const char* url, std::string* text) {
+    AVIOContext* io = NULL;
+    if (avio_open2(&io, url, AVIO_FLAG_READ, NULL, NULL) < 0) {
+        printf("Couldn't open %s\n", url);
+        return false;
+    }
+
+    uint8_t buffer[4096];
+    int n;
+    while ((n = avio_read(io, buffer, sizeof(buffer))) > 0) {
+        text->append((const char*)buffer, n);
+    }
+
+    avio_closep(&io);
+    return true;
+}
+
+std::string resource_resolve_url(const std::string& base, const std::string& ref) {
+    if (ref.find("://") != std::string::npos) {
+        return ref;
+    }
+
+    size_t scheme = base.find("://");
+    if (!ref.empty() && ref[0] == '/') {
+        if (scheme == std::string::npos) {
+            return ref;
+        }
+        size_t host_end = base.find('/', scheme + 3);
+        return base.substr(0, host_end) + ref;
+    }
+
+    size_t dir_end = base.find_last_of("/\\");
+    if (dir_end == std::string::npos || (scheme != std::string::npos && dir_end < scheme + 3)) {
+        return ref;
+    }
+    return base.substr(0, dir_end + 1) + ref;
+}
+
+std::string resource_trim(const std::string& str) {
+    size_t begin = str.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    size_t end = str.find_last_not_of(" \t\r\n");
+    return str.substr(begin, end - begin + 1);
+}
@@ -0,0 +1,275 @@
+#include "Core/Scrub.hpp"
+#include "Core/VideoWriter.hpp"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+extern "C" {
+#include <libavutil/time.h>
+}
+
+// Master and proxy may start at different timestamps, positions are seconds
+// from the first frame of each.
+static int64_t stream_start(VideoReaderState* reader) {
+    int64_t start = reader->av_format_ctx->streams[reader->video_stream_index]->start_time;
+    return start != AV_NOPTS_VALUE ? start : 0;
+}
+
+static double to_seconds(VideoReaderState* reader, int64_t pts) {
+    return (pts - stream_start(reader)) * av_q2d(reader->time_base);
+}
+
+static int64_t to_pts(VideoReaderState* reader, double seconds) {
+    return stream_start(reader) + llround(seconds / av_q2d(reader->time_base));
+}
+
+// "clip.proxy.mp4" -> "clip.proxy.part.mp4", the extension still picks the container.
+static std::string partial_path(const std::string& path) {
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return path + ".part";
+    }
+    return path.substr(0, dot) + ".part" + path.substr(dot);
+}
+
+static bool file_exists(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    fclose(file);
+    return true;
+}
+
+// Encodes the proxy next to the master. Written under another name and
+// renamed when done, so a half written proxy is never picked up.
+static void generate_proxy(ScrubState* state, VideoReaderOptions options) {
+    std::string part_path = partial_path(state->proxy_path);
+
+    VideoReaderState reader;
+    if (!video_reader_open(&reader, state->master_path.c_str(), &options)) {
+        printf("Couldn't open %s to generate a proxy\n", state->master_path.c_str());
+        video_reader_close(&reader);
+        return;
+    }
+
+    // Decimated in the conversion already, the writer only scales the rest of the way
+    int shift = 0;
+    while ((reader.width >> (shift + 1)) >= state->options.proxy_width) {
+        shift++;
+    }
+    video_reader_set_decimation(&reader, shift);
+
+    int width = std::max(std::min(state->options.proxy_width, reader.width) & ~1, 2);
+    int height = std::max((int)((int64_t)width * reader.height / reader.width) & ~1, 2);
+    uint8_t* frame_buffer = (uint8_t*)av_malloc((size_t)AV_CEIL_RSHIFT(reader.width, shift) * AV_CEIL_RSHIFT(reader.height, shift) * 4);
+
+    VideoWriterOptions writer_options;
+    writer_options.keyframe_interval = state->options.proxy_keyframe_interval;
+    AVRational frame_rate = reader.av_format_ctx->streams[reader.video_stream_index]->avg_frame_rate;
+
+    VideoWriterState writer;
+    bool ok = frame_buffer && video_writer_open(&writer, part_path.c_str(), width, height,
+                                                reader.time_base, frame_rate, &writer_options);
+
+    int64_t start = stream_start(&reader);
+    while (ok && !state->quit) {
+        int64_t pts;
+        if (!video_reader_read_frame(&reader, &frame_buffer, &pts)) {
+            ok = reader.eof;
+            break;
+        }
+        ok = video_writer_write_frame(&writer, frame_buffer, reader.output_width * 4,
+                                      reader.output_width, reader.output_height, pts - start);
+        if (state->duration > 0.0) {
+            state->generate_progress = (float)std::min(to_seconds(&reader, pts) / state->duration, 0.99);
+        }
+    }
+
+    if (frame_buffer) {
+        ok = video_writer_close(&writer) && ok;
+    }
+    video_reader_close(&reader);
+    av_free(frame_buffer);
+
+    if (ok && !state->quit && rename(part_path.c_str(), state->proxy_path.c_str()) == 0) {
+        printf("Proxy written to %s\n", state->proxy_path.c_str());
+        state->generate_progress = 1.0f;
+        state->generated = true;
+    } else {
+        if (!state->quit) {
+            printf("Couldn't generate proxy %s\n", state->proxy_path.c_str());
+        }
+        remove(part_path.c_str());
+    }
+}
+
+static bool open_proxy(ScrubState* state) {
+    if (!video_reader_open(&state->proxy, state->proxy_path.c_str())) {
+        printf("Couldn't open proxy %s\n", state->proxy_path.c_str());
+        video_reader_close(&state->proxy);
+        return false;
+    }
+
+    state->proxy_buffer = (uint8_t*)av_malloc((size_t)state->proxy.width * state->proxy.height * 4);
+    if (!state->proxy_buffer) {
+        printf("Couldn't allocate proxy frame buffer\n");
+        video_reader_close(&state->proxy);
+        return false;
+    }
+
+    state->proxy_open = true;
+    state->proxy_width = state->proxy.width;
+    state->proxy_height = state->proxy.height;
+
+    return true;
+}
+
+// Seeks reader to the frame on screen at position and converts it.
+static bool seek_to(VideoReaderState* reader, uint8_t* frame_buffer, double position, int64_t* pts) {
+    return video_reader_seek_exact(reader, to_pts(reader, position), pts) &&
+           video_reader_convert_frame(reader, frame_buffer);
+}
+
+bool scrub_open(ScrubState* state, const char* master_path, const char* proxy_path,
+                const VideoReaderOptions* options, const ScrubOptions* scrub_options) {
+
+    state->options = scrub_options ? *scrub_options : ScrubOptions();
+    state->master_path = master_path;
+    state->proxy_path = proxy_path ? proxy_path : state->master_path + ".proxy.mp4";
+    state->master_buffer = NULL;
+    state->proxy_buffer = NULL;
+    state->proxy_open = false;
+    state->proxy_width = 0;
+    state->proxy_height = 0;
+    state->eof = false;
+    state->on_proxy = false;
+    state->discontinuity = false;
+    state->generate_progress = 0.0f;
+    state->stats = ScrubStats();
+    state->duration = 0.0;
+    state->position = 0.0;
+    state->last_seek = 0;
+    state->seek_pending = false;
+    state->generated = false;
+    state->quit = false;
+
+    if (!video_reader_open(&state->master, master_path, options)) {
+        printf("Couldn't open %s\n", master_path);
+        return false;
+    }
+
+    state->master_buffer = (uint8_t*)av_malloc((size_t)state->master.width * state->master.height * 4);
+    if (!state->master_buffer) {
+        printf("Couldn't allocate frame buffer\n");
+        return false;
+    }
+
+    state->width = state->master.width;
+    state->height = state->master.height;
+    if (state->master.av_format_ctx->duration != AV_NOPTS_VALUE) {
+        state->duration = state->master.av_format_ctx->duration / (double)AV_TIME_BASE;
+    }
+
+    if (file_exists(state->proxy_path)) {
+        // Scrubbing works without it, only slower
+        if (open_proxy(state)) {
+            state->generate_progress = 1.0f;
+        }
+    } else {
+        printf("Generating proxy %s\n", state->proxy_path.c_str());
+        VideoReaderOptions generator_options = options ? *options : VideoReaderOptions();
+        generator_options.follow = false;
+        generator_options.low_latency = false;
+        generator_options.high_bit_depth = false;
+        state->generator = std::thread(generate_proxy, state, generator_options);
+    }
+
+    return true;
+}
+
+void scrub_seek(ScrubState* state, double offset) {
+    double end = state->duration > 0.0 ? std::max(state->duration - 1.0, 0.0) : INFINITY;
+    state->position = std::min(std::max(state->position + offset, 0.0), end);
+    state->seek_pending = true;
+    state->last_seek = av_gettime_relative();
+    state->eof = false;
+    state->stats.seeks++;
+}
+
+bool scrub_read_frame(ScrubState* state, uint8_t** frame_buffer, double* pt_seconds) {
+
+    // A proxy generated in the background is used from the next seek on
+    if (!state->proxy_open && state->generated) {
+        state->generator.join();
+        state->generated = false;
+        open_proxy(state);
+    }
+
+    bool settled = av_gettime_relative() - state->last_seek >= state->options.settle_time * 1000000.0;
+    state->discontinuity = false;
+
+    // Seeks are applied here, so any number of them between two frames cost one
+    VideoReaderState* reader = state->on_proxy ? &state->proxy : &state->master;
+    uint8_t* buffer = state->on_proxy ? state->proxy_buffer : state->master_buffer;
+    int64_t pts;
+    if (state->seek_pending) {
+        state->seek_pending = false;
+        state->on_proxy = state->proxy_open;
+        reader = state->on_proxy ? &state->proxy : &state->master;
+        buffer = state->on_proxy ? state->proxy_buffer : state->master_buffer;
+        if (!seek_to(reader, buffer, state->position, &pts)) {
+            return false;
+        }
+        state->discontinuity = true;
+    } else if ((state->on_proxy && settled) || !video_reader_read_frame(reader, &buffer, &pts)) {
+        if (!state->on_proxy) {
+            state->eof = state->master.eof;
+            return false;
+        }
+
+        // The scrub settled (or ran into the end of the proxy): the master
+        // takes over at the frame the proxy showed last
+        int64_t start = av_gettime_relative();
+        state->on_proxy = false;
+        reader = &state->master;
+        buffer = state->master_buffer;
+        if (!seek_to(reader, buffer, state->position, &pts)) {
+            return false;
+        }
+        state->discontinuity = true;
+        state->stats.master_switches++;
+        state->stats.last_switch_time = (av_gettime_relative() - start) / 1000000.0;
+    }
+
+    if (state->on_proxy) {
+        state->stats.proxy_frames++;
+    }
+
+    state->position = to_seconds(reader, pts);
+    state->width = reader->output_width;
+    state->height = reader->output_height;
+
+    *frame_buffer = buffer;
+    *pt_seconds = state->position;
+
+    return true;
+}
+
+void scrub_close(ScrubState* state) {
+    state->quit = true;
+    if (state->generator.joinable()) {
+        state->generator.join();
+    }
+
+    if (state->proxy_open) {
+        video_reader_close(&state->proxy);
+        av_free(state->proxy_buffer);
+        state->proxy_open = false;
+    }
+    video_reader_close(&state->master);
+    av_free(state->master_buffer);
+}
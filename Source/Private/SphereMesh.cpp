@@ -0,0 +1,215 @@
+#include "Core/SphereMesh.hpp"
+
+#include <math.h>
+
+#include <algorithm>
+#include <chrono>
+
+// Cells per strip within a band. A row of a strip shares STRIP_CELLS + 1
+// vertices with the row before, which have to survive in the cache until
+// then along with the row's own.
+#define STRIP_CELLS 6
+
+static glm::vec3 grid_position(int lon_count, int lat_count, int i, int j) {
+    float stack_angle = (float)M_PI / 2 - i * (float)M_PI / lat_count;
+    float sector_angle = j * 2 * (float)M_PI / lon_count;
+    float xy = cosf(stack_angle);
+    return glm::vec3(xy * cosf(sector_angle), xy * sinf(sector_angle), sinf(stack_angle));
+}
+
+static void build_lod(SphereMesh* mesh, int lon_count, int lat_count) {
+    SphereLod lod;
+    lod.lon_count = lon_count;
+    lod.lat_count = lat_count;
+    lod.first_vertex = mesh->vertices.size();
+    lod.first_index = mesh->indices.size();
+
+    // Indices into the (lat_count + 1) x (lon_count + 1) grid first, the
+    // column at u = 1 repeats the one at u = 0 with other texture coordinates
+    int row_size = lon_count + 1;
+    std::vector<uint32_t> grid_indices;
+    grid_indices.reserve((size_t)lon_count * lat_count * 6);
+
+    for (int band_row = 0; band_row < SPHERE_MESH_BAND_ROWS; ++band_row) {
+        int i0 = band_row * lat_count / SPHERE_MESH_BAND_ROWS;
+        int i1 = (band_row + 1) * lat_count / SPHERE_MESH_BAND_ROWS;
+
+        for (int band_column = 0; band_column < SPHERE_MESH_BAND_COLUMNS; ++band_column) {
+            int j0 = band_column * lon_count / SPHERE_MESH_BAND_COLUMNS;
+            int j1 = (band_column + 1) * lon_count / SPHERE_MESH_BAND_COLUMNS;
+
+            SphereBand band;
+            band.first_index = grid_indices.size();
+
+            for (int strip = j0; strip < j1; strip += STRIP_CELLS) {
+                int strip_end = std::min(strip + STRIP_CELLS, j1);
+                for (int i = i0; i < i1; ++i) {
+                    for (int j = strip; j < strip_end; ++j) {
+                        uint32_t k1 = i * row_size + j;
+                        uint32_t k2 = k1 + row_size;
+
+                        // Triangles collapsing onto a pole are left out
+                        if (i != 0) {
+                            grid_indices.push_back(k1);
+                            grid_indices.push_back(k2);
+                            grid_indices.push_back(k1 + 1);
+                        }
+                        if (i != lat_count - 1) {
+                            grid_indices.push_back(k1 + 1);
+                            grid_indices.push_back(k2);
+                            grid_indices.push_back(k2 + 1);
+                        }
+                    }
+                }
+            }
+            band.index_count = grid_indices.size() - band.first_index;
+
+            // Bounding sphere of the band's grid points
+            glm::vec3 sum(0.0f);
+            for (int i = i0; i <= i1; ++i) {
+                for (int j = j0; j <= j1; ++j) {
+                    sum += grid_position(lon_count, lat_count, i, j);
+                }
+            }
+            band.center = sum / (float)((i1 - i0 + 1) * (j1 - j0 + 1));
+            band.radius = 0.0f;
+            for (int i = i0; i <= i1; ++i) {
+                for (int j = j0; j <= j1; ++j) {
+                    band.radius = std::max(band.radius, glm::length(grid_position(lon_count, lat_count, i, j) - band.center));
+                }
+            }
+            lod.bands.push_back(band);
+        }
+    }
+
+    // Vertices are numbered in the order they are first used, the grid
+    // vertices at the poles that no triangle uses are dropped
+    std::vector<int> remap((size_t)row_size * (lat_count + 1), -1);
+    uint32_t vertex_count = 0;
+    for (uint32_t& index : grid_indices) {
+        if (remap[index] < 0) {
+            remap[index] = vertex_count++;
+        }
+        index = remap[index];
+    }
+
+    lod.vertex_count = vertex_count;
+    mesh->vertices.resize(lod.first_vertex + vertex_count);
+    for (int i = 0; i <= lat_count; ++i) {
+        for (int j = 0; j <= lon_count; ++j) {
+            int vertex = remap[i * row_size + j];
+            if (vertex < 0) {
+                continue;
+            }
+            SphereVertex& out = mesh->vertices[lod.first_vertex + vertex];
+            out.position = grid_position(lon_count, lat_count, i, j);
+            out.tex_coords = glm::vec2((float)j / lon_count, (float)i / lat_count);
+        }
+    }
+
+    mesh->indices.insert(mesh->indices.end(), grid_indices.begin(), grid_indices.end());
+    lod.index_count = grid_indices.size();
+    lod.acmr = sphere_mesh_acmr(&mesh->indices[lod.first_index], lod.index_count, SPHERE_MESH_CACHE_SIZE);
+
+    mesh->lods.push_back(lod);
+}
+
+void sphere_mesh_build(SphereMesh* mesh, int lon_count, int lod_count) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    mesh->vertices.clear();
+    mesh->indices.clear();
+    mesh->lods.clear();
+
+    for (int lod = 0; lod < lod_count && lon_count >= 2 * SPHERE_MESH_BAND_COLUMNS; ++lod) {
+        build_lod(mesh, lon_count, lon_count / 2);
+        lon_count /= 2;
+    }
+
+    mesh->build_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int sphere_mesh_pick_lod(const SphereMesh* mesh, float fov_degrees, int viewport_height,
+                         float eye_distance, float cell_pixels) {
+
+    // The nearest surface that can be in view: straight ahead from inside,
+    // where the view grazes the far side from outside (the near side faces
+    // away and is culled). Cells are largest on screen there.
+    float surface_distance = eye_distance < 1.0f ? 1.0f - eye_distance : sqrtf(eye_distance * eye_distance - 1.0f);
+    surface_distance = std::max(surface_distance, 0.1f);
+    float pixels_per_radian = viewport_height / (fov_degrees * (float)M_PI / 180.0f);
+
+    for (int lod = (int)mesh->lods.size() - 1; lod > 0; --lod) {
+        float cell_radians = 2.0f * (float)M_PI / mesh->lods[lod].lon_count;
+        if (cell_radians / surface_distance * pixels_per_radian <= cell_pixels) {
+            return lod;
+        }
+    }
+    return 0;
+}
+
+void sphere_mesh_cull(const SphereMesh* mesh, int lod, const glm::mat4& mvp, SphereMeshDraws* draws) {
+    const SphereLod& level = mesh->lods[lod];
+
+    // Frustum planes in model space, ax + by + cz + d >= 0 inside
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; ++i) {
+        rows[i] = glm::vec4(mvp[0][i], mvp[1][i], mvp[2][i], mvp[3][i]);
+    }
+    glm::vec4 planes[6] = {
+        rows[3] + rows[0], rows[3] - rows[0],
+        rows[3] + rows[1], rows[3] - rows[1],
+        rows[3] + rows[2], rows[3] - rows[2],
+    };
+
+    draws->counts.clear();
+    draws->offsets.clear();
+    draws->base_vertices.clear();
+    draws->bands = 0;
+    draws->triangles = 0;
+
+    uint32_t range_end = UINT32_MAX;
+    for (const SphereBand& band : level.bands) {
+        bool inside = true;
+        for (const glm::vec4& plane : planes) {
+            float distance = glm::dot(glm::vec3(plane), band.center) + plane.w;
+            if (distance < -band.radius * glm::length(glm::vec3(plane))) {
+                inside = false;
+                break;
+            }
+        }
+        if (!inside || band.index_count == 0) {
+            continue;
+        }
+
+        draws->bands++;
+        draws->triangles += band.index_count / 3;
+        if (band.first_index == range_end) {
+            draws->counts.back() += band.index_count;
+        } else {
+            draws->counts.push_back(band.index_count);
+            draws->offsets.push_back((const void*)((size_t)(level.first_index + band.first_index) * sizeof(uint16_t)));
+            draws->base_vertices.push_back(level.first_vertex);
+        }
+        range_end = band.first_index + band.index_count;
+    }
+}
+
+float sphere_mesh_acmr(const uint16_t* indices, size_t index_count, int cache_size) {
+    if (index_count < 3) {
+        return 0.0f;
+    }
+
+    std::vector<int> cache(cache_size, -1);
+    int next = 0;
+    size_t misses = 0;
+    for (size_t i = 0; i < index_count; ++i) {
+        if (std::find(cache.begin(), cache.end(), (int)indices[i]) != cache.end()) {
+            continue;
+        }
+        cache[next] = indices[i];
+        next = (next + 1) % cache_size;
+        misses++;
+    }
+    return (float)misses / (index_count / 3);
+}
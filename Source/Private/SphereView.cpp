@@ -0,0 +1,181 @@
+#include "Core/SphereView.hpp"
+
+#include <math.h>
+
+#include <algorithm>
+
+// Screen points sampled along each axis. Cells smaller than the spacing can
+// be missed, the margin covers them.
+#define SPHERE_VIEW_SAMPLES 32
+
+// Grid the bounds are worked out on, cells of 5.625 degrees
+#define SPHERE_VIEW_BOUNDS_COLUMNS 64
+#define SPHERE_VIEW_BOUNDS_ROWS 32
+
+// sphere_view_cast() with the inverse of mvp already at hand.
+static bool cast_ray(const glm::mat4& inverse, float ndc_x, float ndc_y, glm::vec2* uv) {
+    glm::vec4 near_point = inverse * glm::vec4(ndc_x, ndc_y, -1.0f, 1.0f);
+    glm::vec4 far_point = inverse * glm::vec4(ndc_x, ndc_y, 1.0f, 1.0f);
+    glm::vec3 origin = glm::vec3(near_point) / near_point.w;
+    glm::vec3 direction = glm::normalize(glm::vec3(far_point) / far_point.w - origin);
+
+    // |origin + t * direction| = 1, far root
+    float b = glm::dot(origin, direction);
+    float c = glm::dot(origin, origin) - 1.0f;
+    float discriminant = b * b - c;
+    if (discriminant < 0.0f) {
+        return false;
+    }
+    float t = -b + sqrtf(discriminant);
+    if (t < 0.0f) {
+        return false;
+    }
+
+    glm::vec3 hit = origin + t * direction;
+    float lon = atan2f(hit.y, hit.x);
+    if (lon < 0.0f) {
+        lon += 2.0f * (float)M_PI;
+    }
+    float lat = asinf(glm::clamp(hit.z, -1.0f, 1.0f));
+
+    uv->x = lon / (2.0f * (float)M_PI);
+    uv->y = 0.5f - lat / (float)M_PI;
+    return true;
+}
+
+bool sphere_view_cast(const glm::mat4& mvp, float ndc_x, float ndc_y, glm::vec2* uv) {
+    return cast_ray(glm::inverse(mvp), ndc_x, ndc_y, uv);
+}
+
+void sphere_view_visible_cells(const glm::mat4& mvp, int columns, int rows, float margin_degrees,
+                               std::vector<uint8_t>* visible) {
+    std::vector<uint8_t> hits(columns * rows, 0);
+
+    for (int y = 0; y <= SPHERE_VIEW_SAMPLES; ++y) {
+        for (int x = 0; x <= SPHERE_VIEW_SAMPLES; ++x) {
+            glm::vec2 uv;
+            float ndc_x = -1.0f + 2.0f * x / SPHERE_VIEW_SAMPLES;
+            float ndc_y = -1.0f + 2.0f * y / SPHERE_VIEW_SAMPLES;
+            if (!sphere_view_cast(mvp, ndc_x, ndc_y, &uv)) {
+                continue;
+            }
+            int column = std::min((int)(uv.x * columns), columns - 1);
+            int row = std::min((int)(uv.y * rows), rows - 1);
+            hits[row * columns + column] = 1;
+        }
+    }
+
+    // Grow by the margin, wrapping around in longitude
+    int margin_columns = (int)ceilf(margin_degrees / (360.0f / columns));
+    int margin_rows = (int)ceilf(margin_degrees / (180.0f / rows));
+
+    visible->assign(columns * rows, 0);
+    for (int row = 0; row < rows; ++row) {
+        for (int column = 0; column < columns; ++column) {
+            if (!hits[row * columns + column]) {
+                continue;
+            }
+            for (int dy = -margin_rows; dy <= margin_rows; ++dy) {
+                int r = row + dy;
+                if (r < 0 || r >= rows) {
+                    continue;
+                }
+                for (int dx = -margin_columns; dx <= margin_columns; ++dx) {
+                    int c = ((column + dx) % columns + columns) % columns;
+                    (*visible)[r * columns + c] = 1;
+                }
+            }
+        }
+    }
+}
+
+int sphere_view_bounds(const glm::mat4& mvp, float margin_degrees, glm::vec4 bounds[2]) {
+    const int columns = SPHERE_VIEW_BOUNDS_COLUMNS;
+    const int rows = SPHERE_VIEW_BOUNDS_ROWS;
+
+    std::vector<uint8_t> visible;
+    sphere_view_visible_cells(mvp, columns, rows, margin_degrees, &visible);
+
+    int first_row = rows, last_row = -1;
+    std::vector<uint8_t> column_visible(columns, 0);
+    for (int row = 0; row < rows; ++row) {
+        for (int column = 0; column < columns; ++column) {
+            if (visible[row * columns + column]) {
+                first_row = std::min(first_row, row);
+                last_row = std::max(last_row, row);
+                column_visible[column] = 1;
+            }
+        }
+    }
+    if (last_row < 0) {
+        return 0;
+    }
+
+    float v0 = (float)first_row / rows;
+    float v1 = (float)(last_row + 1) / rows;
+
+    // The longitudes needed are everything but the widest run of columns
+    // out of view, which may wrap around the seam
+    int gap_start = 0, gap_length = 0;
+    for (int start = 0; start < columns; ++start) {
+        if (column_visible[start] || column_visible[(start + columns - 1) % columns] == 0) {
+            continue;   // only runs starting right after a visible column
+        }
+        int length = 0;
+        while (length < columns && !column_visible[(start + length) % columns]) {
+            length++;
+        }
+        if (length > gap_length) {
+            gap_start = start;
+            gap_length = length;
+        }
+    }
+
+    if (gap_length == 0) {
+        bounds[0] = glm::vec4(0.0f, v0, 1.0f, v1);
+        return 1;
+    }
+
+    int first_column = (gap_start + gap_length) % columns;
+    int last_column = (gap_start + columns - 1) % columns;
+    if (first_column <= last_column) {
+        bounds[0] = glm::vec4((float)first_column / columns, v0, (float)(last_column + 1) / columns, v1);
+        return 1;
+    }
+
+    bounds[0] = glm::vec4((float)first_column / columns, v0, 1.0f, v1);
+    bounds[1] = glm::vec4(0.0f, v0, (float)(last_column + 1) / columns, v1);
+    return 2;
+}
+
+void sphere_view_footprints(const glm::mat4& mvp, int viewport_width, int viewport_height, int spacing,
+                            int frame_width, int frame_height, std::vector<ViewFootprint>* footprints) {
+    glm::mat4 inverse = glm::inverse(mvp);
+    float pixel_x = 2.0f / viewport_width;
+    float pixel_y = 2.0f / viewport_height;
+
+    footprints->clear();
+    for (int y = spacing / 2; y < viewport_height; y += spacing) {
+        for (int x = spacing / 2; x < viewport_width; x += spacing) {
+            float ndc_x = -1.0f + x * pixel_x;
+            float ndc_y = -1.0f + y * pixel_y;
+
+            glm::vec2 uv, uv_x, uv_y;
+            if (!cast_ray(inverse, ndc_x, ndc_y, &uv) ||
+                !cast_ray(inverse, ndc_x + pixel_x, ndc_y, &uv_x) ||
+                !cast_ray(inverse, ndc_x, ndc_y + pixel_y, &uv_y)) {
+                continue;
+            }
+
+            // Steps across the seam go the short way around
+            glm::vec2 dx = uv_x - uv;
+            glm::vec2 dy = uv_y - uv;
+            dx.x -= roundf(dx.x);
+            dy.x -= roundf(dy.x);
+
+            glm::vec2 size((float)frame_width, (float)frame_height);
+            float texels = std::max(glm::length(dx * size), glm::length(dy * size));
+            footprints->push_back(ViewFootprint{ uv, texels });
+        }
+    }
+}
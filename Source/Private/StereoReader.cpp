@@ -0,0 +1,230 @@
+#include "Core/StereoReader.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+// Reads that fail without reaching the end are retried after a pause that
+// doubles up to the maximum, until this many fail in a row.
+#define STEREO_RETRY_MIN_MS 10
+#define STEREO_RETRY_MAX_MS 200
+#define STEREO_MAX_READ_ERRORS 50
+
+static void decode_loop(StereoState* state, StereoEye* eye) {
+    int failures = 0;
+    int retry_ms = STEREO_RETRY_MIN_MS;
+    std::unique_lock<std::mutex> lock(eye->mutex);
+    while (true) {
+        eye->cv.wait(lock, [state, eye]() { return state->quit || eye->count < STEREO_QUEUE_SIZE - 1; });
+        if (state->quit) {
+            return;
+        }
+
+        StereoFrame* frame = &eye->slots[(eye->read_index + eye->count) % STEREO_QUEUE_SIZE];
+        lock.unlock();
+        bool ok = video_reader_read_frame(&eye->reader, &frame->data, &frame->pts);
+        lock.lock();
+
+        if (!ok) {
+            // A corrupt packet fails once, a broken stream fails every read.
+            // The pause is cut short by stereo_close().
+            if (!eye->reader.eof && ++failures < STEREO_MAX_READ_ERRORS) {
+                eye->cv.wait_for(lock, std::chrono::milliseconds(retry_ms), [state]() { return (bool)state->quit; });
+                retry_ms = std::min(retry_ms * 2, STEREO_RETRY_MAX_MS);
+                continue;
+            }
+            if (!eye->reader.eof) {
+                printf("Couldn't read the stereo video, stopping after %d failed reads in a row\n", failures);
+            }
+            eye->eof = true;
+            eye->cv.notify_all();
+            return;
+        }
+
+        failures = 0;
+        retry_ms = STEREO_RETRY_MIN_MS;
+        eye->count++;
+        eye->cv.notify_all();
+    }
+}
+
+// Waits for a decoded frame. Returns NULL at the end of the stream.
+static StereoFrame* peek_frame(StereoEye* eye) {
+    std::unique_lock<std::mutex> lock(eye->mutex);
+    eye->cv.wait(lock, [eye]() { return eye->count > 0 || eye->eof; });
+    return eye->count > 0 ? &eye->slots[eye->read_index] : NULL;
+}
+
+// Hands out the frame at the head of the queue, which frees the slot of the
+// frame handed out before it.
+static StereoFrame* take_frame(StereoEye* eye) {
+    std::lock_guard<std::mutex> lock(eye->mutex);
+    StereoFrame* frame = &eye->slots[eye->read_index];
+    eye->read_index = (eye->read_index + 1) % STEREO_QUEUE_SIZE;
+    eye->count--;
+    eye->taken = true;
+    eye->cv.notify_all();
+    return frame;
+}
+
+static StereoFrame* last_taken(StereoEye* eye) {
+    return eye->taken ? &eye->slots[(eye->read_index + STEREO_QUEUE_SIZE - 1) % STEREO_QUEUE_SIZE] : NULL;
+}
+
+static double frame_position(StereoEye* eye, StereoFrame* frame) {
+    return frame->pts * av_q2d(eye->reader.time_base);
+}
+
+static bool open_eye(StereoEye* eye, const char* filename, int stream_index, const VideoReaderOptions* options) {
+    VideoReaderOptions eye_options = options ? *options : VideoReaderOptions();
+    eye_options.stream_index = stream_index;
+
+    if (!video_reader_open(&eye->reader, filename, &eye_options)) {
+        video_reader_close(&eye->reader);
+        return false;
+    }
+
+    eye->opened = true;
+    for (int i = 0; i < STEREO_QUEUE_SIZE; ++i) {
+        eye->slots[i].data = (uint8_t*)av_malloc(eye->reader.width * eye->reader.height * 4);
+        if (!eye->slots[i].data) {
+            printf("Couldn't allocate stereo frame buffers\n");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool stereo_open(StereoState* state, const char* filename, const VideoReaderOptions* options) {
+
+    state->eof = false;
+    state->quit = false;
+    state->stats = StereoStats();
+
+    for (StereoEye& eye : state->eyes) {
+        eye.opened = false;
+        eye.read_index = 0;
+        eye.count = 0;
+        eye.taken = false;
+        eye.eof = false;
+        for (StereoFrame& slot : eye.slots) {
+            slot.data = NULL;
+        }
+    }
+
+    StereoEye* left = &state->eyes[0];
+    StereoEye* right = &state->eyes[1];
+
+    if (!open_eye(left, filename, -1, options)) {
+        return false;
+    }
+
+    // The right eye is the next video stream after the left one
+    AVFormatContext* av_format_ctx = left->reader.av_format_ctx;
+    int right_index = -1;
+    for (unsigned i = left->reader.video_stream_index + 1; i < av_format_ctx->nb_streams; ++i) {
+        if (av_format_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+            right_index = (int)i;
+            break;
+        }
+    }
+    if (right_index == -1) {
+        printf("Couldn't find a second video stream for the right eye\n");
+        return false;
+    }
+
+    if (!open_eye(right, filename, right_index, options)) {
+        return false;
+    }
+
+    if (left->reader.width != right->reader.width || left->reader.height != right->reader.height) {
+        printf("Left and right eye streams differ in size\n");
+        return false;
+    }
+
+    state->width = left->reader.width;
+    state->height = left->reader.height;
+
+    AVRational frame_rate = av_format_ctx->streams[left->reader.video_stream_index]->avg_frame_rate;
+    state->frame_interval = frame_rate.num > 0 && frame_rate.den > 0 ? av_q2d(av_inv_q(frame_rate)) : 1.0 / 30.0;
+
+    for (StereoEye& eye : state->eyes) {
+        eye.thread = std::thread(decode_loop, state, &eye);
+    }
+
+    return true;
+}
+
+bool stereo_read_frame(StereoState* state, uint8_t** left, uint8_t** right, double* pt_seconds) {
+
+    if (state->eof) {
+        return false;
+    }
+
+    StereoEye* left_eye = &state->eyes[0];
+    StereoEye* right_eye = &state->eyes[1];
+
+    if (!peek_frame(left_eye)) {
+        state->eof = true;
+        return false;
+    }
+    StereoFrame* left_frame = take_frame(left_eye);
+    double position = frame_position(left_eye, left_frame);
+    double half_frame = state->frame_interval / 2.0;
+
+    StereoFrame* right_frame = NULL;
+    StereoFrame* next;
+    while ((next = peek_frame(right_eye))) {
+        double right_position = frame_position(right_eye, next);
+
+        if (right_position < position - half_frame) {
+            // Right eye behind: skip frames until it catches up
+            take_frame(right_eye);
+            state->stats.dropped++;
+            continue;
+        }
+
+        if (right_position <= position + half_frame || !last_taken(right_eye)) {
+            right_frame = take_frame(right_eye);
+        }
+        break;
+    }
+
+    if (!right_frame) {
+        // Right eye ahead or finished: hold its last frame
+        right_frame = last_taken(right_eye);
+        if (!right_frame) {
+            state->eof = true;
+            return false;
+        }
+        state->stats.duplicated++;
+    }
+
+    state->stats.pairs++;
+
+    *left = left_frame->data;
+    *right = right_frame->data;
+    *pt_seconds = position;
+
+    return true;
+}
+
+void stereo_close(StereoState* state) {
+    for (StereoEye& eye : state->eyes) {
+        std::lock_guard<std::mutex> lock(eye.mutex);
+        state->quit = true;
+        eye.cv.notify_all();
+    }
+
+    for (StereoEye& eye : state->eyes) {
+        if (eye.thread.joinable()) {
+            eye.thread.join();
+        }
+        if (eye.opened) {
+            video_reader_close(&eye.reader);
+        }
+        for (StereoFrame& slot : eye.slots) {
+            av_freep(&slot.data);
+        }
+    }
+}
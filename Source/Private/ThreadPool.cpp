@@ -0,0 +1,69 @@
+#include <Core/ThreadPool.hpp>
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(int thread_count)
+    : m_busy(0), m_quit(false)
+{
+    if(thread_count <= 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+    for(int i = 0; i < thread_count; ++i)
+        m_threads.emplace_back(&ThreadPool::Run, this);
+}
+
+ThreadPool::~ThreadPool(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_cv.notify_all();
+
+    for(std::thread& thread : m_threads)
+        thread.join();
+}
+
+void ThreadPool::Submit(Job job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(std::move(job));
+    }
+    m_cv.notify_one();
+}
+
+void ThreadPool::Wait(void)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle_cv.wait(lock, [this]() { return m_jobs.empty() && m_busy == 0; });
+}
+
+int ThreadPool::GetThreadCount(void) const
+{
+    return (int)m_threads.size();
+}
+
+void ThreadPool::Run(void)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(true)
+    {
+        m_cv.wait(lock, [this]() { return m_quit || !m_jobs.empty(); });
+
+        if(m_jobs.empty())
+            return;
+
+        Job job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+        m_busy++;
+
+        lock.unlock();
+        job();
+        lock.lock();
+
+        m_busy--;
+        if(m_jobs.empty() && m_busy == 0)
+            m_idle_cv.notify_all();
+    }
+}
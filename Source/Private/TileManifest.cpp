@@ -0,0 +1,116 @@
+#include "Core/TileManifest.hpp"
+#include "Core/Resource.hpp"
+
+#include <stdio.h>
+
+#include <sstream>
+
+// Reads "<url> [stream index]" from the rest of a directive.
+static bool parse_stream(const std::string& manifest_url, std::istringstream& in, TileStream* stream) {
+    std::string ref;
+    if (!(in >> ref)) {
+        return false;
+    }
+
+    stream->url = resource_resolve_url(manifest_url, ref);
+    if (!(in >> stream->stream_index)) {
+        stream->stream_index = -1;
+    }
+    return true;
+}
+
+bool tile_manifest_load(const char* url, TileManifest* manifest) {
+    std::string text;
+    if (!resource_read_text(url, &text)) {
+        return false;
+    }
+
+    manifest->columns = 0;
+    manifest->rows = 0;
+    manifest->width = 0;
+    manifest->height = 0;
+    manifest->base = TileStream{ "", -1 };
+    manifest->tiles.clear();
+
+    std::istringstream lines(text);
+    std::string line;
+    int line_number = 0;
+    while (std::getline(lines, line)) {
+        ++line_number;
+        line = resource_trim(line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        std::istringstream in(line);
+        std::string directive;
+        in >> directive;
+
+        bool ok = true;
+        if (directive == "grid") {
+            ok = (in >> manifest->columns >> manifest->rows) && manifest->columns > 0 && manifest->rows > 0;
+            if (ok) {
+                manifest->tiles.assign(manifest->columns * manifest->rows, TileStream{ "", -1 });
+            }
+        } else if (directive == "size") {
+            ok = (bool)(in >> manifest->width >> manifest->height);
+        } else if (directive == "base") {
+            ok = parse_stream(url, in, &manifest->base);
+        } else if (directive == "tile") {
+            int column, row;
+            ok = (in >> column >> row) &&
+                 column >= 0 && column < manifest->columns && row >= 0 && row < manifest->rows &&
+                 parse_stream(url, in, &manifest->tiles[row * manifest->columns + column]);
+        }
+
+        if (!ok) {
+            printf("Couldn't parse line %d of tile manifest %s\n", line_number, url);
+            return false;
+        }
+    }
+
+    if (manifest->tiles.empty() || manifest->base.url.empty()) {
+        printf("Tile manifest %s needs a grid and a base layer\n", url);
+        return false;
+    }
+    for (int i = 0; i < (int)manifest->tiles.size(); ++i) {
+        if (manifest->tiles[i].url.empty()) {
+            printf("Tile manifest %s is missing tile %d %d\n", url, i % manifest->columns, i / manifest->columns);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void write_stream(FILE* file, const TileStream& stream) {
+    fprintf(file, " %s", stream.url.c_str());
+    if (stream.stream_index >= 0) {
+        fprintf(file, " %d", stream.stream_index);
+    }
+    fprintf(file, "\n");
+}
+
+bool tile_manifest_save(const char* path, const TileManifest& manifest) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        printf("Couldn't open %s for writing\n", path);
+        return false;
+    }
+
+    fprintf(file, "grid %d %d\n", manifest.columns, manifest.rows);
+    fprintf(file, "size %d %d\n", manifest.width, manifest.height);
+    fprintf(file, "base");
+    write_stream(file, manifest.base);
+    for (int i = 0; i < (int)manifest.tiles.size(); ++i) {
+        fprintf(file, "tile %d %d", i % manifest.columns, i / manifest.columns);
+        write_stream(file, manifest.tiles[i]);
+    }
+
+    bool ok = !ferror(file);
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        printf("Couldn't write %s\n", path);
+    }
+    return ok;
+}
@@ -0,0 +1,229 @@
+#include "Core/TiledPlayer.hpp"
+
+extern "C" {
+#include <libavutil/time.h>
+}
+
+static double tile_position(Tile* tile) {
+    return tile->pts * av_q2d(tile->reader.time_base);
+}
+
+static bool open_tile(Tile* tile, const TileStream& stream, const VideoReaderOptions& options) {
+    VideoReaderOptions tile_options = options;
+    tile_options.stream_index = stream.stream_index;
+
+    if (!video_reader_open(&tile->reader, stream.url.c_str(), &tile_options)) {
+        printf("Couldn't open tile %d %d (%s)\n", tile->column, tile->row, stream.url.c_str());
+        video_reader_close(&tile->reader);
+        return false;
+    }
+
+    tile->width = tile->reader.width;
+    tile->height = tile->reader.height;
+    tile->frame_buffer = (uint8_t*)av_malloc(tile->width * tile->height * 4);
+    if (!tile->frame_buffer) {
+        printf("Couldn't allocate frame buffer for tile %d %d\n", tile->column, tile->row);
+        video_reader_close(&tile->reader);
+        return false;
+    }
+
+    tile->opened = true;
+    return true;
+}
+
+// Positions an idle tile on its first keyframe after position.
+static void prepare_tile(Tile* tile, double position) {
+    int64_t ts = (int64_t)(position / av_q2d(tile->reader.time_base));
+    if (!video_reader_seek_keyframe(&tile->reader, ts, &tile->pts)) {
+        tile->status = TILE_IDLE;
+        return;
+    }
+    tile->status = TILE_PENDING;
+}
+
+// Brings a tile up to the frame of the base layer at position.
+static void step_tile(Tile* tile, double position, double half_frame) {
+    tile->updated = false;
+
+    if (tile->status == TILE_IDLE) {
+        if (!tile->wanted || tile->reader.eof) {
+            return;
+        }
+        prepare_tile(tile, position);
+    }
+
+    if (tile->status == TILE_PENDING) {
+        double start = tile_position(tile);
+        if (position < start - half_frame) {
+            return;
+        }
+        if (position > start + half_frame) {
+            // The keyframe went by (the tile was prepared late), try the next one
+            tile->status = TILE_IDLE;
+            if (tile->wanted) {
+                prepare_tile(tile, position);
+            }
+            return;
+        }
+
+        tile->status = TILE_ACTIVE;
+        tile->updated = video_reader_convert_frame(&tile->reader, tile->frame_buffer);
+        return;
+    }
+
+    bool decoded = false;
+    while (tile_position(tile) < position - half_frame) {
+        if (!video_reader_decode_frame(&tile->reader, &tile->pts)) {
+            tile->status = TILE_IDLE;
+            return;
+        }
+        if (!tile->wanted && (tile->reader.av_frame->flags & AV_FRAME_FLAG_KEY)) {
+            tile->status = TILE_IDLE;
+            return;
+        }
+        decoded = true;
+    }
+
+    if (decoded) {
+        tile->updated = video_reader_convert_frame(&tile->reader, tile->frame_buffer);
+    }
+}
+
+bool tiled_open(TiledState* state, const char* manifest_url, const VideoReaderOptions* options) {
+
+    VideoReaderOptions reader_options = options ? *options : VideoReaderOptions();
+
+    state->base_frame_buffer = NULL;
+    state->pool = NULL;
+    state->eof = false;
+    state->stats = TiledStats();
+    state->tiles.clear();
+
+    if (!tile_manifest_load(manifest_url, &state->manifest)) {
+        return false;
+    }
+
+    const TileManifest& manifest = state->manifest;
+
+    VideoReaderOptions base_options = reader_options;
+    base_options.stream_index = manifest.base.stream_index;
+    if (!video_reader_open(&state->base, manifest.base.url.c_str(), &base_options)) {
+        printf("Couldn't open base layer %s\n", manifest.base.url.c_str());
+        video_reader_close(&state->base);
+        return false;
+    }
+
+    state->width = state->base.width;
+    state->height = state->base.height;
+    state->base_frame_buffer = (uint8_t*)av_malloc(state->width * state->height * 4);
+    if (!state->base_frame_buffer) {
+        printf("Couldn't allocate frame buffer for base layer\n");
+        tiled_close(state);
+        return false;
+    }
+
+    AVRational frame_rate = state->base.av_format_ctx->streams[state->base.video_stream_index]->avg_frame_rate;
+    state->frame_interval = frame_rate.num > 0 && frame_rate.den > 0 ? av_q2d(av_inv_q(frame_rate)) : 1.0 / 30.0;
+
+    state->pool = new ThreadPool();
+
+    state->tiles.resize(manifest.tiles.size());
+    for (int i = 0; i < (int)state->tiles.size(); ++i) {
+        Tile* tile = &state->tiles[i];
+        tile->column = i % manifest.columns;
+        tile->row = i / manifest.columns;
+        tile->status = TILE_IDLE;
+        tile->width = 0;
+        tile->height = 0;
+        tile->frame_buffer = NULL;
+        tile->updated = false;
+        tile->opened = false;
+        tile->wanted = false;
+        tile->pts = 0;
+
+        const TileStream& stream = manifest.tiles[i];
+        state->pool->Submit([tile, &stream, &reader_options]() {
+            open_tile(tile, stream, reader_options);
+        });
+    }
+    state->pool->Wait();
+
+    for (Tile& tile : state->tiles) {
+        if (!tile.opened) {
+            tiled_close(state);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void tiled_set_visible(TiledState* state, const std::vector<uint8_t>& visible) {
+    for (int i = 0; i < (int)state->tiles.size() && i < (int)visible.size(); ++i) {
+        state->tiles[i].wanted = visible[i] != 0;
+    }
+}
+
+bool tiled_read_frame(TiledState* state, uint8_t** frame_buffer, double* pt_seconds) {
+
+    if (state->eof) {
+        return false;
+    }
+
+    int64_t start = av_gettime_relative();
+
+    // The base layer drives the timeline
+    int64_t pts;
+    if (!video_reader_decode_frame(&state->base, &pts)) {
+        state->eof = state->base.eof;
+        return false;
+    }
+    double position = pts * av_q2d(state->base.time_base);
+    double half_frame = state->frame_interval / 2.0;
+
+    bool converted = false;
+    state->pool->Submit([state, &converted]() {
+        converted = video_reader_convert_frame(&state->base, state->base_frame_buffer);
+    });
+    for (Tile& tile : state->tiles) {
+        Tile* tile_ptr = &tile;
+        state->pool->Submit([tile_ptr, position, half_frame]() {
+            step_tile(tile_ptr, position, half_frame);
+        });
+    }
+    state->pool->Wait();
+
+    if (!converted) {
+        return false;
+    }
+
+    state->stats.active_tiles = 0;
+    state->stats.pending_tiles = 0;
+    for (Tile& tile : state->tiles) {
+        state->stats.active_tiles += tile.status == TILE_ACTIVE;
+        state->stats.pending_tiles += tile.status == TILE_PENDING;
+    }
+    state->stats.decode_time = (av_gettime_relative() - start) / 1000000.0;
+
+    *frame_buffer = state->base_frame_buffer;
+    *pt_seconds = position;
+
+    return true;
+}
+
+void tiled_close(TiledState* state) {
+    delete state->pool;
+    state->pool = NULL;
+
+    for (Tile& tile : state->tiles) {
+        if (tile.opened) {
+            video_reader_close(&tile.reader);
+            av_free(tile.frame_buffer);
+        }
+    }
+    state->tiles.clear();
+
+    video_reader_close(&state->base);
+    av_free(state->base_frame_buffer);
+    state->base_frame_buffer = NULL;
+}
@@ -0,0 +1,168 @@
+#include <Core/TiledTexture.hpp>
+
+#include <string.h>
+
+#include <algorithm>
+
+// Tiles are bordered by one texel on each side
+#define TILE_BORDER 1
+
+TiledTexture::TiledTexture(void)
+    : m_texture(0), m_width(0), m_height(0), m_tile_width(0), m_tile_height(0), m_columns(0), m_rows(0)
+{
+}
+
+TiledTexture::~TiledTexture(void)
+{
+    Release();
+}
+
+void TiledTexture::Release(void)
+{
+    if(m_texture)
+        glDeleteTextures(1, &m_texture);
+    m_texture = 0;
+}
+
+bool TiledTexture::IsNeeded(int width, int height, int max_size)
+{
+    return width > max_size || height > max_size;
+}
+
+void TiledTexture::Allocate(int width, int height, int max_size)
+{
+    int tile_max = max_size - 2 * TILE_BORDER;
+    m_width = width;
+    m_height = height;
+    m_columns = (width + tile_max - 1) / tile_max;
+    m_rows = (height + tile_max - 1) / tile_max;
+
+    // Evenly sized, a 12K frame becomes two 6K tiles rather than 8K and 4K
+    m_tile_width = (width + m_columns - 1) / m_columns;
+    m_tile_height = (height + m_rows - 1) / m_rows;
+
+    if(!m_texture)
+        glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, m_tile_width + 2 * TILE_BORDER, m_tile_height + 2 * TILE_BORDER,
+        m_columns * m_rows, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void TiledTexture::Upload(UploadRing& ring, const uint8_t* frame, const VideoRect* rects, int count)
+{
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+
+    // Each rectangle is cut along the tiles, a texel next to a tile edge
+    // goes into the border of the neighbouring tile as well. Pieces are
+    // cut further into bands of rows where a slot of the ring fills up.
+    m_pieces.clear();
+    size_t size = 0;
+    size_t max_size = ring.GetMaxSize();
+    for(int i = 0; i < count; i++)
+    {
+        const VideoRect& rect = rects[i];
+        if(rect.width <= 0 || rect.height <= 0)
+            continue;
+
+        int first_column = std::max((rect.x - TILE_BORDER) / m_tile_width, 0);
+        int last_column = std::min((rect.x + rect.width + TILE_BORDER - 1) / m_tile_width, m_columns - 1);
+        int first_row = std::max((rect.y - TILE_BORDER) / m_tile_height, 0);
+        int last_row = std::min((rect.y + rect.height + TILE_BORDER - 1) / m_tile_height, m_rows - 1);
+
+        for(int row = first_row; row <= last_row; row++)
+        {
+            for(int column = first_column; column <= last_column; column++)
+            {
+                int layer_x0 = column * m_tile_width - TILE_BORDER;
+                int layer_y0 = row * m_tile_height - TILE_BORDER;
+                int x0 = std::max(rect.x, layer_x0);
+                int y0 = std::max(rect.y, layer_y0);
+                int x1 = std::min(rect.x + rect.width, layer_x0 + m_tile_width + 2 * TILE_BORDER);
+                int y1 = std::min(rect.y + rect.height, layer_y0 + m_tile_height + 2 * TILE_BORDER);
+                if(x1 <= x0 || y1 <= y0)
+                    continue;
+
+                size_t row_size = (size_t)(x1 - x0) * 4;
+                for(int y = y0; y < y1; )
+                {
+                    size_t room = size < max_size ? max_size - size : 0;
+                    int rows = (int)std::min(room / row_size, (size_t)(y1 - y));
+                    if(rows == 0 && size > 0)
+                    {
+                        UploadPieces(ring, frame, size);
+                        m_pieces.clear();
+                        size = 0;
+                        continue;
+                    }
+                    rows = std::max(rows, 1);
+
+                    Piece piece = { row * m_columns + column, x0 - layer_x0, y - layer_y0, { x0, y, x1 - x0, rows } };
+                    m_pieces.push_back(piece);
+                    size += row_size * rows;
+                    y += rows;
+                }
+            }
+        }
+    }
+    if(!m_pieces.empty())
+        UploadPieces(ring, frame, size);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void TiledTexture::UploadPieces(UploadRing& ring, const uint8_t* frame, size_t size)
+{
+    uint8_t* slot = ring.Acquire(size);
+    if(!slot)
+    {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, m_width);
+        for(const Piece& piece : m_pieces)
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, piece.layer_x, piece.layer_y, piece.layer,
+                piece.source.width, piece.source.height, 1, GL_RGBA, GL_UNSIGNED_BYTE,
+                frame + ((size_t)piece.source.y * m_width + piece.source.x) * 4);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        return;
+    }
+
+    size_t offset = 0;
+    for(const Piece& piece : m_pieces)
+    {
+        size_t row_size = (size_t)piece.source.width * 4;
+        const uint8_t* src = frame + ((size_t)piece.source.y * m_width + piece.source.x) * 4;
+        for(int y = 0; y < piece.source.height; y++)
+            memcpy(slot + offset + y * row_size, src + (size_t)y * m_width * 4, row_size);
+        offset += row_size * piece.source.height;
+    }
+
+    ring.Bind();
+    offset = 0;
+    for(const Piece& piece : m_pieces)
+    {
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, piece.layer_x, piece.layer_y, piece.layer,
+            piece.source.width, piece.source.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, (const void*)offset);
+        offset += (size_t)piece.source.width * piece.source.height * 4;
+    }
+    ring.Submit();
+}
+
+void TiledTexture::SetUniforms(GLuint program_id) const
+{
+    glUniform2f(glGetUniformLocation(program_id, "frame_size"), (float)m_width, (float)m_height);
+    glUniform2f(glGetUniformLocation(program_id, "tile_size"), (float)m_tile_width, (float)m_tile_height);
+    glUniform2i(glGetUniformLocation(program_id, "tile_grid"), m_columns, m_rows);
+}
+
+GLuint TiledTexture::GetTexture(void) const
+{
+    return m_texture;
+}
+
+int TiledTexture::GetLayerCount(void) const
+{
+    return m_columns * m_rows;
+}
@@ -0,0 +1,135 @@
+#include <Core/UploadRing.hpp>
+
+extern "C" {
+#include <libavutil/time.h>
+}
+
+UploadRing::UploadRing(int slot_count, size_t max_size)
+    : m_slot_size(0), m_max_size(max_size), m_slot_count(slot_count > 1 ? slot_count : 2), m_current(-1),
+      m_persistent(false),
+      m_acquire_us(0), m_stats()
+{
+}
+
+UploadRing::~UploadRing(void)
+{
+    Release();
+}
+
+void UploadRing::Allocate(size_t size)
+{
+    Release();
+
+    m_persistent = (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) && glBufferStorage;
+    m_stats.persistent = m_persistent;
+    m_slot_size = size;
+    m_slots.resize(m_slot_count);
+
+    for(Slot& slot : m_slots)
+    {
+        slot.mapped = nullptr;
+        slot.fence = nullptr;
+
+        glGenBuffers(1, &slot.buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+        if(m_persistent)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+            slot.mapped = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+        }
+        else
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void UploadRing::Release(void)
+{
+    for(Slot& slot : m_slots)
+    {
+        if(slot.fence)
+            glDeleteSync(slot.fence);
+
+        // Deleting a buffer unmaps it, copies still reading from it finish first
+        glDeleteBuffers(1, &slot.buffer);
+    }
+    m_slots.clear();
+    m_slot_size = 0;
+    m_current = -1;
+}
+
+uint8_t* UploadRing::Acquire(size_t size)
+{
+    m_acquire_us = av_gettime_relative();
+
+    if(size > GetMaxSize())
+        return nullptr;
+    if(size > m_slot_size)
+        Allocate(size);
+
+    m_current = (m_current + 1) % m_slot_count;
+    Slot& slot = m_slots[m_current];
+
+    if(slot.fence)
+    {
+        // Out of free slots: the GPU is more than slot_count uploads behind
+        if(glClientWaitSync(slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+        {
+            int64_t start = av_gettime_relative();
+            while(glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+                ;
+            m_stats.stalls++;
+            m_stats.stall_time += (av_gettime_relative() - start) / 1000000.0;
+        }
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+    }
+
+    if(!m_persistent)
+    {
+        // Orphaned: the driver hands out new storage if the old one is in use
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, m_slot_size, nullptr, GL_STREAM_DRAW);
+        slot.mapped = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    return slot.mapped;
+}
+
+void UploadRing::Bind(void)
+{
+    Slot& slot = m_slots[m_current];
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+    if(!m_persistent)
+    {
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        slot.mapped = nullptr;
+    }
+}
+
+void UploadRing::Submit(void)
+{
+    Slot& slot = m_slots[m_current];
+
+    // Orphaned slots need no fence, writing to them never touches storage in use
+    if(m_persistent)
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    m_stats.uploads++;
+    m_stats.write_time = (av_gettime_relative() - m_acquire_us) / 1000000.0;
+}
+
+size_t UploadRing::GetMaxSize(void) const
+{
+    return m_max_size / m_slot_count;
+}
+
+const UploadRingStats& UploadRing::GetStats(void) const
+{
+    return m_stats;
+}
@@ -0,0 +1,56 @@
+#include <Core/UploadThread.hpp>
+
+UploadThread::UploadThread(GLFWwindow* context)
+    : m_context(context), m_quit(false)
+{
+    m_thread = std::thread(&UploadThread::Run, this);
+}
+
+UploadThread::~UploadThread(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+        m_jobs.clear();
+    }
+    m_cv.notify_one();
+
+    m_thread.join();
+    glfwDestroyWindow(m_context);
+}
+
+void UploadThread::Post(Job job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(std::move(job));
+    }
+    m_cv.notify_one();
+}
+
+void UploadThread::Run(void)
+{
+    // GLEW's entry points were loaded for the main context, they are the
+    // same for a context sharing with it
+    glfwMakeContextCurrent(m_context);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(true)
+    {
+        m_cv.wait(lock, [this]() { return m_quit || !m_jobs.empty(); });
+
+        if(m_quit)
+            break;
+
+        Job job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+
+        lock.unlock();
+        job();
+        lock.lock();
+    }
+
+    // Commands still queued reach the GPU before the context goes
+    glFinish();
+    glfwMakeContextCurrent(NULL);
+}
@@ -1,4 +1,12 @@
 #include "Core/VideoReader.hpp"
+#include "Core/FollowIO.hpp"
+
+#include <algorithm>
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+}
 
 // av_err2str returns a temporary array. This doesn't work in gcc.
 // This function can be used as a replacement for av_err2str.
@@ -20,7 +28,74 @@ static AVPixelFormat correct_for_deprecated_pixel_format(AVPixelFormat pix_fmt)
     }
 }
 
-bool video_reader_open(VideoReaderState* state, const char* filename) {
+// Regions of interest start and end on this grid, so they are aligned for
+// any chroma subsampling and decimation and don't change with every small
+// camera movement (each change of size sets up a new sws context).
+#define ROI_ALIGN 64
+
+// Pulls the next frame of the video stream out of the decoder into
+// state->av_frame, feeding it packets as needed. Once the demuxer runs dry the
+// decoder is drained so the frames it still buffers are not lost.
+static bool decode_next_frame(VideoReaderState* state) {
+
+    // Unpack members of state
+    auto& av_format_ctx = state->av_format_ctx;
+    auto& av_codec_ctx = state->av_codec_ctx;
+    auto& video_stream_index = state->video_stream_index;
+    auto& av_frame = state->av_frame;
+    auto& av_packet = state->av_packet;
+
+    state->demux_time = 0.0;
+    state->decode_time = 0.0;
+
+    int response;
+    int64_t start;
+    while (true) {
+        start = av_gettime_relative();
+        response = avcodec_receive_frame(av_codec_ctx, av_frame);
+        state->decode_time += (av_gettime_relative() - start) / 1000000.0;
+        if (response == 0) {
+            return true;
+        } else if (response == AVERROR_EOF) {
+            state->eof = true;
+            return false;
+        } else if (response != AVERROR(EAGAIN)) {
+            printf("Failed to decode packet: %s\n", av_make_error(response));
+            return false;
+        }
+
+        start = av_gettime_relative();
+        response = av_read_frame(av_format_ctx, av_packet);
+        state->demux_time += (av_gettime_relative() - start) / 1000000.0;
+        if (response < 0) {
+            // End of file (or a read error): enter draining mode
+            avcodec_send_packet(av_codec_ctx, NULL);
+            continue;
+        }
+        if (av_packet->stream_index != video_stream_index) {
+            av_packet_unref(av_packet);
+            continue;
+        }
+
+        state->demuxed_bytes += av_packet->size;
+
+        start = av_gettime_relative();
+        response = avcodec_send_packet(av_codec_ctx, av_packet);
+        state->decode_time += (av_gettime_relative() - start) / 1000000.0;
+        av_packet_unref(av_packet);
+        if (response < 0 && response != AVERROR(EAGAIN)) {
+            printf("Failed to decode packet: %s\n", av_make_error(response));
+            return false;
+        }
+    }
+}
+
+bool video_reader_open(VideoReaderState* state, const char* filename, const VideoReaderOptions* options) {
+
+    VideoReaderOptions default_options;
+    if (!options) {
+        options = &default_options;
+    }
 
     // Unpack members of state
     auto& width = state->width;
@@ -32,6 +107,28 @@ bool video_reader_open(VideoReaderState* state, const char* filename) {
     auto& av_frame = state->av_frame;
     auto& av_packet = state->av_packet;
 
+    av_format_ctx = NULL;
+    av_codec_ctx = NULL;
+    av_frame = NULL;
+    av_packet = NULL;
+    state->sws_scaler_ctx = NULL;
+    for (int i = 0; i < VIDEO_MAX_ROI; ++i) {
+        state->roi_sws_ctx[i] = NULL;
+    }
+    state->roi_count = 0;
+    state->converted_count = 0;
+    state->av_io_ctx = NULL;
+    state->av_io_close = NULL;
+    state->eof = false;
+    state->live_edge = false;
+    state->high_bit_depth = false;
+    state->decimation = 0;
+    state->follow = options->follow;
+    state->demux_time = 0.0;
+    state->decode_time = 0.0;
+    state->convert_time = 0.0;
+    state->demuxed_bytes = 0;
+
     // Open the file using libavformat
     av_format_ctx = avformat_alloc_context();
     if (!av_format_ctx) {
@@ -39,25 +136,63 @@ bool video_reader_open(VideoReaderState* state, const char* filename) {
         return false;
     }
 
-    if (avformat_open_input(&av_format_ctx, filename, NULL, NULL) != 0) {
+    if (options->follow) {
+        state->av_io_ctx = follow_io_open(filename, options->follow_idle_timeout);
+        state->av_io_close = follow_io_close;
+        if (!state->av_io_ctx) {
+            return false;
+        }
+        av_format_ctx->pb = state->av_io_ctx;
+    } else if (options->http_cache && (strncmp(filename, "http://", 7) == 0 || strncmp(filename, "https://", 8) == 0)) {
+        state->av_io_ctx = http_cache_io_open(filename, &options->http_cache_config);
+        state->av_io_close = http_cache_io_close;
+        if (!state->av_io_ctx) {
+            return false;
+        }
+        av_format_ctx->pb = state->av_io_ctx;
+    }
+
+    AVDictionary* av_format_opts = NULL;
+    if (options->low_latency) {
+        av_dict_set(&av_format_opts, "probesize", "32", 0);
+        av_dict_set(&av_format_opts, "analyzeduration", "0", 0);
+        av_dict_set(&av_format_opts, "fflags", "nobuffer", 0);
+        av_dict_set(&av_format_opts, "max_delay", "0", 0);
+    }
+
+    int response = avformat_open_input(&av_format_ctx, filename, NULL, &av_format_opts);
+    av_dict_free(&av_format_opts);
+    if (response != 0) {
         printf("Couldn't open video file\n");
         return false;
     }
 
-    // Find the first valid video stream inside the file
+    // Raw streams coming through a pipe or socket don't carry a header with
+    // the stream parameters, so they have to be probed from the first packets
+    if (options->low_latency && avformat_find_stream_info(av_format_ctx, NULL) < 0) {
+        printf("Couldn't find stream info\n");
+        return false;
+    }
+
+    // Find the first valid video stream inside the file (or the one asked for)
     video_stream_index = -1;
     AVCodecParameters* av_codec_params;
     AVCodec* av_codec;
-    for (int i = 0; i < av_format_ctx->nb_streams; ++i) {
+    for (unsigned i = 0; i < av_format_ctx->nb_streams; ++i) {
+        if (options->stream_index >= 0 && (int)i != options->stream_index) {
+            continue;
+        }
         av_codec_params = av_format_ctx->streams[i]->codecpar;
         av_codec = const_cast<AVCodec*>(avcodec_find_decoder(av_codec_params->codec_id));
         if (!av_codec) {
             continue;
         }
         if (av_codec_params->codec_type == AVMEDIA_TYPE_VIDEO) {
-            video_stream_index = i;
+            video_stream_index = (int)i;
             width = av_codec_params->width;
             height = av_codec_params->height;
+            state->output_width = width;
+            state->output_height = height;
             time_base = av_format_ctx->streams[i]->time_base;
             break;
         }
@@ -77,11 +212,26 @@ bool video_reader_open(VideoReaderState* state, const char* filename) {
         printf("Couldn't initialize AVCodecContext\n");
         return false;
     }
-    if (avcodec_open2(av_codec_ctx, av_codec, NULL) < 0) {
+    if (options->low_latency) {
+        // Frame threading delays output by one frame per thread
+        av_codec_ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+        av_codec_ctx->thread_type = FF_THREAD_SLICE;
+        av_codec_ctx->thread_count = 0;
+    }
+    AVDictionary* av_codec_opts = NULL;
+    if (options->decoder_options) {
+        av_dict_parse_string(&av_codec_opts, options->decoder_options, "=", ":", 0);
+    }
+    response = avcodec_open2(av_codec_ctx, av_codec, &av_codec_opts);
+    av_dict_free(&av_codec_opts);
+    if (response < 0) {
         printf("Couldn't open codec\n");
         return false;
     }
 
+    const AVPixFmtDescriptor* pix_desc = av_pix_fmt_desc_get(av_codec_ctx->pix_fmt);
+    state->high_bit_depth = options->high_bit_depth && pix_desc && pix_desc->comp[0].depth > 8;
+
     av_frame = av_frame_alloc();
     if (!av_frame) {
         printf("Couldn't allocate AVFrame\n");
@@ -96,116 +246,247 @@ bool video_reader_open(VideoReaderState* state, const char* filename) {
     return true;
 }
 
-bool video_reader_read_frame(VideoReaderState* state, uint8_t** frame_buffer, int64_t* pts) {
+bool video_reader_decode_frame(VideoReaderState* state, int64_t* pts) {
 
-    // Unpack members of state
-    auto& width = state->width;
-    auto& height = state->height;
-    auto& av_format_ctx = state->av_format_ctx;
-    auto& av_codec_ctx = state->av_codec_ctx;
-    auto& video_stream_index = state->video_stream_index;
     auto& av_frame = state->av_frame;
-    auto& av_packet = state->av_packet;
-    auto& sws_scaler_ctx = state->sws_scaler_ctx;
 
     // Decode one frame
-    int response;
-    while (av_read_frame(av_format_ctx, av_packet) >= 0) {
-        if (av_packet->stream_index != video_stream_index) {
-            av_packet_unref(av_packet);
-            continue;
-        }
+    if (!decode_next_frame(state)) {
+        return false;
+    }
 
-        response = avcodec_send_packet(av_codec_ctx, av_packet);
-        if (response < 0) {
-            printf("Failed to decode packet: %s\n", av_make_error(response));
-            return false;
-        }
+    if (state->follow) {
+        state->live_edge = follow_io_waited(state->av_io_ctx);
+    }
 
-        response = avcodec_receive_frame(av_codec_ctx, av_frame);
-        if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
-            av_packet_unref(av_packet);
+    *pts = av_frame->pts != AV_NOPTS_VALUE ? av_frame->pts : av_frame->best_effort_timestamp;
+
+    return true;
+}
+
+// Pointers to the texel at (x, y) in each plane of a frame.
+static void offset_planes(const AVFrame* av_frame, const AVPixFmtDescriptor* desc, int x, int y, const uint8_t* planes[4]) {
+    bool is_rgb = desc->flags & AV_PIX_FMT_FLAG_RGB;
+    bool done[4] = { false, false, false, false };
+
+    for (int i = 0; i < 4; ++i) {
+        planes[i] = av_frame->data[i];
+    }
+    for (int c = 0; c < desc->nb_components; ++c) {
+        const AVComponentDescriptor& comp = desc->comp[c];
+        if (done[comp.plane]) {
             continue;
-        } else if (response < 0) {
-            printf("Failed to decode packet: %s\n", av_make_error(response));
-            return false;
         }
+        done[comp.plane] = true;
 
-        av_packet_unref(av_packet);
-        break;
+        bool is_chroma = !is_rgb && (c == 1 || c == 2);
+        int shift_x = is_chroma ? desc->log2_chroma_w : 0;
+        int shift_y = is_chroma ? desc->log2_chroma_h : 0;
+        planes[comp.plane] += (y >> shift_y) * av_frame->linesize[comp.plane] + (x >> shift_x) * comp.step;
     }
+}
 
+// Converts the source rectangle src into the frame buffer, at its place in
+// the (possibly decimated) output. Returns the rectangle written.
+static bool convert_rect(VideoReaderState* state, SwsContext** sws_ctx, const AVPixFmtDescriptor* desc,
+                         AVPixelFormat source_pix_fmt, AVPixelFormat dest_pix_fmt,
+                         const VideoRect& src, uint8_t* frame_buffer, VideoRect* dest) {
 
-    
-    *pts = av_frame->pts;
-    
-    // Set up sws scaler
-    if (true) {
-        auto source_pix_fmt = correct_for_deprecated_pixel_format(av_codec_ctx->pix_fmt);
-        sws_scaler_ctx = sws_getContext(width, height, source_pix_fmt,
-                                        width, height, AV_PIX_FMT_RGB0,
-                                        SWS_BILINEAR, NULL, NULL, NULL);
-    }
-    if (!sws_scaler_ctx) {
+    auto& av_frame = state->av_frame;
+    int shift = state->decimation;
+
+    dest->x = src.x >> shift;
+    dest->y = src.y >> shift;
+    dest->width = AV_CEIL_RSHIFT(src.x + src.width, shift) - dest->x;
+    dest->height = AV_CEIL_RSHIFT(src.y + src.height, shift) - dest->y;
+
+    *sws_ctx = sws_getCachedContext(*sws_ctx,
+                                    src.width, src.height, source_pix_fmt,
+                                    dest->width, dest->height, dest_pix_fmt,
+                                    SWS_BILINEAR, NULL, NULL, NULL);
+    if (!*sws_ctx) {
         printf("Couldn't initialize sw scaler\n");
         return false;
     }
 
-    uint8_t* dest[4] = { *frame_buffer, NULL, NULL, NULL };
-    int dest_linesize[4] = { width * 4, 0, 0, 0 };
-    sws_scale(sws_scaler_ctx, av_frame->data, av_frame->linesize, 0, av_frame->height, dest, dest_linesize);
+    const uint8_t* source[4];
+    offset_planes(av_frame, desc, src.x, src.y, source);
+
+    int output_width = state->output_width;
+    int output_height = state->output_height;
+    uint8_t* dest_planes[4] = { frame_buffer + ((size_t)dest->y * output_width + dest->x) * 4, NULL, NULL, NULL };
+    int dest_linesize[4] = { output_width * 4, 0, 0, 0 };
+    if (state->high_bit_depth) {
+        // Only repacked, samples keep their bits and stay YCbCr
+        dest_linesize[0] = output_width * 2;
+        dest_linesize[1] = (output_width + 1) / 2 * 4;
+        dest_planes[0] = frame_buffer + (size_t)dest->y * dest_linesize[0] + dest->x * 2;
+        dest_planes[1] = frame_buffer + (size_t)output_width * output_height * 2 +
+                         (size_t)(dest->y / 2) * dest_linesize[1] + (dest->x / 2) * 4;
+    }
+    sws_scale(*sws_ctx, source, av_frame->linesize, 0, src.height, dest_planes, dest_linesize);
+
+    return true;
+}
+
+bool video_reader_convert_frame(VideoReaderState* state, uint8_t* frame_buffer) {
+
+    // Unpack members of state
+    auto& width = state->width;
+    auto& height = state->height;
+    auto& av_codec_ctx = state->av_codec_ctx;
+
+    int64_t start = av_gettime_relative();
+
+    // Scaling down happens in the conversion pass, no extra copy. A frame
+    // of another size than the last one is laid out at another stride, what
+    // the buffer holds outside the ROI is no use then.
+    int output_width = AV_CEIL_RSHIFT(width, state->decimation);
+    int output_height = AV_CEIL_RSHIFT(height, state->decimation);
+    bool resized = state->converted_count == 0 ||
+                   output_width != state->output_width || output_height != state->output_height;
+    state->output_width = output_width;
+    state->output_height = output_height;
+
+    // sws contexts are reused across frames as long as the input doesn't change
+    auto source_pix_fmt = correct_for_deprecated_pixel_format(av_codec_ctx->pix_fmt);
+    auto dest_pix_fmt = state->high_bit_depth ? AV_PIX_FMT_P010LE : AV_PIX_FMT_RGB0;
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(source_pix_fmt);
+    if (!desc) {
+        printf("Couldn't get pixel format of the video\n");
+        return false;
+    }
+
+    bool can_cut = !(desc->flags & (AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL));
+    if (state->roi_count > 0 && can_cut && !resized) {
+        for (int i = 0; i < state->roi_count; ++i) {
+            if (!convert_rect(state, &state->roi_sws_ctx[i], desc, source_pix_fmt, dest_pix_fmt,
+                              state->roi[i], frame_buffer, &state->converted[i])) {
+                return false;
+            }
+        }
+        state->converted_count = state->roi_count;
+    } else {
+        VideoRect whole = { 0, 0, width, height };
+        if (!convert_rect(state, &state->sws_scaler_ctx, desc, source_pix_fmt, dest_pix_fmt,
+                          whole, frame_buffer, &state->converted[0])) {
+            return false;
+        }
+        state->converted_count = 1;
+    }
+
+    state->convert_time = (av_gettime_relative() - start) / 1000000.0;
 
     return true;
 }
 
+bool video_reader_read_frame(VideoReaderState* state, uint8_t** frame_buffer, int64_t* pts) {
+    return video_reader_decode_frame(state, pts) && video_reader_convert_frame(state, *frame_buffer);
+}
+
 bool video_reader_seek_frame(VideoReaderState* state, int64_t ts) {
     
     // Unpack members of state
     auto& av_format_ctx = state->av_format_ctx;
     auto& av_codec_ctx = state->av_codec_ctx;
     auto& video_stream_index = state->video_stream_index;
-    auto& av_packet = state->av_packet;
-    auto& av_frame = state->av_frame;
     
     av_seek_frame(av_format_ctx, video_stream_index, ts, AVSEEK_FLAG_BACKWARD);
+    avcodec_flush_buffers(av_codec_ctx);
+    state->eof = false;
 
     // av_seek_frame takes effect after one frame, so I'm decoding one here
     // so that the next call to video_reader_read_frame() will give the correct
     // frame
-    int response;
-    while (av_read_frame(av_format_ctx, av_packet) >= 0) {
-        if (av_packet->stream_index != video_stream_index) {
-            av_packet_unref(av_packet);
-            continue;
-        }
+    return decode_next_frame(state);
+}
 
-        response = avcodec_send_packet(av_codec_ctx, av_packet);
-        if (response < 0) {
-            printf("Failed to decode packet: %s\n", av_make_error(response));
+bool video_reader_seek_keyframe(VideoReaderState* state, int64_t ts, int64_t* pts) {
+
+    // Unpack members of state
+    auto& av_format_ctx = state->av_format_ctx;
+    auto& av_codec_ctx = state->av_codec_ctx;
+    auto& video_stream_index = state->video_stream_index;
+
+    // Without AVSEEK_FLAG_BACKWARD the demuxer lands on the next keyframe
+    if (av_seek_frame(av_format_ctx, video_stream_index, ts, 0) < 0) {
+        av_seek_frame(av_format_ctx, video_stream_index, ts, AVSEEK_FLAG_BACKWARD);
+    }
+    avcodec_flush_buffers(av_codec_ctx);
+    state->eof = false;
+
+    return video_reader_decode_frame(state, pts);
+}
+
+bool video_reader_seek_exact(VideoReaderState* state, int64_t ts, int64_t* pts) {
+
+    // Unpack members of state
+    auto& av_format_ctx = state->av_format_ctx;
+    auto& av_codec_ctx = state->av_codec_ctx;
+    auto& video_stream_index = state->video_stream_index;
+    auto& av_frame = state->av_frame;
+
+    if (av_seek_frame(av_format_ctx, video_stream_index, ts, AVSEEK_FLAG_BACKWARD) < 0) {
+        printf("Couldn't seek to %" PRId64 "\n", ts);
+        return false;
+    }
+    avcodec_flush_buffers(av_codec_ctx);
+    state->eof = false;
+
+    AVRational frame_rate = av_format_ctx->streams[video_stream_index]->avg_frame_rate;
+    int64_t default_duration = frame_rate.num > 0 && frame_rate.den > 0 ?
+                               av_rescale_q(1, av_inv_q(frame_rate), state->time_base) : 0;
+
+    // Frames from the keyframe on are decoded and dropped until the one still
+    // on screen at ts
+    while (true) {
+        if (!video_reader_decode_frame(state, pts)) {
             return false;
         }
+        int64_t duration = av_frame->duration > 0 ? av_frame->duration : default_duration;
+        if (*pts + std::max(duration, (int64_t)1) > ts) {
+            return true;
+        }
+    }
+}
 
-        response = avcodec_receive_frame(av_codec_ctx, av_frame);
-        if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
-            av_packet_unref(av_packet);
-            continue;
-        } else if (response < 0) {
-            printf("Failed to decode packet: %s\n", av_make_error(response));
-            return false;
+void video_reader_set_decimation(VideoReaderState* state, int shift) {
+    state->decimation = shift;
+}
+
+void video_reader_set_roi(VideoReaderState* state, const VideoRect* rects, int count) {
+    state->roi_count = 0;
+    for (int i = 0; i < count && i < VIDEO_MAX_ROI; ++i) {
+        int x0 = std::max(rects[i].x / ROI_ALIGN * ROI_ALIGN, 0);
+        int y0 = std::max(rects[i].y / ROI_ALIGN * ROI_ALIGN, 0);
+        int x1 = std::min((rects[i].x + rects[i].width + ROI_ALIGN - 1) / ROI_ALIGN * ROI_ALIGN, state->width);
+        int y1 = std::min((rects[i].y + rects[i].height + ROI_ALIGN - 1) / ROI_ALIGN * ROI_ALIGN, state->height);
+        if (x1 > x0 && y1 > y0) {
+            state->roi[state->roi_count++] = VideoRect{ x0, y0, x1 - x0, y1 - y0 };
         }
+    }
+}
 
-        av_packet_unref(av_packet);
-        break;
+bool video_reader_http_cache_stats(VideoReaderState* state, HttpCacheStats* stats) {
+    if (state->av_io_close != http_cache_io_close) {
+        return false;
     }
 
+    *stats = http_cache_io_stats(state->av_io_ctx);
     return true;
 }
 
 void video_reader_close(VideoReaderState* state) {
     sws_freeContext(state->sws_scaler_ctx);
+    for (int i = 0; i < VIDEO_MAX_ROI; ++i) {
+        sws_freeContext(state->roi_sws_ctx[i]);
+    }
     avformat_close_input(&state->av_format_ctx);
     avformat_free_context(state->av_format_ctx);
     av_frame_free(&state->av_frame);
     av_packet_free(&state->av_packet);
     avcodec_free_context(&state->av_codec_ctx);
+    if (state->av_io_close) {
+        state->av_io_close(&state->av_io_ctx);
+    }
 }
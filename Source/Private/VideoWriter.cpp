@@ -0,0 +1,228 @@
+#include "Core/VideoWriter.hpp"
+
+// Sends frame (NULL to flush) to the encoder and muxes the packets it returns.
+static bool encode_frame(VideoWriterState* state, AVFrame* frame) {
+
+    // Unpack members of state
+    auto& av_format_ctx = state->av_format_ctx;
+    auto& av_codec_ctx = state->av_codec_ctx;
+    auto& av_stream = state->av_stream;
+    auto& av_packet = state->av_packet;
+
+    int response = avcodec_send_frame(av_codec_ctx, frame);
+    if (response < 0) {
+        printf("Couldn't send frame to encoder\n");
+        return false;
+    }
+
+    while (true) {
+        response = avcodec_receive_packet(av_codec_ctx, av_packet);
+        if (response == AVERROR(EAGAIN) || response == AVERROR_EOF) {
+            return true;
+        } else if (response < 0) {
+            printf("Failed to encode frame\n");
+            return false;
+        }
+
+        av_packet_rescale_ts(av_packet, av_codec_ctx->time_base, av_stream->time_base);
+        av_packet->stream_index = av_stream->index;
+        response = av_interleaved_write_frame(av_format_ctx, av_packet);
+        if (response < 0) {
+            printf("Couldn't write packet\n");
+            return false;
+        }
+    }
+}
+
+static const AVCodec* find_encoder(const char* name) {
+    const AVCodec* av_codec = name ? avcodec_find_encoder_by_name(name) : NULL;
+    if (!av_codec) {
+        av_codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+    }
+    if (!av_codec) {
+        av_codec = avcodec_find_encoder(AV_CODEC_ID_MPEG4);
+    }
+    return av_codec;
+}
+
+bool video_writer_open(VideoWriterState* state, const char* filename, int width, int height,
+                       AVRational time_base, AVRational frame_rate, const VideoWriterOptions* options) {
+
+    VideoWriterOptions default_options;
+    if (!options) {
+        options = &default_options;
+    }
+
+    // Unpack members of state
+    auto& av_format_ctx = state->av_format_ctx;
+    auto& av_codec_ctx = state->av_codec_ctx;
+    auto& av_stream = state->av_stream;
+    auto& av_frame = state->av_frame;
+    auto& av_packet = state->av_packet;
+
+    av_format_ctx = NULL;
+    av_codec_ctx = NULL;
+    av_stream = NULL;
+    av_frame = NULL;
+    av_packet = NULL;
+    state->sws_scaler_ctx = NULL;
+    state->width = width;
+    state->height = height;
+    state->time_base = time_base;
+    state->frames_written = 0;
+    state->keyframe_interval = options->keyframe_interval > 0 ? options->keyframe_interval : 1;
+
+    if (frame_rate.num <= 0 || frame_rate.den <= 0) {
+        frame_rate = av_make_q(30, 1);
+    }
+
+    // The container is picked from the file extension
+    if (avformat_alloc_output_context2(&av_format_ctx, NULL, NULL, filename) < 0) {
+        printf("Couldn't create output context for %s\n", filename);
+        return false;
+    }
+
+    const AVCodec* av_codec = find_encoder(options->codec);
+    if (!av_codec) {
+        printf("Couldn't find a video encoder\n");
+        return false;
+    }
+
+    av_codec_ctx = avcodec_alloc_context3(av_codec);
+    if (!av_codec_ctx) {
+        printf("Couldn't create AVCodecContext\n");
+        return false;
+    }
+    av_codec_ctx->width = width;
+    av_codec_ctx->height = height;
+    av_codec_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    av_codec_ctx->time_base = av_inv_q(frame_rate);
+    av_codec_ctx->framerate = frame_rate;
+    av_codec_ctx->gop_size = state->keyframe_interval;
+    av_codec_ctx->keyint_min = state->keyframe_interval;
+    av_codec_ctx->max_b_frames = 0;
+    av_codec_ctx->thread_count = options->thread_count;
+    if (options->bit_rate > 0) {
+        av_codec_ctx->bit_rate = options->bit_rate;
+    }
+    if (av_format_ctx->oformat->flags & AVFMT_GLOBALHEADER) {
+        av_codec_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    // No scene cut keyframes, and forced keyframes are IDR frames, so every
+    // keyframe is a switching point shared by all files of a set. Options
+    // the encoder doesn't know are left alone.
+    AVDictionary* av_codec_opts = NULL;
+    av_dict_set(&av_codec_opts, "sc_threshold", "0", 0);
+    av_dict_set(&av_codec_opts, "forced-idr", "1", 0);
+    av_dict_set(&av_codec_opts, "preset", "veryfast", 0);
+    int response = avcodec_open2(av_codec_ctx, av_codec, &av_codec_opts);
+    av_dict_free(&av_codec_opts);
+    if (response < 0) {
+        printf("Couldn't open encoder %s\n", av_codec->name);
+        return false;
+    }
+
+    av_stream = avformat_new_stream(av_format_ctx, NULL);
+    if (!av_stream) {
+        printf("Couldn't create output stream\n");
+        return false;
+    }
+    av_stream->time_base = av_codec_ctx->time_base;
+    av_stream->avg_frame_rate = frame_rate;
+    if (avcodec_parameters_from_context(av_stream->codecpar, av_codec_ctx) < 0) {
+        printf("Couldn't set output stream parameters\n");
+        return false;
+    }
+
+    if (!(av_format_ctx->oformat->flags & AVFMT_NOFILE) &&
+        avio_open(&av_format_ctx->pb, filename, AVIO_FLAG_WRITE) < 0) {
+        printf("Couldn't open %s for writing\n", filename);
+        return false;
+    }
+    if (avformat_write_header(av_format_ctx, NULL) < 0) {
+        printf("Couldn't write header of %s\n", filename);
+        return false;
+    }
+
+    av_frame = av_frame_alloc();
+    if (!av_frame) {
+        printf("Couldn't allocate AVFrame\n");
+        return false;
+    }
+    av_frame->format = av_codec_ctx->pix_fmt;
+    av_frame->width = width;
+    av_frame->height = height;
+    if (av_frame_get_buffer(av_frame, 0) < 0) {
+        printf("Couldn't allocate frame buffer\n");
+        return false;
+    }
+
+    av_packet = av_packet_alloc();
+    if (!av_packet) {
+        printf("Couldn't allocate AVPacket\n");
+        return false;
+    }
+
+    return true;
+}
+
+bool video_writer_write_frame(VideoWriterState* state, const uint8_t* src, int src_linesize,
+                              int src_width, int src_height, int64_t pts) {
+
+    // Unpack members of state
+    auto& av_codec_ctx = state->av_codec_ctx;
+    auto& av_frame = state->av_frame;
+    auto& sws_scaler_ctx = state->sws_scaler_ctx;
+
+    sws_scaler_ctx = sws_getCachedContext(sws_scaler_ctx,
+                                          src_width, src_height, AV_PIX_FMT_RGB0,
+                                          state->width, state->height, av_codec_ctx->pix_fmt,
+                                          SWS_BILINEAR, NULL, NULL, NULL);
+    if (!sws_scaler_ctx) {
+        printf("Couldn't initialize sw scaler\n");
+        return false;
+    }
+
+    // The encoder may still hold a reference to the previous frame
+    if (av_frame_make_writable(av_frame) < 0) {
+        printf("Couldn't make frame writable\n");
+        return false;
+    }
+
+    const uint8_t* src_data[4] = { src, NULL, NULL, NULL };
+    int src_linesizes[4] = { src_linesize, 0, 0, 0 };
+    sws_scale(sws_scaler_ctx, src_data, src_linesizes, 0, src_height, av_frame->data, av_frame->linesize);
+
+    bool keyframe = state->frames_written % state->keyframe_interval == 0;
+    av_frame->pict_type = keyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+    av_frame->pts = av_rescale_q(pts, state->time_base, av_codec_ctx->time_base);
+
+    if (!encode_frame(state, av_frame)) {
+        return false;
+    }
+
+    state->frames_written++;
+    return true;
+}
+
+bool video_writer_close(VideoWriterState* state) {
+    bool ok = true;
+
+    if (state->av_format_ctx && state->av_packet && state->av_codec_ctx && avcodec_is_open(state->av_codec_ctx)) {
+        ok = encode_frame(state, NULL) && av_write_trailer(state->av_format_ctx) == 0;
+    }
+
+    if (state->av_format_ctx && !(state->av_format_ctx->oformat->flags & AVFMT_NOFILE)) {
+        avio_closep(&state->av_format_ctx->pb);
+    }
+    avformat_free_context(state->av_format_ctx);
+    state->av_format_ctx = NULL;
+    sws_freeContext(state->sws_scaler_ctx);
+    state->sws_scaler_ctx = NULL;
+    av_frame_free(&state->av_frame);
+    av_packet_free(&state->av_packet);
+    avcodec_free_context(&state->av_codec_ctx);
+
+    return ok;
+}
@@ -0,0 +1,534 @@
+#include "Core/VirtualTexture.hpp"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <Core/ImageRows.hpp>
+
+static const char VT_MAGIC[8] = { 'S', '3', '6', '0', 'V', 'T', '0', '1' };
+
+// Tiles paged in ahead at most, the rest are asked for again next frame
+#define VT_MAX_PREFETCH 64
+
+static const size_t VT_TILE_BYTES = (size_t)VT_SLOT_SIZE * VT_SLOT_SIZE * 4;
+
+// Sizes of the pyramid levels, halving (rounded up) until one tile holds the
+// whole level. Returns the number of levels.
+static int compute_levels(int width, int height, VirtualTextureLevel* levels) {
+    int count = 0;
+    int64_t first_tile = 0;
+    int page_row = 0;
+
+    while (count < VT_MAX_LEVELS) {
+        VirtualTextureLevel& level = levels[count++];
+        level.width = width;
+        level.height = height;
+        level.columns = (width + VT_TILE_SIZE - 1) / VT_TILE_SIZE;
+        level.rows = (height + VT_TILE_SIZE - 1) / VT_TILE_SIZE;
+        level.first_tile = first_tile;
+        level.page_row = page_row;
+
+        first_tile += (int64_t)level.columns * level.rows;
+        page_row += level.rows;
+
+        if (level.columns == 1 && level.rows == 1) {
+            break;
+        }
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+
+    return count;
+}
+
+// One level of the pyramid as it is built. Rows arrive top to bottom and
+// are kept in a window of one tile row with its borders, which is written
+// out once the row below its last one (or the level's last row) is there.
+// Pairs of rows are box filtered into the next level as they come.
+struct LevelBuilder {
+    VirtualTextureLevel level;
+    std::vector<uint8_t> window;    // rows [window_first, window_first + VT_SLOT_SIZE)
+    int window_first;
+    int tile_row;                   // next tile row to write
+    int rows_in;                    // rows received so far
+    std::vector<uint8_t> pair;      // an even row waiting for the odd one below it
+};
+
+static int64_t file_offset(int64_t tile) {
+    return (int64_t)sizeof(VirtualTextureHeader) + tile * (int64_t)VT_TILE_BYTES;
+}
+
+static bool seek_file(FILE* file, int64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+// Tiles of a tile row lie next to each other in the file, left to right.
+// Rows above the image and below it repeat its edge rows.
+static bool write_tile_row(FILE* file, LevelBuilder* builder) {
+    const VirtualTextureLevel& level = builder->level;
+    std::vector<uint32_t> tile(VT_SLOT_SIZE * VT_SLOT_SIZE);
+
+    if (!seek_file(file, file_offset(level.first_tile + (int64_t)builder->tile_row * level.columns))) {
+        return false;
+    }
+    for (int column = 0; column < level.columns; ++column) {
+        int x0 = column * VT_TILE_SIZE - VT_TILE_BORDER;
+
+        for (int y = 0; y < VT_SLOT_SIZE; ++y) {
+            int source_y = std::min(std::max(builder->window_first + y, 0), level.height - 1);
+            const uint32_t* source_row = (const uint32_t*)builder->window.data() +
+                                         (size_t)(source_y - builder->window_first) * level.width;
+            for (int x = 0; x < VT_SLOT_SIZE; ++x) {
+                int source_x = ((x0 + x) % level.width + level.width) % level.width;
+                tile[y * VT_SLOT_SIZE + x] = source_row[source_x];
+            }
+        }
+
+        if (fwrite(tile.data(), VT_TILE_BYTES, 1, file) != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Box filters a level down to the next one. Odd edges repeat their last texel.
+static void downsample(const uint8_t* source, int width, int height, uint8_t* dest) {
+    int dest_width = (width + 1) / 2;
+    int dest_height = (height + 1) / 2;
+
+    for (int y = 0; y < dest_height; ++y) {
+        const uint8_t* row0 = source + (size_t)(2 * y) * width * 4;
+        const uint8_t* row1 = source + (size_t)std::min(2 * y + 1, height - 1) * width * 4;
+        uint8_t* out = dest + (size_t)y * dest_width * 4;
+
+        for (int x = 0; x < dest_width; ++x) {
+            int x0 = 2 * x * 4;
+            int x1 = std::min(2 * x + 1, width - 1) * 4;
+            for (int c = 0; c < 4; ++c) {
+                out[x * 4 + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4;
+            }
+        }
+    }
+}
+
+// Hands the next row of level index to its builder, writing the tile rows
+// it completes and passing rows on to the coarser levels.
+static bool add_row(FILE* file, std::vector<LevelBuilder>& builders, int index, const uint8_t* row) {
+    LevelBuilder& builder = builders[index];
+    const VirtualTextureLevel& level = builder.level;
+    size_t row_bytes = (size_t)level.width * 4;
+
+    int y = builder.rows_in++;
+    memcpy(builder.window.data() + (size_t)(y - builder.window_first) * row_bytes, row, row_bytes);
+
+    // A tile row needs the row below it, unless it is the last one
+    while (builder.tile_row < level.rows &&
+           y >= std::min(builder.window_first + VT_SLOT_SIZE - 1, level.height - 1)) {
+        if (!write_tile_row(file, &builder)) {
+            return false;
+        }
+        builder.tile_row++;
+
+        // The next window starts with the last two rows of this one
+        memmove(builder.window.data(), builder.window.data() + (size_t)VT_TILE_SIZE * row_bytes, 2 * row_bytes);
+        builder.window_first += VT_TILE_SIZE;
+    }
+
+    if (index + 1 == (int)builders.size()) {
+        return true;
+    }
+
+    // Even rows wait for the one below, the last row of an odd height pairs with itself
+    bool last = y == level.height - 1;
+    if (y % 2 == 0) {
+        memcpy(builder.pair.data(), row, row_bytes);
+        if (!last) {
+            return true;
+        }
+        memcpy(builder.pair.data() + row_bytes, row, row_bytes);
+    } else {
+        memcpy(builder.pair.data() + row_bytes, row, row_bytes);
+    }
+
+    std::vector<uint8_t> next_row((size_t)builders[index + 1].level.width * 4);
+    downsample(builder.pair.data(), level.width, 2, next_row.data());
+    return add_row(file, builders, index + 1, next_row.data());
+}
+
+bool virtual_texture_build(const char* image_path, const char* tile_path) {
+
+    VideoReaderOptions options;
+    // EXR panoramas hold linear light, see ImageSequence.cpp
+    options.decoder_options = "apply_trc=iec61966_2_1";
+
+    // Rows are decoded, tiled and filtered down as they come, every level
+    // only holds one tile row at a time
+    ImageRowsState image;
+    if (!image_rows_open(&image, image_path, &options)) {
+        image_rows_close(&image);
+        return false;
+    }
+
+    VirtualTextureLevel levels[VT_MAX_LEVELS];
+    int level_count = compute_levels(image.width, image.height, levels);
+
+    std::vector<LevelBuilder> builders(level_count);
+    for (int i = 0; i < level_count; ++i) {
+        LevelBuilder& builder = builders[i];
+        builder.level = levels[i];
+        builder.window.resize((size_t)VT_SLOT_SIZE * levels[i].width * 4);
+        builder.window_first = -VT_TILE_BORDER;
+        builder.tile_row = 0;
+        builder.rows_in = 0;
+        builder.pair.resize((size_t)2 * levels[i].width * 4);
+    }
+
+    FILE* file = fopen(tile_path, "wb");
+    if (!file) {
+        printf("Couldn't create %s\n", tile_path);
+        image_rows_close(&image);
+        return false;
+    }
+
+    VirtualTextureHeader header;
+    memcpy(header.magic, VT_MAGIC, sizeof(header.magic));
+    header.width = image.width;
+    header.height = image.height;
+    header.level_count = level_count;
+    header.reserved = 0;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    printf("Importing %s: %dx%d, %d levels\n", image_path, image.width, image.height, level_count);
+    std::vector<uint8_t> row((size_t)image.width * 4);
+    for (int y = 0; ok && y < image.height; ++y) {
+        if (!image_rows_read(&image, row.data())) {
+            printf("Couldn't decode %s\n", image_path);
+            ok = false;
+            break;
+        }
+        ok = add_row(file, builders, 0, row.data());
+
+        if (y % 4096 == 4095) {
+            printf("Importing %s: %d of %d rows\n", image_path, y + 1, image.height);
+        }
+    }
+    image_rows_close(&image);
+
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        printf("Couldn't write %s\n", tile_path);
+        remove(tile_path);
+    }
+
+    return ok;
+}
+
+bool virtual_texture_probe(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+
+    char magic[sizeof(VT_MAGIC)];
+    bool is_tile_file = fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, VT_MAGIC, sizeof(magic)) == 0;
+    fclose(file);
+    return is_tile_file;
+}
+
+static const uint8_t* map_file(const char* path, int64_t* size) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+    LARGE_INTEGER file_size;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(file, &file_size)) {
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    }
+    CloseHandle(file);
+    if (!mapping) {
+        return NULL;
+    }
+
+    // The view keeps the mapping alive
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    *size = file_size.QuadPart;
+    return (const uint8_t*)data;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+
+    madvise(data, st.st_size, MADV_RANDOM);
+    *size = st.st_size;
+    return (const uint8_t*)data;
+#endif
+}
+
+static void unmap_file(const uint8_t* data, int64_t size) {
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+#else
+    munmap((void*)data, size);
+#endif
+}
+
+static const uint8_t* tile_texels(VirtualTextureState* state, int64_t tile) {
+    return state->data + sizeof(VirtualTextureHeader) + tile * VT_TILE_BYTES;
+}
+
+static int tile_level(VirtualTextureState* state, int64_t tile) {
+    int level = 0;
+    while (level + 1 < state->level_count && tile >= state->levels[level + 1].first_tile) {
+        level++;
+    }
+    return level;
+}
+
+bool virtual_texture_open(VirtualTextureState* state, const char* tile_path, int atlas_slots) {
+
+    state->data = NULL;
+    state->data_size = 0;
+    state->frame = 0;
+    state->prefetcher = NULL;
+    state->page_table_dirty = true;
+    state->stats = VirtualTextureStats();
+
+    state->data = map_file(tile_path, &state->data_size);
+    if (!state->data) {
+        printf("Couldn't map %s\n", tile_path);
+        return false;
+    }
+
+    VirtualTextureHeader header;
+    if (state->data_size < (int64_t)sizeof(header)) {
+        printf("%s is not a tile file\n", tile_path);
+        return false;
+    }
+    memcpy(&header, state->data, sizeof(header));
+    if (memcmp(header.magic, VT_MAGIC, sizeof(VT_MAGIC)) != 0 || header.width == 0 || header.height == 0) {
+        printf("%s is not a tile file\n", tile_path);
+        return false;
+    }
+
+    state->width = header.width;
+    state->height = header.height;
+    state->level_count = compute_levels(state->width, state->height, state->levels);
+
+    const VirtualTextureLevel& top = state->levels[state->level_count - 1];
+    int64_t tile_count = top.first_tile + (int64_t)top.columns * top.rows;
+    if ((int)header.level_count != state->level_count ||
+        state->data_size < (int64_t)sizeof(header) + tile_count * (int64_t)VT_TILE_BYTES) {
+        printf("%s is truncated or from another version\n", tile_path);
+        return false;
+    }
+
+    state->page_width = state->levels[0].columns;
+    state->page_height = top.page_row + top.rows;
+    state->page_table.assign((size_t)state->page_width * state->page_height * 4, 0);
+
+    state->atlas_slots = std::min(atlas_slots, 255);
+    state->slots.assign(state->atlas_slots * state->atlas_slots, VtSlot{ -1, 0, false });
+    state->resident.clear();
+    state->prefetching.clear();
+    state->prefetched.clear();
+
+    state->prefetcher = new WorkerThread();
+
+    return true;
+}
+
+// Picks a free slot, or the least recently used one that the current view
+// doesn't need. Returns -1 if every slot is in use.
+static int find_slot(VirtualTextureState* state) {
+    int best = -1;
+    for (int i = 0; i < (int)state->slots.size(); ++i) {
+        const VtSlot& slot = state->slots[i];
+        if (slot.tile < 0) {
+            return i;
+        }
+        if (slot.pinned || slot.last_used == state->frame) {
+            continue;
+        }
+        if (best < 0 || slot.last_used < state->slots[best].last_used) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Touches every page of a tile so it is read from disk here rather than
+// when the render thread copies it.
+static void prefetch_tile(VirtualTextureState* state, int64_t tile) {
+    const volatile uint8_t* texels = tile_texels(state, tile);
+    uint8_t sum = 0;
+    for (size_t offset = 0; offset < VT_TILE_BYTES; offset += 4096) {
+        sum += texels[offset];
+    }
+    sum += texels[VT_TILE_BYTES - 1];
+    (void)sum;
+
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->prefetching.erase(tile);
+    state->prefetched.insert(tile);
+}
+
+// Every page shows its own tile if it is in the cache, else whatever covers
+// its parent page, so missing tiles fall back to the closest coarser one.
+static void rebuild_page_table(VirtualTextureState* state) {
+    for (int l = state->level_count - 1; l >= 0; --l) {
+        const VirtualTextureLevel& level = state->levels[l];
+        for (int row = 0; row < level.rows; ++row) {
+            for (int column = 0; column < level.columns; ++column) {
+                uint8_t* entry = &state->page_table[((size_t)(level.page_row + row) * state->page_width + column) * 4];
+
+                auto it = state->resident.find(level.first_tile + (int64_t)row * level.columns + column);
+                if (it != state->resident.end()) {
+                    entry[0] = it->second % state->atlas_slots;
+                    entry[1] = it->second / state->atlas_slots;
+                    entry[2] = l;
+                    entry[3] = 255;
+                } else if (l + 1 < state->level_count) {
+                    const VirtualTextureLevel& parent = state->levels[l + 1];
+                    memcpy(entry, &state->page_table[((size_t)(parent.page_row + row / 2) * state->page_width + column / 2) * 4], 4);
+                } else {
+                    memset(entry, 0, 4);
+                }
+            }
+        }
+    }
+}
+
+void virtual_texture_update(VirtualTextureState* state, const std::vector<ViewFootprint>& footprints,
+                            int max_uploads, std::vector<VtUpload>* uploads) {
+    state->frame++;
+    uploads->clear();
+
+    // Each footprint needs the tile of the level the shader will pick there,
+    // and every coarser tile above it as a stand-in. The coarsest level is
+    // always needed.
+    const VirtualTextureLevel& top = state->levels[state->level_count - 1];
+    std::vector<int64_t> needed;
+    std::unordered_set<int64_t> marked;
+    for (int64_t tile = top.first_tile; tile < top.first_tile + (int64_t)top.columns * top.rows; ++tile) {
+        needed.push_back(tile);
+        marked.insert(tile);
+    }
+
+    for (const ViewFootprint& footprint : footprints) {
+        int l = (int)floorf(log2f(std::max(footprint.texels_per_pixel, 1e-6f)));
+        l = std::min(std::max(l, 0), state->level_count - 1);
+
+        float scale = 1.0f / (VT_TILE_SIZE * (float)(1 << l));
+        int column = (int)(footprint.uv.x * state->width * scale);
+        int row = (int)(footprint.uv.y * state->height * scale);
+
+        for (; l < state->level_count; ++l, column /= 2, row /= 2) {
+            const VirtualTextureLevel& level = state->levels[l];
+            column = std::min(std::max(column, 0), level.columns - 1);
+            row = std::min(std::max(row, 0), level.rows - 1);
+
+            int64_t tile = level.first_tile + (int64_t)row * level.columns + column;
+            if (!marked.insert(tile).second) {
+                break;      // and so are the ones above it
+            }
+            needed.push_back(tile);
+        }
+    }
+
+    // Coarse tiles first, they cover the most and stand in for the rest
+    std::sort(needed.begin(), needed.end(), [](int64_t a, int64_t b) { return a > b; });
+
+    std::lock_guard<std::mutex> lock(state->mutex);
+
+    for (int64_t tile : needed) {
+        auto it = state->resident.find(tile);
+        if (it != state->resident.end()) {
+            state->slots[it->second].last_used = state->frame;
+            continue;
+        }
+
+        if (state->prefetched.count(tile)) {
+            if ((int)uploads->size() >= max_uploads) {
+                continue;
+            }
+            int slot_index = find_slot(state);
+            if (slot_index < 0) {
+                continue;
+            }
+
+            VtSlot& slot = state->slots[slot_index];
+            if (slot.tile >= 0) {
+                state->resident.erase(slot.tile);
+                state->stats.evictions++;
+            }
+            slot.tile = tile;
+            slot.last_used = state->frame;
+            slot.pinned = tile_level(state, tile) == state->level_count - 1;
+            state->resident[tile] = slot_index;
+            state->prefetched.erase(tile);
+            state->stats.loads++;
+            state->page_table_dirty = true;
+
+            uploads->push_back(VtUpload{ slot_index % state->atlas_slots, slot_index / state->atlas_slots, tile_texels(state, tile) });
+        } else if (!state->prefetching.count(tile) && state->prefetching.size() < VT_MAX_PREFETCH) {
+            state->prefetching.insert(tile);
+            state->prefetcher->Post([state, tile]() { prefetch_tile(state, tile); });
+        }
+    }
+
+    // Paged in tiles the view moved away from are forgotten
+    for (auto it = state->prefetched.begin(); it != state->prefetched.end();) {
+        it = marked.count(*it) ? std::next(it) : state->prefetched.erase(it);
+    }
+
+    if (state->page_table_dirty) {
+        rebuild_page_table(state);
+    }
+
+    state->stats.needed = needed.size();
+    state->stats.resident = state->resident.size();
+    state->stats.uploads = uploads->size();
+}
+
+void virtual_texture_close(VirtualTextureState* state) {
+    // Waits for the prefetches still reading the mapping
+    delete state->prefetcher;
+    state->prefetcher = NULL;
+
+    if (state->data) {
+        unmap_file(state->data, state->data_size);
+        state->data = NULL;
+    }
+}
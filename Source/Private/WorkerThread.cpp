@@ -0,0 +1,46 @@
+#include <Core/WorkerThread.hpp>
+
+WorkerThread::WorkerThread(void)
+    : m_quit(false)
+{
+    m_thread = std::thread(&WorkerThread::Run, this);
+}
+
+WorkerThread::~WorkerThread(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_cv.notify_one();
+
+    m_thread.join();
+}
+
+void WorkerThread::Post(Job job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(std::move(job));
+    }
+    m_cv.notify_one();
+}
+
+void WorkerThread::Run(void)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(true)
+    {
+        m_cv.wait(lock, [this]() { return m_quit || !m_jobs.empty(); });
+
+        if(m_jobs.empty())
+            return;
+
+        Job job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+
+        lock.unlock();
+        job();
+        lock.lock();
+    }
+}
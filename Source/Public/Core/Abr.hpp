@@ -0,0 +1,85 @@
+#ifndef abr_hpp
+#define abr_hpp
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Core/VideoReader.hpp>
+#include <Core/WorkerThread.hpp>
+
+// Adaptive playback of a title published as several renditions. The
+// rendition played is the largest one the host can both fetch and decode in
+// real time, judged from the measured demux, decode and conversion times of
+// the frames actually played rather than from bandwidth alone. Switches are
+// prepared on a background thread and happen on a keyframe, so renditions
+// need aligned keyframes (as HLS/DASH ladders have).
+
+struct Rendition {
+    std::string url;
+    int width, height;
+    int64_t bandwidth;      // bits per second, 0 if unknown
+};
+
+// Loads the renditions of a title from an HLS master playlist, a DASH MPD
+// (representations addressed by a BaseURL) or a plain list with one
+// "<width>x<height> <bandwidth> <url>" line per rendition. Renditions are
+// sorted from smallest to largest.
+bool abr_load_manifest(const char* url, std::vector<Rendition>* renditions);
+
+struct AbrItem {
+    int index;              // rendition index
+    VideoReaderState reader;
+    uint8_t* frame_buffer;
+    int64_t preroll_pts;    // keyframe decoded into frame_buffer while preparing a switch
+};
+
+struct AbrStats {
+    double frame_cost;      // seconds to demux, decode and convert one frame
+    double throughput;      // bits per second delivered while demuxing
+    int switches;
+};
+
+struct AbrState {
+    // Public things for other parts of the program to read from
+    int width, height;      // size of the frame last returned by abr_read_frame
+    int rendition;          // index of the rendition on display
+    bool eof;
+
+    // Set while a prepared switch waits for its keyframe, so the renderer
+    // can allocate textures of the new size ahead of time
+    bool switch_pending;
+    int pending_width, pending_height;
+
+    AbrStats stats;
+
+    // Private internal state
+    std::vector<Rendition> renditions;
+    VideoReaderOptions options;
+    AbrItem* current;
+    double frame_interval;
+
+    // Switch target, opened and positioned on the next keyframe in the
+    // background. target belongs to target_thread while target_started.
+    AbrItem* target;
+    int target_index;
+    std::thread target_thread;
+    std::atomic<bool> target_done;
+    bool target_started;
+
+    // Measurements since the last decision
+    int window_frames;
+    double window_cost;
+    double window_demux_time;
+    int64_t window_start_bytes;
+    int upswitch_votes;
+
+    WorkerThread* releaser;
+};
+
+bool abr_open(AbrState* state, const char* manifest_url, const VideoReaderOptions* options = NULL);
+bool abr_read_frame(AbrState* state, uint8_t** frame_buffer, double* pt_seconds);
+void abr_close(AbrState* state);
+
+#endif
@@ -3,11 +3,14 @@
 
 #include <iostream>
 #include <functional>
+#include <atomic>
+#include <thread>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
 #include <Core/Defines.h>
+#include <Core/SpscQueue.hpp>
 
 struct WindowDesc
 {
@@ -54,12 +57,42 @@ private:
     using MouseScrollCallback = std::function<void(GLFWwindow*, double, double)>;
     using MouseButtonCallback = std::function<void(GLFWwindow*, int, int, int)>;
 
+private:
+    /**
+     * @brief An input or resize event, as the GLFW callbacks get it.
+     */
+    struct WindowEvent
+    {
+        enum Type { KEY, CURSOR, SCROLL, BUTTON, RESIZE } type;
+        int args[4];        // key, scancode, action, mods / button, action, mods / width, height
+        double x, y;        // cursor position / scroll offsets
+    };
+
 private:
     /**
      * @brief The application owned window.
      */
     GLFWwindow* m_window;
 
+private:
+    GLFWkeyfun m_key_callback;
+    GLFWcursorposfun m_cursor_callback;
+    GLFWscrollfun m_scroll_callback;
+    GLFWmousebuttonfun m_button_callback;
+    GLFWframebuffersizefun m_resize_callback;
+
+    /**
+     * @brief Events the main thread got for the render thread, in order.
+     */
+    SpscQueue<WindowEvent, 1024> m_events;
+
+    /**
+     * @brief Events dropped because the render thread fell that far behind.
+     */
+    std::atomic<int64_t> m_dropped_events;
+
+    std::thread m_render_thread;
+
 private:
     DefaultCallback m_on_start_callback;
     DefaultCallback m_on_update_callback;
@@ -126,6 +159,15 @@ public:
      */
     void SetMouseButtonCallback(GLFWmousebuttonfun fn);
 
+    /**
+     * @brief Sets the framebuffer size callback of the specified window,
+     * which is called when the window is resized, with its new size in
+     * pixels.
+     * 
+     * @param fn The function to be called.
+     */
+    void SetResizeCallback(GLFWframebuffersizefun fn);
+
 public:
     /**
      * @brief Initializes the application by creating a window and a valid
@@ -135,6 +177,16 @@ public:
      */
     void Init(WindowDesc window_description);
 
+    /**
+     * @brief Creates a GL context sharing objects (textures, buffers, syncs)
+     * with the window's, for another thread to make current. GLFW has no
+     * contexts without windows, it comes with a hidden one. Has to be called
+     * from the main thread, after Init().
+     * 
+     * @returns The hidden window of the context, nullptr if it couldn't be created.
+     */
+    GLFWwindow* CreateSharedContext(void);
+
     /**
      * @brief Updates the current frame of the application.
      */
@@ -145,6 +197,27 @@ public:
      */
     void Poll(void);
 
+    /**
+     * @brief Ticks and polls until the window is closed.
+     * 
+     * With a render thread, the GL context is moved to a thread of its own
+     * that ticks, while the calling thread, which has to be the main one,
+     * only waits for events. Moving or resizing the window, which blocks
+     * event processing on some platforms, then doesn't hold up rendering.
+     * Input and resize events are handed to the render thread through a
+     * lock-free queue, the callbacks are called there before each update.
+     * The context is current on the calling thread again on return.
+     * 
+     * @param render_thread Render on a thread of its own.
+     */
+    void Run(bool render_thread);
+
+    /**
+     * @brief Gets the number of events dropped because the render thread
+     * didn't take them in time.
+     */
+    int64_t GetDroppedEvents(void) const;
+
 public:
     /**
      * @brief Sets the function to be called on application start.
@@ -166,6 +239,17 @@ public:
      * @param fn The function to be called.
      */
     void OnTerminate(DefaultCallback fn);
+
+private:
+    void RenderLoop(void);
+    void DispatchEvents(void);
+    void QueueEvent(const WindowEvent& event);
+
+    static void QueueKey(GLFWwindow* window, int key, int scancode, int action, int mods);
+    static void QueueCursor(GLFWwindow* window, double xpos, double ypos);
+    static void QueueScroll(GLFWwindow* window, double xoffset, double yoffset);
+    static void QueueButton(GLFWwindow* window, int button, int action, int mods);
+    static void QueueResize(GLFWwindow* window, int width, int height);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,65 @@
+#ifndef audio_player_hpp
+#define audio_player_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include <Core/AudioSink.hpp>
+
+// Audio track of a file, decoded on its own thread (with its own demuxer),
+// converted to interleaved float at the rate of the sink and queued for the
+// sink to pull. What the sink has played is the master clock of playback:
+// video frames are presented when audio_clock() reaches them.
+
+struct AudioState {
+    // Public things for other parts of the program to read from
+    int sample_rate;        // of the sink
+    int channels;
+    std::atomic<bool> eof;  // everything decoded was played
+
+    // Private internal state
+    AVFormatContext* av_format_ctx;
+    AVCodecContext* av_codec_ctx;
+    int audio_stream_index;
+    AVFrame* av_frame;
+    AVPacket* av_packet;
+
+    AudioSink* sink;
+    std::thread decode_thread;
+    std::atomic<bool> quit;
+    std::atomic<bool> decoder_done;
+
+    // Queue of converted samples, a ring of interleaved frames
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<float> queue;
+    int64_t queue_read;     // frames pulled by the sink so far
+    int64_t queue_write;    // frames queued so far
+
+    // Linear resampler
+    double resample_step;   // input frames per output frame
+    double resample_pos;
+    std::vector<float> resample_input;
+
+    double start_time;      // seconds, pts of the first sample
+    std::atomic<bool> started;
+};
+
+// Opens the first audio stream of filename. Returns false if there is none.
+bool audio_open(AudioState* state, const char* filename, AudioSink* sink);
+
+// Media time currently being heard, in seconds, or a negative value until
+// the first samples were played.
+double audio_clock(AudioState* state);
+
+void audio_close(AudioState* state);
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef AUDIO_SINK_HPP
+#define AUDIO_SINK_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/**
+ * @brief Where decoded audio goes. A sink pulls interleaved float samples at
+ * its own pace and reports how much of them it has played, which is what
+ * playback is clocked from. Pulling happens on a thread of the sink.
+ */
+class AudioSink
+{
+public:
+    /**
+     * @brief Fills up to frames frames of interleaved samples and returns
+     * how many it filled. The sink plays silence for the rest.
+     */
+    using PullCallback = std::function<int(float* samples, int frames)>;
+
+protected:
+    int m_sample_rate;
+    int m_channels;
+
+private:
+    PullCallback m_pull;
+    std::thread m_thread;
+    std::atomic<bool> m_quit;
+
+    std::mutex m_position_mutex;
+    int64_t m_played_frames;        // before the block being played
+    int64_t m_block_frames;         // samples (silence excluded) in the block being played
+    int64_t m_block_start_us;
+
+public:
+    /**
+     * @brief Default constructor.
+     *
+     * @param sample_rate The rate the sink plays at.
+     */
+    AudioSink(int sample_rate);
+
+public:
+    /**
+     * @brief Default destructor, the sink has to be stopped by then.
+     */
+    virtual ~AudioSink(void);
+
+public:
+    /**
+     * @brief Gets the rate the sink plays at.
+     *
+     * @returns The sample rate in Hz.
+     */
+    int GetSampleRate(void) const;
+
+    /**
+     * @brief Starts pulling samples.
+     *
+     * @param channels The number of interleaved channels.
+     * @param pull The function samples are pulled from.
+     *
+     * @returns True if the sink could be opened, otherwise false.
+     */
+    bool Start(int channels, PullCallback pull);
+
+    /**
+     * @brief Stops pulling samples and closes the sink.
+     */
+    void Stop(void);
+
+    /**
+     * @brief Gets the number of pulled frames played out so far, silence
+     * excluded. This is the master clock of playback.
+     *
+     * @returns The number of frames.
+     */
+    int64_t GetPlayedFrames(void);
+
+protected:
+    virtual bool Open(void) = 0;
+    virtual void Consume(const float* samples, int frames) = 0;
+    virtual void Close(void) = 0;
+
+private:
+    void Run(void);
+};
+
+/**
+ * @brief Plays audio into nothing, in real time, for headless runs.
+ */
+class NullAudioSink : public AudioSink
+{
+public:
+    NullAudioSink(int sample_rate = 48000);
+
+protected:
+    bool Open(void) override;
+    void Consume(const float* samples, int frames) override;
+    void Close(void) override;
+};
+
+/**
+ * @brief Plays audio into a 32-bit float WAV file, in real time, so what was
+ * heard can be checked after a headless run.
+ */
+class WavAudioSink : public AudioSink
+{
+private:
+    const char* m_path;
+    FILE* m_file;
+    int64_t m_data_bytes;
+
+public:
+    WavAudioSink(const char* path, int sample_rate = 48000);
+
+protected:
+    bool Open(void) override;
+    void Consume(const float* samples, int frames) override;
+    void Close(void) override;
+
+private:
+    void WriteHeader(void);
+};
+
+#endif
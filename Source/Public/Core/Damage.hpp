@@ -0,0 +1,48 @@
+#ifndef damage_hpp
+#define damage_hpp
+
+#include <stdint.h>
+#include <vector>
+
+#include <Core/VideoReader.hpp>
+
+// Change detection between consecutive frames, so static parts of a frame
+// (most of the sphere in static camera footage) aren't uploaded again. The
+// frame is cut into DAMAGE_TILE_SIZE tiles, each tile is hashed (SSE2 where
+// available) and compared with its hash from the frame before. Content whose
+// tiles keep changing anyway (a moving camera) isn't hashed for a while, so
+// the hashing never costs more than the uploads it saves.
+
+#define DAMAGE_TILE_SIZE 64
+
+struct DamageStats {
+    int tiles;              // tiles hashed for the last frame
+    int dirty_tiles;        // of those, the ones that changed
+    bool bypassed;          // the last frame wasn't hashed, all of it counts as changed
+    double hash_time;       // seconds spent hashing the last frame
+    int64_t skipped_bytes;  // upload bytes saved so far
+};
+
+struct DamageState {
+    // Public things for other parts of the program to read from
+    DamageStats stats;
+
+    // Private internal state
+    int width, height;
+    int columns, rows;
+    std::vector<uint64_t> hashes;
+    std::vector<uint8_t> known;     // the hash is the one of the content uploaded
+    int bypass_frames;              // frames left to pass through unhashed
+};
+
+void damage_init(DamageState* state);
+
+// Hashes the tiles of an RGBA frame overlapping the regions that were written
+// (e.g. VideoReaderState::converted) and returns the parts that differ from
+// the last frame, on tile boundaries clipped to the frame, with runs of tiles
+// merged. Whatever is returned has to be uploaded. A frame of another size
+// counts as changed everywhere.
+void damage_update(DamageState* state, const uint8_t* frame, int width, int height,
+                   const VideoRect* regions, int count, std::vector<VideoRect>* damage);
+
+#endif
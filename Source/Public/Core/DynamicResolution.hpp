@@ -0,0 +1,110 @@
+#ifndef DYNAMIC_RESOLUTION_HPP
+#define DYNAMIC_RESOLUTION_HPP
+
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+struct DynamicResolutionStats
+{
+    int64_t frames;         // frames measured
+    int64_t over_budget;    // frames measured that took longer than the budget
+    int64_t changes;        // times the scale was changed
+    double last_time;       // seconds the GPU took for the last frame measured
+    double average_time;    // the same, smoothed over the last frames
+    double budget;          // seconds a frame may take, one refresh interval
+};
+
+/**
+ * @brief Picks the scale the scene is rendered at offscreen, before it is
+ * upscaled to the window, from how long the GPU took for the frames before.
+ * Frames that go over the budget (one refresh interval) lower the scale
+ * right away, by as much as the pixel count has to shrink. It is only
+ * raised again after a run of frames well within the budget, and by a
+ * bounded step, so it doesn't oscillate around the limit.
+ *
+ * GPU time comes from timestamp queries around the scene, read back a few
+ * frames later so the CPU never waits for them. Frames still measured at
+ * the old scale after a change are ignored.
+ */
+class DynamicResolution
+{
+private:
+    struct Measure
+    {
+        GLuint queries[2];  // timestamps of the start and end of the frame
+        float scale;        // scale the frame was rendered at
+        bool pending;       // issued, the result isn't read yet
+    };
+
+private:
+    static const int MEASURE_COUNT = 4;
+
+    Measure m_measures[MEASURE_COUNT];
+    int m_current;
+    bool m_timed;           // timer queries are there, the scale is adjusted
+
+    float m_min_scale;
+    float m_max_scale;
+    float m_scale;
+    int m_calm_frames;      // frames in a row well within the budget
+
+    DynamicResolutionStats m_stats;
+
+public:
+    /**
+     * @brief Default constructor, the queries are created by Init().
+     *
+     * @param min_scale Lowest scale, of the window's width and height.
+     * @param max_scale Highest scale, the one started at.
+     */
+    DynamicResolution(float min_scale = 0.5f, float max_scale = 1.0f);
+
+public:
+    /**
+     * @brief Default destructor, releases the queries. Needs the GL context
+     * to be current.
+     */
+    ~DynamicResolution(void);
+
+public:
+    /**
+     * @brief Creates the queries.
+     *
+     * @param budget Seconds a frame may take on the GPU.
+     * @returns false if timer queries aren't supported, the scale then stays
+     * at its maximum.
+     */
+    bool Init(double budget);
+
+    /**
+     * @brief Marks the start of the frame's GPU work.
+     */
+    void BeginFrame(void);
+
+    /**
+     * @brief Marks the end of the frame's GPU work, reads back the frames
+     * done by now and adjusts the scale for the next one.
+     */
+    void EndFrame(void);
+
+    /**
+     * @brief Gets the scale of the window size to render the next frame at.
+     */
+    float GetScale(void) const;
+
+    /**
+     * @brief Gets the highest scale, for allocating the render target once.
+     */
+    float GetMaxScale(void) const;
+
+    /**
+     * @brief Gets the GPU times and scale changes so far.
+     */
+    const DynamicResolutionStats& GetStats(void) const;
+
+private:
+    void Adjust(double time);
+};
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef follow_io_hpp
+#define follow_io_hpp
+
+extern "C" {
+#include <libavformat/avio.h>
+}
+
+// I/O context following a file another process is still writing, like
+// `tail -f`. A read hitting the current end of the file blocks until the
+// file grows, woken up by inotify on Linux (and by a short sleep loop on
+// platforms without it). Once the file hasn't grown for idle_timeout seconds
+// the writer is assumed to be done and the read returns EOF. Reads can
+// therefore block for that long, they belong on a thread that may wait.
+//
+// Only formats that can be demuxed while incomplete work this way, i.e.
+// fragmented MP4 (moov up front, moof/mdat pairs appended) or MPEG-TS.
+
+AVIOContext* follow_io_open(const char* filename, double idle_timeout);
+
+// Returns whether a read had to wait for the file to grow since the last
+// call, meaning the demuxer has caught up with the live edge.
+bool follow_io_waited(AVIOContext* io);
+
+void follow_io_close(AVIOContext** io);
+
+#endif
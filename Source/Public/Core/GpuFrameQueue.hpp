@@ -0,0 +1,122 @@
+#ifndef GPU_FRAME_QUEUE_HPP
+#define GPU_FRAME_QUEUE_HPP
+
+#include <stdint.h>
+
+#include <mutex>
+#include <vector>
+
+#include <GL/glew.h>
+
+struct GpuFrame
+{
+    GLuint texture;
+    int width, height;
+    double time;            // seconds, when the frame is due
+    double entry_start;     // seconds, time of the first frame of the playlist entry it is from
+    GLsync fence;           // set once the frame is uploaded, or once the renderer is done drawing it
+};
+
+struct GpuFrameQueueStats
+{
+    int64_t presents;
+    int64_t empty_presents; // presents that found no frame ready, the upload was late
+    int last_ready;         // frames ready at the last present, the presented one included
+    int min_ready;          // fewest frames ready at a present since ResetMinReady()
+};
+
+/**
+ * @brief Decoded frames uploaded ahead of presentation, each into a texture
+ * of its own. Presenting a frame only changes which texture is drawn, so an
+ * upload that is slow for one frame is absorbed by the frames queued before
+ * it instead of making the next present late.
+ *
+ * Holds one texture more than the queue depth, for the frame on screen.
+ * Frames may be pushed from another thread, with a context sharing the
+ * textures: fences make the renderer wait for uploads and uploads wait for
+ * the renderer to be done drawing a texture before it is filled again.
+ */
+class GpuFrameQueue
+{
+private:
+    std::mutex m_mutex;
+    std::vector<GpuFrame> m_slots;
+    int m_depth;
+    int m_first;            // slot of the oldest queued frame
+    int m_count;            // frames queued
+    int m_shown;            // slot of the frame on screen, -1 if none
+
+    GpuFrameQueueStats m_stats;
+
+public:
+    /**
+     * @brief Default constructor, the textures are created on first use.
+     *
+     * @param depth Number of frames that can be queued ahead of the one on screen.
+     */
+    GpuFrameQueue(int depth = 3);
+
+public:
+    /**
+     * @brief Default destructor, releases the textures. Needs the GL context
+     * to be current.
+     */
+    ~GpuFrameQueue(void);
+
+public:
+    /**
+     * @brief Takes the texture the next frame goes into and binds it, it is
+     * (re)allocated if its size differs. The caller uploads the whole frame,
+     * the texture still holds one from a few pushes ago, and calls Commit().
+     *
+     * @param width Width of the frame.
+     * @param height Height of the frame.
+     * @param time When the frame is due.
+     * @param entry_start Time of the first frame of the frame's playlist
+     * entry, so the renderer needn't look at the playlist being read.
+     * @returns false if the queue is full.
+     */
+    bool Push(int width, int height, double time, double entry_start);
+
+    /**
+     * @brief Queues the frame pushed last, once the uploads issued so far
+     * are done.
+     */
+    void Commit(void);
+
+    /**
+     * @brief Gets the oldest queued frame, the next to present.
+     *
+     * @returns nullptr if none is queued.
+     */
+    const GpuFrame* Peek(void);
+
+    /**
+     * @brief Puts the oldest queued frame on screen. The texture of the
+     * frame shown before is free for Push() from now on, once the draws
+     * issued so far are done. Has to be called on the render thread.
+     *
+     * @returns The frame now shown, nullptr if none was queued.
+     */
+    const GpuFrame* Present(void);
+
+    /**
+     * @brief Gets the frame on screen.
+     *
+     * @returns nullptr until the first present.
+     */
+    const GpuFrame* GetShown(void);
+
+    bool IsFull(void);
+    int GetReadyCount(void);
+    int GetDepth(void) const;
+
+    /**
+     * @brief Gets a copy of the stats, taken under the lock as the upload
+     * thread may be pushing.
+     */
+    GpuFrameQueueStats GetStats(void);
+    void ResetMinReady(void);
+};
+
+#endif
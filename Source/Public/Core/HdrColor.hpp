@@ -0,0 +1,51 @@
+#ifndef hdr_color_hpp
+#define hdr_color_hpp
+
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// Colour conversion of high bit depth frames, which VideoReader hands out as
+// 16-bit planes in the P010 layout (see VideoReaderOptions::high_bit_depth)
+// instead of converting them to 8-bit RGB. The conversion itself happens in
+// the fragment shader; the functions here work out its parameters from the
+// frame's colour metadata and do the same conversion on the CPU, as the
+// reference the shader output is checked against.
+//
+// Steps: range expansion, YCbCr to R'G'B' matrix, then for PQ and HLG the
+// EOTF to linear light, BT.2020 to BT.709 primaries, compression of the
+// highlights into the SDR range and a 2.2 gamma. Other transfers are shown as
+// they are.
+
+enum HdrTransfer {
+    HDR_TRANSFER_SDR = 0,
+    HDR_TRANSFER_PQ  = 1,
+    HDR_TRANSFER_HLG = 2,
+};
+
+struct HdrParams {
+    float sample_scale;         // 16-bit sample (as GL normalizes it) to code value / max code value
+    float y_offset, y_scale;    // Y' = (code - y_offset) * y_scale
+    float c_offset, c_scale;    // Cb, Cr = (code - c_offset) * c_scale
+    glm::mat3 yuv_to_rgb;
+    int transfer;               // HdrTransfer
+    bool bt2020;                // primaries to convert to BT.709
+    float peak_nits;            // brightest content, mapped to display white
+    float sdr_white_nits;       // HDR level shown as SDR white
+};
+
+// Parameters for a frame, from its colour metadata.
+void hdr_params_from_frame(const AVFrame* frame, HdrParams* params);
+
+// One pixel from its P010 samples to display R'G'B' in [0, 1].
+glm::vec3 hdr_convert_pixel(const HdrParams& params, uint16_t y, uint16_t cb, uint16_t cr);
+
+// A whole P010 frame buffer (luma plane followed by the interleaved chroma
+// plane) to RGB0.
+void hdr_convert_frame(const HdrParams& params, const uint8_t* frame_buffer, int width, int height, uint8_t* rgb0);
+
+#endif
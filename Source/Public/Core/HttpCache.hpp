@@ -0,0 +1,43 @@
+#ifndef http_cache_hpp
+#define http_cache_hpp
+
+#include <stdint.h>
+
+extern "C" {
+#include <libavformat/avio.h>
+}
+
+// I/O context reading an http(s) source in fixed-size chunks fetched with
+// range requests. Chunks are kept in an in-memory LRU and, if a directory is
+// given, in an on-disk LRU that also survives restarts, so seeking back to
+// data that was already played never hits the network again. A prefetch
+// thread fetches the chunks ahead of the read position.
+//
+// The origin has to honour Range requests (any nginx/apache/caddy does;
+// python's http.server doesn't).
+
+struct HttpCacheConfig {
+    int chunk_size = 1 << 20;
+    int memory_chunks = 64;             // chunks kept in memory
+    const char* disk_dir = NULL;        // on-disk cache directory, NULL to disable
+    int64_t disk_bytes = INT64_C(4) << 30;  // whole directory, every source in it
+    int prefetch_chunks = 4;            // chunks fetched ahead of the read position
+};
+
+struct HttpCacheStats {
+    int64_t hits;           // chunk lookups served from memory or disk
+    int64_t misses;         // chunk lookups that had to wait for the network
+    int64_t disk_hits;
+    int64_t bytes_fetched;  // bytes downloaded from the origin, prefetch included
+    int64_t bytes_read;     // bytes handed to the demuxer
+
+    double HitRatio(void) const {
+        return hits + misses > 0 ? (double)hits / (hits + misses) : 0.0;
+    }
+};
+
+AVIOContext* http_cache_io_open(const char* url, const HttpCacheConfig* config);
+HttpCacheStats http_cache_io_stats(AVIOContext* io);
+void http_cache_io_close(AVIOContext** io);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef image_rows_hpp
+#define image_rows_hpp
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <Core/VideoReader.hpp>
+
+// Reads a still image a row at a time, top to bottom, as RGBA. JPEG and
+// (non interlaced) PNG are decoded row by row, with memory for a few rows
+// however large the image is, when built with IMAGE_ROWS_CODECS (libjpeg
+// and libpng). Anything else goes through FFmpeg, which decodes it whole
+// and so only takes what fits in one frame (about 268M pixels).
+
+struct JpegRows;
+struct PngRows;
+
+struct ImageRowsState {
+    // Public things for other parts of the program to read from
+    int width, height;
+
+    // Private internal state
+    FILE* file;
+    JpegRows* jpeg;
+    PngRows* png;
+    uint8_t* scanline;          // a row as the decoder hands it out
+
+    VideoReaderState reader;    // FFmpeg fallback, the whole image converted into pixels
+    bool reader_open;
+    uint8_t* pixels;
+
+    int next_row;
+};
+
+// Options are passed on to FFmpeg, for formats it decodes.
+bool image_rows_open(ImageRowsState* state, const char* path, const VideoReaderOptions* options = NULL);
+
+// Reads the next row, width RGBA texels.
+bool image_rows_read(ImageRowsState* state, uint8_t* row);
+void image_rows_close(ImageRowsState* state);
+
+#endif
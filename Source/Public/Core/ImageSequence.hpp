@@ -0,0 +1,75 @@
+#ifndef image_sequence_hpp
+#define image_sequence_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <Core/ThreadPool.hpp>
+#include <Core/VideoReader.hpp>
+
+// Playback of numbered still images (EXR, PNG, JPEG, ... renders) as a
+// video. The files are named by a printf style pattern ("shot.%04d.exr") or
+// a run of '#' standing for the zero padded frame number ("shot.####.exr").
+// Every image decodes on its own, so a window of frames ahead of the one on
+// display is decoded in parallel on a thread pool and handed out in order,
+// and throughput grows with the number of cores instead of being bound to a
+// single decoder.
+
+struct ImageSequenceOptions {
+    double frame_rate = 24.0;
+
+    // Number of the first frame, -1 for the first existing one of 0 to 4
+    int start_number = -1;
+
+    // Frames decoded ahead of the one on display, 0 for two per thread
+    int read_ahead = 0;
+
+    // Decoding threads, 0 for one per hardware thread
+    int thread_count = 0;
+};
+
+struct SequenceFrame {
+    int position;       // frame index in the sequence, -1 while the slot is unused
+    uint8_t* data;
+    bool done;
+    bool ok;
+};
+
+struct SequenceStats {
+    int64_t decoded;
+    double decode_time;     // seconds spent decoding, summed over all threads
+    int64_t stalls;         // frames that weren't decoded yet when they were due
+};
+
+struct ImageSequenceState {
+    // Public things for other parts of the program to read from
+    int width, height;      // of the first frame, every frame must have this size
+    int frame_count;
+    bool eof;
+    SequenceStats stats;
+
+    // Private internal state
+    std::string format;     // printf format of the file names
+    int first_number;
+    double frame_rate;
+    int position;           // index of the next frame to hand out
+
+    // Frame at position p is decoded into slots[p % slots.size()]
+    std::vector<SequenceFrame> slots;
+    std::mutex mutex;
+    std::condition_variable cv;
+    SequenceStats decode_stats;     // updated by the decoding threads, copied to stats
+    std::atomic<bool> quit;
+    ThreadPool* pool;
+};
+
+bool image_sequence_open(ImageSequenceState* state, const char* pattern, const ImageSequenceOptions* options = NULL);
+
+// The frame buffer stays valid until the next call.
+bool image_sequence_read_frame(ImageSequenceState* state, uint8_t** frame_buffer, double* pt_seconds);
+void image_sequence_close(ImageSequenceState* state);
+
+#endif
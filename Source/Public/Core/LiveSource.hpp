@@ -0,0 +1,61 @@
+#ifndef live_source_hpp
+#define live_source_hpp
+
+#include <atomic>
+#include <thread>
+
+#include <Core/TripleBuffer.hpp>
+#include <Core/VideoReader.hpp>
+
+// Live input played back with as little latency as possible. Frames are
+// decoded as fast as they arrive on a dedicated thread and handed to the
+// renderer through a triple buffer: the renderer always shows the newest
+// frame and frames it had no time to show are dropped, nothing is paced.
+//
+// Glass-to-glass latency can be measured when the sender stamps frames with
+// the wall clock, e.g. a local test sender on the same machine:
+//
+//   ffmpeg -re -f lavfi -i testsrc2=size=3840x1920:rate=30
+//          -vf "settb=1/90000,setpts=RTCTIME*9/100" -c:v libx264 -tune zerolatency
+//          -muxdelay 0 -muxpreload 0 -f mpegts udp://127.0.0.1:5000
+//
+// played with `Sphere360 --live --wallclock-pts udp://127.0.0.1:5000`.
+
+struct LiveFrame {
+    uint8_t* data;
+    int64_t pts;
+    int64_t received_us;    // av_gettime_relative() when the frame left the decoder
+};
+
+struct LiveSourceStats {
+    int64_t frames_decoded;
+    int64_t frames_presented;
+    int64_t frames_dropped;         // overwritten before the renderer picked them up
+    double last_decode_to_present;  // seconds from leaving the decoder to being presented
+    double last_glass_to_glass;     // seconds from capture (wall clock pts) to being presented
+    double max_glass_to_glass;
+};
+
+struct LiveSourceState {
+    // Public things for other parts of the program to read from
+    int width, height;
+    bool wallclock_pts;     // pts are wall clock timestamps of the sender
+    LiveSourceStats stats;
+
+    // Private internal state
+    VideoReaderState reader;
+    TripleBuffer<LiveFrame> frames;
+    std::thread decode_thread;
+    std::atomic<bool> quit;
+    std::atomic<bool> eof;
+    std::atomic<int64_t> frames_decoded;
+    std::atomic<int64_t> frames_dropped;
+};
+
+bool live_source_open(LiveSourceState* state, const char* url, bool wallclock_pts = false);
+bool live_source_acquire_frame(LiveSourceState* state, uint8_t** frame_buffer, int64_t* pts);
+void live_source_frame_presented(LiveSourceState* state);
+bool live_source_eof(LiveSourceState* state);
+void live_source_close(LiveSourceState* state);
+
+#endif
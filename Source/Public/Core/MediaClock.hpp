@@ -0,0 +1,94 @@
+#ifndef MEDIA_CLOCK_HPP
+#define MEDIA_CLOCK_HPP
+
+#include <stdint.h>
+
+#include <Core/AudioPlayer.hpp>
+
+struct MediaClockStats
+{
+    double last_drift;      // seconds the last frame was presented after its time
+    double max_drift;
+    double mean_drift;
+    int64_t frames;
+};
+
+/**
+ * @brief The media time video frames are presented against. With an audio
+ * track it is the position of the audio sink, otherwise (and once the audio
+ * has ended) the wall clock anchored on a media time.
+ */
+class MediaClock
+{
+private:
+    AudioState* m_audio;
+    bool m_audio_master;
+
+    int64_t m_anchor_us;
+    double m_anchor_time;
+    bool m_anchored;
+
+    MediaClockStats m_stats;
+    double m_drift_sum;
+
+public:
+    /**
+     * @brief Default constructor, the clock runs on the wall clock.
+     */
+    MediaClock(void);
+
+public:
+    /**
+     * @brief Makes the play position of an audio track the master clock.
+     *
+     * @param audio The audio track, already opened.
+     */
+    void SetAudio(AudioState* audio);
+
+    /**
+     * @brief Makes the wall clock read media_time now. Has no effect while
+     * audio is the master.
+     *
+     * @param media_time The media time in seconds.
+     */
+    void Anchor(double media_time);
+
+    /**
+     * @brief Checks wether the clock runs at all, which it does once it was
+     * anchored or the audio started playing.
+     */
+    bool IsRunning(void);
+
+    /**
+     * @brief Gets the current media time.
+     *
+     * @returns The media time in seconds.
+     */
+    double Now(void);
+
+    /**
+     * @brief Gets how long until the clock reaches media_time.
+     *
+     * @returns The time in seconds, negative if it went by already.
+     */
+    double Until(double media_time);
+
+    /**
+     * @brief Records how late a frame was presented.
+     *
+     * @param media_time The media time of the frame.
+     */
+    void Presented(double media_time);
+
+    /**
+     * @brief Gets the presentation drift measured so far.
+     */
+    const MediaClockStats& GetStats(void) const;
+
+    /**
+     * @brief Checks wether the audio track is the master clock.
+     */
+    bool IsAudioMaster(void) const;
+};
+
+#endif
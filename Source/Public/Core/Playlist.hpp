@@ -0,0 +1,66 @@
+#ifndef playlist_hpp
+#define playlist_hpp
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Core/VideoReader.hpp>
+#include <Core/WorkerThread.hpp>
+
+// One opened entry of the playlist. Frames of the entry are converted into
+// its own frame buffer, so the next entry can be pre-decoded while the
+// current one is still on display.
+struct PlaylistItem {
+    int index;
+    VideoReaderState reader;
+    uint8_t* frame_buffer;
+
+    // pts bookkeeping, in the time base of the entry's video stream
+    int64_t first_pts;  // pts of the first frame of the entry
+    int64_t end_pts;    // pts at which the last returned frame stops being shown
+    bool has_preroll;   // frame_buffer holds the (not yet returned) first frame
+};
+
+struct PlaylistState {
+    // Public things for other parts of the program to read from
+    int width, height;  // size of the frame last returned by playlist_read_frame
+    int index;          // index of the entry currently on display
+    bool eof;
+    bool live_edge;     // the last frame was read right after its (followed) file grew
+
+    // Parts of the frame buffer the last frame changed, see video_reader_set_roi()
+    VideoRect updated[VIDEO_MAX_ROI];
+    int updated_count;
+
+    // Private internal state
+    std::vector<std::string> paths;
+    VideoReaderOptions options;
+    int decimation;
+    VideoRect roi[VIDEO_MAX_ROI];
+    int roi_count;
+    double preload_lead;    // seconds before the end of an entry at which the next one is opened
+    double entry_offset;    // playlist time at which the current entry's first frame is shown
+    PlaylistItem* current;
+
+    // Next entry, opened and pre-decoded on a background thread
+    PlaylistItem* next;
+    std::thread preload_thread;
+    bool preload_started;
+
+    // Entries that finished playing are torn down on a background thread
+    WorkerThread* releaser;
+};
+
+bool playlist_open(PlaylistState* state, const char* const* paths, int count,
+                   const VideoReaderOptions* options = NULL, double preload_lead = 2.0);
+bool playlist_read_frame(PlaylistState* state, uint8_t** frame_buffer, double* pt_seconds);
+
+// Frames read from now on are scaled down by 2^shift, see video_reader_set_decimation().
+void playlist_set_decimation(PlaylistState* state, int shift);
+
+// Frames read from now on are only converted within these rectangles, see video_reader_set_roi().
+void playlist_set_roi(PlaylistState* state, const VideoRect* rects, int count);
+void playlist_close(PlaylistState* state);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef resource_hpp
+#define resource_hpp
+
+#include <string>
+
+// Small text resources (manifests, playlists) addressed by a local path or
+// by any url libavformat can open.
+
+bool resource_read_text(const char* url, std::string* text);
+
+// Resolves a reference found inside a resource against the resource's url.
+std::string resource_resolve_url(const std::string& base, const std::string& ref);
+
+std::string resource_trim(const std::string& str);
+
+#endif
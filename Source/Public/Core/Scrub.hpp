@@ -0,0 +1,77 @@
+#ifndef scrub_hpp
+#define scrub_hpp
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include <Core/VideoReader.hpp>
+
+// Playback for review, where the position is moved around a lot. While the
+// position is being scrubbed frames come from a low resolution proxy of the
+// master, which decodes and seeks many times faster. Once the position has
+// stayed put for settle_time seconds the master takes over at the frame the
+// proxy was showing. Without a proxy file one is encoded from the master in
+// the background, the master alone is used until it is done.
+
+struct ScrubOptions {
+    // Seconds without a seek before the master is shown again
+    double settle_time = 0.5;
+
+    // Width of a generated proxy, its height keeps the aspect ratio
+    int proxy_width = 1024;
+
+    // Frames between keyframes of a generated proxy, short so seeks are cheap
+    int proxy_keyframe_interval = 10;
+};
+
+struct ScrubStats {
+    int64_t seeks;
+    int64_t proxy_frames;       // frames shown from the proxy
+    int64_t master_switches;    // times the master took over after a scrub
+    double last_switch_time;    // seconds the last switch back to the master took
+};
+
+struct ScrubState {
+    // Public things for other parts of the program to read from
+    int width, height;          // size of the frame last returned by scrub_read_frame
+    int proxy_width, proxy_height;  // 0 while there is no proxy
+    bool eof;
+    bool on_proxy;              // the last frame came from the proxy
+    bool discontinuity;         // the last frame doesn't follow the one before (seek, switch)
+    std::atomic<float> generate_progress;   // share of the proxy encoded so far, 1 once it is usable
+    ScrubStats stats;
+
+    // Private internal state
+    VideoReaderState master;
+    VideoReaderState proxy;
+    uint8_t* master_buffer;
+    uint8_t* proxy_buffer;
+    bool proxy_open;
+    std::string master_path;
+    std::string proxy_path;
+
+    ScrubOptions options;
+    double duration;            // seconds
+    double position;            // seconds, of the last frame returned
+    int64_t last_seek;          // av_gettime_relative() of the last seek
+    bool seek_pending;          // the master has to be moved to the proxy's position
+
+    // Proxy encoding, if there was none
+    std::thread generator;
+    std::atomic<bool> generated;
+    std::atomic<bool> quit;
+};
+
+// The proxy is opened from proxy_path, or encoded into it in the background
+// if it doesn't exist. NULL for the master path with ".proxy.mp4" appended.
+bool scrub_open(ScrubState* state, const char* master_path, const char* proxy_path = NULL,
+                const VideoReaderOptions* options = NULL, const ScrubOptions* scrub_options = NULL);
+
+// Moves the position by offset seconds from the last frame returned. Frames
+// come from the proxy from now on until the position settles.
+void scrub_seek(ScrubState* state, double offset);
+bool scrub_read_frame(ScrubState* state, uint8_t** frame_buffer, double* pt_seconds);
+void scrub_close(ScrubState* state);
+
+#endif
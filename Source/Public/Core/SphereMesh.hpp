@@ -0,0 +1,87 @@
+#ifndef sphere_mesh_hpp
+#define sphere_mesh_hpp
+
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// The sphere the frame is mapped on, as a triangle mesh at a few levels of
+// detail. All levels share one interleaved vertex buffer and one 16-bit
+// index buffer (a level's indices are relative to its first vertex, drawn
+// with a base vertex). Each level is cut into bands of latitude and
+// longitude, so only the bands in view are drawn. Within a band the
+// triangles go in narrow strips, so the post-transform cache keeps the
+// row of vertices shared with the row before. Vertices are stored in the
+// order the indices first use them.
+//
+// Positions are on the unit sphere, texture coordinates map it the same way
+// as the ray cast in EntryPoint.cpp and SphereView do: u follows the
+// longitude from 0 to 1, v goes from the north pole (0) to the south pole (1).
+
+// Bands per level, along longitude and latitude
+#define SPHERE_MESH_BAND_COLUMNS 16
+#define SPHERE_MESH_BAND_ROWS 8
+
+// Post-transform cache the layout is measured against, in vertices (FIFO)
+#define SPHERE_MESH_CACHE_SIZE 16
+
+struct SphereVertex {
+    glm::vec3 position;
+    glm::vec2 tex_coords;
+};
+
+struct SphereBand {
+    uint32_t first_index;       // into the level's indices
+    uint32_t index_count;
+    glm::vec3 center;           // bounding sphere
+    float radius;
+};
+
+struct SphereLod {
+    int lon_count, lat_count;   // cells around and from pole to pole
+    uint32_t first_vertex;      // the level's indices count from here
+    uint32_t vertex_count;
+    uint32_t first_index;
+    uint32_t index_count;
+    std::vector<SphereBand> bands;
+    float acmr;                 // cache misses per triangle, 0.5 at best for a grid
+};
+
+struct SphereMesh {
+    std::vector<SphereVertex> vertices;
+    std::vector<uint16_t> indices;
+    std::vector<SphereLod> lods;    // finest first
+    double build_time;              // seconds
+};
+
+// Ranges of the index buffer to draw, for glMultiDrawElementsBaseVertex.
+// Bands next to each other in the buffer are merged into one range.
+struct SphereMeshDraws {
+    std::vector<int> counts;
+    std::vector<const void*> offsets;   // bytes into the index buffer
+    std::vector<int> base_vertices;
+    int bands;                          // bands in view
+    int triangles;
+};
+
+// Builds lod_count levels, the finest lon_count cells around, each level
+// half as fine as the one before. Cells are square in angle. Levels have to
+// stay under 65536 vertices for 16-bit indices, 256 cells around at most.
+void sphere_mesh_build(SphereMesh* mesh, int lon_count, int lod_count);
+
+// The coarsest level whose cells span at most cell_pixels on screen, seen
+// with a vertical field of view of fov_degrees over viewport_height pixels
+// from eye_distance (in sphere radii) to the sphere's center.
+int sphere_mesh_pick_lod(const SphereMesh* mesh, float fov_degrees, int viewport_height,
+                         float eye_distance, float cell_pixels);
+
+// The bands of a level that intersect the view frustum of mvp (which has to
+// include the sphere scale, as for SphereView).
+void sphere_mesh_cull(const SphereMesh* mesh, int lod, const glm::mat4& mvp, SphereMeshDraws* draws);
+
+// Post-transform cache misses per triangle of a triangle list, with a FIFO
+// cache of cache_size vertices.
+float sphere_mesh_acmr(const uint16_t* indices, size_t index_count, int cache_size);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef sphere_view_hpp
+#define sphere_view_hpp
+
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Which part of the equirectangular frame ends up on screen. Rays are cast
+// from a grid of points on the screen onto the unit sphere of the mesh (in
+// model space, so model has to include the sphere scale) and the hits are
+// mapped to frame coordinates the same way the mesh maps them: u follows the
+// longitude from 0 to 1, v goes from the north pole (0) to the south pole (1).
+//
+// The mesh is seen from the inside, so a ray lands where it leaves the sphere.
+
+// Frame coordinates (u, v) seen through the screen point (ndc_x, ndc_y), in
+// normalized device coordinates. Returns false if the ray misses the sphere.
+bool sphere_view_cast(const glm::mat4& mvp, float ndc_x, float ndc_y, glm::vec2* uv);
+
+// Marks the cells of a columns x rows grid over the frame that are on screen
+// or within margin_degrees of it. visible is resized to columns * rows and
+// filled row-major.
+void sphere_view_visible_cells(const glm::mat4& mvp, int columns, int rows, float margin_degrees,
+                               std::vector<uint8_t>* visible);
+
+// Bounds of the part of the frame that is on screen or within margin_degrees
+// of it: one band of latitude, split at the seam into two rectangles if it
+// wraps around. Each rectangle is (u0, v0, u1, v1). Returns the number of
+// rectangles, 0 if the sphere is not in view.
+int sphere_view_bounds(const glm::mat4& mvp, float margin_degrees, glm::vec4 bounds[2]);
+
+struct ViewFootprint {
+    glm::vec2 uv;               // frame coordinates seen through the sample
+    float texels_per_pixel;     // frame texels one screen pixel spans there
+};
+
+// Samples the screen every spacing pixels, for picking the detail level a
+// frame of frame_width x frame_height texels is needed at. The footprint is
+// the larger of the two screen axes, as GPU mip selection does.
+void sphere_view_footprints(const glm::mat4& mvp, int viewport_width, int viewport_height, int spacing,
+                            int frame_width, int frame_height, std::vector<ViewFootprint>* footprints);
+
+#endif
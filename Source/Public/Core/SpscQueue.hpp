@@ -0,0 +1,86 @@
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * @brief Lock-free single producer / single consumer queue of fixed
+ * capacity.
+ *
+ * The producer only writes the tail and the consumer only writes the head,
+ * each reads the other's index to tell whether there is room or something
+ * to pop. Neither side ever waits: pushing into a full queue fails.
+ */
+template <typename T, size_t N>
+class SpscQueue
+{
+private:
+    static_assert((N & (N - 1)) == 0, "SpscQueue capacity has to be a power of two");
+
+private:
+    /**
+     * @brief The slots, indexed by the head and tail modulo N.
+     */
+    T m_slots[N];
+
+    /**
+     * @brief Count of values popped so far, written by the consumer.
+     */
+    std::atomic<size_t> m_head;
+
+    /**
+     * @brief Count of values pushed so far, written by the producer.
+     */
+    std::atomic<size_t> m_tail;
+
+public:
+    /**
+     * @brief Default constructor.
+     */
+    SpscQueue(void)
+        : m_head(0), m_tail(0)
+    {
+    }
+
+public:
+    /**
+     * @brief Appends a value. Called by the producer.
+     *
+     * @param value The value to append.
+     * @returns False if the queue is full and the value was dropped,
+     * otherwise true.
+     */
+    bool Push(const T& value)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if(tail - m_head.load(std::memory_order_acquire) == N)
+            return false;
+
+        m_slots[tail & (N - 1)] = value;
+        m_tail.store(tail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+public:
+    /**
+     * @brief Takes the oldest value. Called by the consumer.
+     *
+     * @param value Set to the value taken.
+     * @returns False if the queue is empty, otherwise true.
+     */
+    bool Pop(T* value)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if(head == m_tail.load(std::memory_order_acquire))
+            return false;
+
+        *value = m_slots[head & (N - 1)];
+        m_head.store(head + 1, std::memory_order_release);
+
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef stereo_reader_hpp
+#define stereo_reader_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <Core/VideoReader.hpp>
+
+// Stereoscopic video stored as two video streams of one file, the first one
+// being the left eye. Each eye is decoded on its own thread (each with its
+// own demuxer, so the file is read twice) into a short queue, and frames are
+// paired by presentation time. The left eye drives the timeline: right eye
+// frames older than the left frame are dropped, and when the right eye has
+// no frame for it the previous right frame is shown again. Pairing only
+// looks at timestamps, never at how fast the threads happen to run, so a
+// given file always plays back with the same pairs.
+
+#define STEREO_QUEUE_SIZE 4
+
+struct StereoFrame {
+    uint8_t* data;
+    int64_t pts;
+};
+
+struct StereoEye {
+    VideoReaderState reader;
+    bool opened;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    // Ring of decoded frames. The slot before read_index holds the frame
+    // last handed out and is not written until the next one is taken.
+    StereoFrame slots[STEREO_QUEUE_SIZE];
+    int read_index;
+    int count;
+    bool taken;         // a frame was handed out at least once
+    bool eof;
+};
+
+struct StereoStats {
+    int64_t pairs;
+    int64_t dropped;        // right eye frames skipped to catch up with the left eye
+    int64_t duplicated;     // right eye frames shown twice while it lagged
+};
+
+struct StereoState {
+    // Public things for other parts of the program to read from
+    int width, height;      // of each eye
+    bool eof;
+    StereoStats stats;
+
+    // Private internal state
+    StereoEye eyes[2];
+    double frame_interval;
+    std::atomic<bool> quit;
+};
+
+bool stereo_open(StereoState* state, const char* filename, const VideoReaderOptions* options = NULL);
+
+// The next left/right pair. Both buffers stay valid until the next call.
+bool stereo_read_frame(StereoState* state, uint8_t** left, uint8_t** right, double* pt_seconds);
+void stereo_close(StereoState* state);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A fixed set of threads running submitted jobs in parallel, used to
+ * spread independent decodes over all cores.
+ */
+class ThreadPool
+{
+private:
+    using Job = std::function<void(void)>;
+
+private:
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::condition_variable m_idle_cv;
+    std::deque<Job> m_jobs;
+    int m_busy;
+    bool m_quit;
+
+public:
+    /**
+     * @brief Starts the threads.
+     *
+     * @param thread_count Number of threads, 0 for one per hardware thread.
+     */
+    ThreadPool(int thread_count = 0);
+
+public:
+    /**
+     * @brief Default destructor, runs the remaining jobs and joins the threads.
+     */
+    ~ThreadPool(void);
+
+public:
+    /**
+     * @brief Queues a job to be run on one of the threads.
+     *
+     * @param job The function to be called.
+     */
+    void Submit(Job job);
+
+    /**
+     * @brief Blocks until every submitted job has finished.
+     */
+    void Wait(void);
+
+    /**
+     * @brief Gets the number of threads.
+     *
+     * @return The number of threads.
+     */
+    int GetThreadCount(void) const;
+
+private:
+    void Run(void);
+};
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef tile_manifest_hpp
+#define tile_manifest_hpp
+
+#include <string>
+#include <vector>
+
+// An equirectangular video cut into a grid of independently encoded tiles,
+// plus a low resolution base layer covering the whole sphere. Text format,
+// one directive per line:
+//
+//   grid <columns> <rows>
+//   size <width> <height>                  resolution of the full frame
+//   base <url> [stream index]
+//   tile <column> <row> <url> [stream index]
+//
+// Urls are relative to the manifest. Column 0 starts at longitude 0 and row 0
+// at the north pole, like the frame itself. Tiles can also be the video
+// streams of a single container, told apart by their stream index.
+
+struct TileStream {
+    std::string url;
+    int stream_index;       // -1 for the first video stream
+};
+
+struct TileManifest {
+    int columns, rows;
+    int width, height;
+    TileStream base;
+    std::vector<TileStream> tiles;  // row-major, columns * rows entries
+};
+
+bool tile_manifest_load(const char* url, TileManifest* manifest);
+
+// Writes the manifest to a local file, with the urls as they are.
+bool tile_manifest_save(const char* path, const TileManifest& manifest);
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef tiled_player_hpp
+#define tiled_player_hpp
+
+#include <stdint.h>
+#include <vector>
+
+#include <Core/ThreadPool.hpp>
+#include <Core/TileManifest.hpp>
+#include <Core/VideoReader.hpp>
+
+// Playback of a tiled equirectangular video (see TileManifest.hpp) that only
+// decodes the tiles in view. The base layer is always decoded and covers
+// whatever no tile does. A tile coming into view starts on its next keyframe
+// and one leaving the view stops on its next keyframe, so tile streams need
+// keyframes aligned with each other (the tiler tool writes them that way).
+// Tiles are decoded in parallel.
+//
+// Every tile has a reader of its own, tiles that are streams of a single
+// container each demux all of it and drop the other streams' packets. For a
+// grid of N tiles that is N times the container's I/O and parsing, which is
+// fine for local files but not for a remote source with many tiles.
+
+enum TileStatus {
+    TILE_IDLE,      // not decoded, the base layer shows through
+    TILE_PENDING,   // positioned on a keyframe ahead, waiting for playback to reach it
+    TILE_ACTIVE,    // decoded every frame and drawn over the base layer
+};
+
+struct Tile {
+    // Public things for other parts of the program to read from
+    int column, row;
+    TileStatus status;
+    int width, height;
+    uint8_t* frame_buffer;
+    bool updated;           // frame_buffer changed during the last tiled_read_frame
+
+    // Private internal state
+    VideoReaderState reader;
+    bool opened;
+    bool wanted;
+    int64_t pts;            // of the frame in av_frame
+};
+
+struct TiledStats {
+    int active_tiles;
+    int pending_tiles;
+    double decode_time;     // wall time of the last tiled_read_frame
+};
+
+struct TiledState {
+    // Public things for other parts of the program to read from
+    TileManifest manifest;
+    int width, height;      // of the base layer
+    std::vector<Tile> tiles;
+    bool eof;
+    TiledStats stats;
+
+    // Private internal state
+    VideoReaderState base;
+    uint8_t* base_frame_buffer;
+    double frame_interval;
+    ThreadPool* pool;
+};
+
+bool tiled_open(TiledState* state, const char* manifest_url, const VideoReaderOptions* options = NULL);
+
+// Tiles to decode from now on, one entry per tile in manifest order (see
+// sphere_view_visible_cells).
+void tiled_set_visible(TiledState* state, const std::vector<uint8_t>& visible);
+
+bool tiled_read_frame(TiledState* state, uint8_t** frame_buffer, double* pt_seconds);
+void tiled_close(TiledState* state);
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef TILED_TEXTURE_HPP
+#define TILED_TEXTURE_HPP
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <GL/glew.h>
+
+#include <Core/UploadRing.hpp>
+#include <Core/VideoReader.hpp>
+
+/**
+ * @brief An RGBA frame larger than the driver's GL_MAX_TEXTURE_SIZE, split
+ * into a grid of tiles kept as the layers of a GL_TEXTURE_2D_ARRAY. Every
+ * tile carries a border of one texel copied from its neighbours, as the
+ * tiles of the panorama atlas do, so filtering doesn't show the tile edges.
+ * tiled_frame_frag_shader in EntryPoint.cpp picks the layer per fragment.
+ */
+class TiledTexture
+{
+private:
+    struct Piece
+    {
+        int layer;
+        int layer_x, layer_y;   // where in the layer, border included
+        VideoRect source;       // where in the frame
+    };
+
+private:
+    GLuint m_texture;
+    int m_width, m_height;
+    int m_tile_width, m_tile_height;    // texels of the frame per tile, borders excluded
+    int m_columns, m_rows;
+    std::vector<Piece> m_pieces;
+
+public:
+    /**
+     * @brief Default constructor, the texture is created on Allocate().
+     */
+    TiledTexture(void);
+
+public:
+    /**
+     * @brief Default destructor, releases the texture. Needs the GL context
+     * to be current.
+     */
+    ~TiledTexture(void);
+
+public:
+    /**
+     * @brief Checks whether a frame needs splitting.
+     *
+     * @param max_size GL_MAX_TEXTURE_SIZE, or a smaller limit.
+     */
+    static bool IsNeeded(int width, int height, int max_size);
+
+    /**
+     * @brief Splits a frame of the given size into as few tiles as fit
+     * max_size, borders included, and allocates their layers.
+     */
+    void Allocate(int width, int height, int max_size);
+
+    /**
+     * @brief Uploads rectangles of a frame (tightly packed RGBA rows) into
+     * the tiles they fall in, their borders included, through the ring.
+     * Uploads larger than a slot of the ring go through several.
+     */
+    void Upload(UploadRing& ring, const uint8_t* frame, const VideoRect* rects, int count);
+
+    /**
+     * @brief Sets the tile layout uniforms of tiled_frame_frag_shader.
+     */
+    void SetUniforms(GLuint program_id) const;
+
+    GLuint GetTexture(void) const;
+    int GetLayerCount(void) const;
+
+private:
+    void UploadPieces(UploadRing& ring, const uint8_t* frame, size_t size);
+    void Release(void);
+};
+
+#endif
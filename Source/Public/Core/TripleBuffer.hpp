@@ -0,0 +1,113 @@
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @brief Lock-free single producer / single consumer triple buffer.
+ *
+ * The producer always owns the back buffer and the consumer always owns the
+ * front buffer; the middle buffer is exchanged between them atomically.
+ * Publishing never waits for the consumer, so the consumer only ever sees
+ * the latest published value and older unseen values are overwritten.
+ */
+template <typename T>
+class TripleBuffer
+{
+private:
+    static constexpr uint8_t DIRTY_BIT = 0x4;
+
+private:
+    /**
+     * @brief The three buffers.
+     */
+    T m_buffers[3];
+
+    /**
+     * @brief Index of the middle buffer, with DIRTY_BIT set while it holds a
+     * value the consumer has not picked up yet.
+     */
+    std::atomic<uint8_t> m_middle_index;
+
+    /**
+     * @brief Index of the buffer owned by the producer.
+     */
+    uint8_t m_back_index;
+
+    /**
+     * @brief Index of the buffer owned by the consumer.
+     */
+    uint8_t m_front_index;
+
+public:
+    /**
+     * @brief Default constructor.
+     */
+    TripleBuffer(void)
+        : m_middle_index(1), m_back_index(0), m_front_index(2)
+    {
+    }
+
+public:
+    /**
+     * @brief Gets one of the three buffers regardless of who owns it, meant
+     * for allocating and releasing their contents while no thread uses them.
+     *
+     * @param index The buffer index, in range [0, 3).
+     */
+    T& GetBuffer(int index)
+    {
+        return m_buffers[index];
+    }
+
+public:
+    /**
+     * @brief Gets the buffer the producer writes into.
+     */
+    T& GetBack(void)
+    {
+        return m_buffers[m_back_index];
+    }
+
+    /**
+     * @brief Publishes the back buffer to the consumer. Called by the producer.
+     *
+     * @returns True if an earlier published value was never picked up by the
+     * consumer and has now been overwritten, otherwise false.
+     */
+    bool Publish(void)
+    {
+        uint8_t prev = m_middle_index.exchange(m_back_index | DIRTY_BIT, std::memory_order_acq_rel);
+        m_back_index = prev & ~DIRTY_BIT;
+
+        return (prev & DIRTY_BIT) != 0;
+    }
+
+public:
+    /**
+     * @brief Makes the latest published value the front buffer, if there is
+     * one the consumer hasn't seen yet. Called by the consumer.
+     *
+     * @returns True if the front buffer changed, otherwise false.
+     */
+    bool Update(void)
+    {
+        if(!(m_middle_index.load(std::memory_order_relaxed) & DIRTY_BIT))
+            return false;
+
+        m_front_index = m_middle_index.exchange(m_front_index, std::memory_order_acq_rel) & ~DIRTY_BIT;
+
+        return true;
+    }
+
+    /**
+     * @brief Gets the buffer the consumer reads from.
+     */
+    T& GetFront(void)
+    {
+        return m_buffers[m_front_index];
+    }
+};
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef UPLOAD_RING_HPP
+#define UPLOAD_RING_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include <GL/glew.h>
+
+struct UploadRingStats
+{
+    int64_t uploads;
+    int64_t stalls;         // uploads that found no free slot and waited for the GPU
+    double stall_time;      // seconds spent waiting for free slots, in total
+    double write_time;      // seconds the last upload took on the CPU, from acquire to submit
+    bool persistent;        // slots are persistently mapped (ARB_buffer_storage), otherwise
+                            // orphaned: any wait happens in the driver and stalls stay 0
+};
+
+/**
+ * @brief A ring of pixel unpack buffers texture uploads go through, so
+ * glTexSubImage2D returns right away and the GPU copies the texels while
+ * the CPU moves on. Texels are written into one slot while the GPU still
+ * reads from the others, a fence per slot tells when it may be written
+ * again.
+ *
+ * With ARB_buffer_storage the slots are mapped once, persistently and
+ * coherently. Otherwise each slot is orphaned and mapped again per upload,
+ * which lets the driver hand out fresh storage instead of waiting.
+ */
+class UploadRing
+{
+private:
+    struct Slot
+    {
+        GLuint buffer;
+        uint8_t* mapped;    // persistent mapping, or the one of the upload in progress
+        GLsync fence;       // set once the GPU was given copies from the slot
+    };
+
+private:
+    std::vector<Slot> m_slots;
+    size_t m_slot_size;
+    size_t m_max_size;      // bytes all slots together may take
+    int m_slot_count;
+    int m_current;          // slot being written, -1 if none
+    bool m_persistent;
+
+    int64_t m_acquire_us;
+    UploadRingStats m_stats;
+
+public:
+    /**
+     * @brief Default constructor, the buffers are created on first use.
+     *
+     * @param slot_count Number of slots, the uploads the GPU may lag behind by.
+     * @param max_size Most bytes all the slots together grow to. A slot
+     * holds a whole frame up to max_size / slot_count (about 179 MB by
+     * default, an 8K RGB0 frame is about 133 MB), only larger uploads are split
+     * across slots by the caller.
+     */
+    UploadRing(int slot_count = 3, size_t max_size = (size_t)512 << 20);
+
+public:
+    /**
+     * @brief Default destructor, releases the buffers. Needs the GL context
+     * to be current.
+     */
+    ~UploadRing(void);
+
+public:
+    /**
+     * @brief Takes the next slot for writing, waiting if the GPU still reads
+     * from it. The slots grow to the largest size asked for, up to
+     * GetMaxSize(), so a frame usually takes one slot.
+     *
+     * @param size The number of bytes to write.
+     * @returns Where to write them, valid until Submit(). nullptr if the size
+     * is over GetMaxSize() or the slot couldn't be mapped.
+     */
+    uint8_t* Acquire(size_t size);
+
+    /**
+     * @brief Binds the slot written to as GL_PIXEL_UNPACK_BUFFER. Texture
+     * uploads issued from now on until Submit() read from the slot, their
+     * data pointer being the byte offset into it.
+     */
+    void Bind(void);
+
+    /**
+     * @brief Fences the slot after the uploads from it and unbinds it.
+     */
+    void Submit(void);
+
+    /**
+     * @brief Gets the most bytes one Acquire() takes, the ring's byte cap
+     * shared out between the slots.
+     */
+    size_t GetMaxSize(void) const;
+
+    /**
+     * @brief Gets the upload and stall counts so far.
+     */
+    const UploadRingStats& GetStats(void) const;
+
+private:
+    void Allocate(size_t size);
+    void Release(void);
+};
+
+#endif
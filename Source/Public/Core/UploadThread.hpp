@@ -0,0 +1,62 @@
+#ifndef UPLOAD_THREAD_HPP
+#define UPLOAD_THREAD_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+/**
+ * @brief A background thread running posted jobs in order with a GL
+ * context of its own current, one sharing objects with the window's (see
+ * Application::CreateSharedContext). Textures filled there are handed to
+ * the render thread with fences, so uploads and the driver work behind
+ * them stay off the render thread.
+ */
+class UploadThread
+{
+private:
+    using Job = std::function<void(void)>;
+
+private:
+    GLFWwindow* m_context;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<Job> m_jobs;
+    bool m_quit;
+
+public:
+    /**
+     * @brief Default constructor, starts the thread and makes the context
+     * current on it.
+     *
+     * @param context The hidden window of the shared context, owned from now on.
+     */
+    UploadThread(GLFWwindow* context);
+
+public:
+    /**
+     * @brief Default destructor, finishes the job being run, drops the rest
+     * and joins the thread. Destroys the context, so it has to be called
+     * from the main thread.
+     */
+    ~UploadThread(void);
+
+public:
+    /**
+     * @brief Queues a job to be run on the upload thread.
+     *
+     * @param job The function to be called.
+     */
+    void Post(Job job);
+
+private:
+    void Run(void);
+};
+
+#endif
@@ -9,10 +9,39 @@ extern "C" {
 #include <inttypes.h>
 }
 
+#include <Core/HttpCache.hpp>
+
+#define VIDEO_MAX_ROI 2
+
+struct VideoRect {
+    int x, y, width, height;
+};
+
 struct VideoReaderState {
     // Public things for other parts of the program to read from
     int width, height;
     AVRational time_base;
+    bool eof;
+    bool live_edge;     // the last frame was read right after the file grew (follow mode)
+
+    // Frames are converted to 16-bit P010 planes instead of RGB0: the luma
+    // plane (width x height samples) followed by the interleaved chroma
+    // plane (2 x (width + 1) / 2 x (height + 1) / 2 samples). This fits in
+    // a width * height * 4 frame buffer. See HdrColor.hpp.
+    bool high_bit_depth;
+
+    // Size of the last converted frame, smaller than width x height while
+    // a decimation is set
+    int output_width, output_height;
+
+    // Parts of the frame buffer the last conversion wrote, in output pixels.
+    // The rest still holds older frames.
+    VideoRect converted[VIDEO_MAX_ROI];
+    int converted_count;
+
+    // Seconds spent demuxing, decoding and converting the last frame
+    double demux_time, decode_time, convert_time;
+    int64_t demuxed_bytes;  // video packet bytes read so far
 
     // Private internal state
     AVFormatContext* av_format_ctx;
@@ -21,11 +50,78 @@ struct VideoReaderState {
     AVFrame* av_frame;
     AVPacket* av_packet;
     SwsContext* sws_scaler_ctx;
+    SwsContext* roi_sws_ctx[VIDEO_MAX_ROI];
+    VideoRect roi[VIDEO_MAX_ROI];
+    int roi_count;
+
+    bool follow;
+    int decimation;
+
+    // Custom I/O layer, if any, and how to release it
+    AVIOContext* av_io_ctx;
+    void (*av_io_close)(AVIOContext** io);
+};
+
+struct VideoReaderOptions {
+    // Live input (pipes, udp:// on loopback, ...): minimal probing, no
+    // demuxer buffering, low delay decoding and slice threading only, so
+    // the decoder never holds frames back.
+    bool low_latency = false;
+
+    // Follow a file that is still being written: at the end of the file
+    // wait for it to grow instead of stopping, until it hasn't grown for
+    // follow_idle_timeout seconds.
+    bool follow = false;
+    double follow_idle_timeout = 10.0;
+
+    // Read http(s) sources through a chunk cache with read-ahead, so seeks
+    // don't re-fetch data that was already downloaded.
+    bool http_cache = false;
+    HttpCacheConfig http_cache_config;
+
+    // Video stream to decode, -1 for the first one. Lets several readers
+    // share a container holding more than one video stream.
+    int stream_index = -1;
+
+    // Keep more than 8 bits per sample (10-bit HEVC and the like) by
+    // converting to P010 planes instead of RGB0.
+    bool high_bit_depth = false;
+
+    // Decoder private options as "key=value:key=value", NULL for none.
+    // Options the decoder doesn't know are ignored.
+    const char* decoder_options = NULL;
 };
 
-bool video_reader_open(VideoReaderState* state, const char* filename);
+bool video_reader_open(VideoReaderState* state, const char* filename, const VideoReaderOptions* options = NULL);
 bool video_reader_read_frame(VideoReaderState* state, uint8_t** frame_buffer, int64_t* pts);
+
+// video_reader_read_frame() in two steps: decode the next frame into
+// av_frame, then convert it to RGB0 into frame_buffer.
+bool video_reader_decode_frame(VideoReaderState* state, int64_t* pts);
+bool video_reader_convert_frame(VideoReaderState* state, uint8_t* frame_buffer);
 bool video_reader_seek_frame(VideoReaderState* state, int64_t ts);
+
+// Positions the reader on the first keyframe at or after ts and decodes it
+// into av_frame, for switching streams without a visible glitch.
+bool video_reader_seek_keyframe(VideoReaderState* state, int64_t ts, int64_t* pts);
+
+// Positions the reader on the frame on screen at ts and decodes it into
+// av_frame. Decodes from the keyframe before ts on, so the cost grows with
+// the keyframe interval.
+bool video_reader_seek_exact(VideoReaderState* state, int64_t ts, int64_t* pts);
+
+// Frames converted from now on are scaled down by 2^shift along each axis
+// (sizes rounded up), in the same sws pass as the pixel format conversion.
+// For showing large frames in a view that can't resolve them anyway.
+void video_reader_set_decimation(VideoReaderState* state, int shift);
+
+// Frames converted from now on are only converted within these rectangles
+// (at most VIDEO_MAX_ROI, in frame pixels, grown to a 64 pixel grid), the
+// rest of the frame buffer is left as it is. No rectangles for the whole
+// frame. Formats that can't be cut (bitstream, paletted) are always
+// converted whole, check converted[].
+void video_reader_set_roi(VideoReaderState* state, const VideoRect* rects, int count);
+bool video_reader_http_cache_stats(VideoReaderState* state, HttpCacheStats* stats);
 void video_reader_close(VideoReaderState* state);
 
 #endif
\ No newline at end of file
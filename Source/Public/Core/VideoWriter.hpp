@@ -0,0 +1,51 @@
+#ifndef video_writer_hpp
+#define video_writer_hpp
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+#include <inttypes.h>
+}
+
+// Encodes RGB0 frames into a video file, the counterpart of VideoReader.
+// Keyframes are placed on every keyframe_interval-th frame and nowhere else,
+// so files written with the same interval from the same frames can be
+// switched between on any keyframe.
+
+struct VideoWriterOptions {
+    const char* codec = "libx264";     // falls back to any h264 encoder, then mpeg4
+    int keyframe_interval = 30;         // frames
+    int64_t bit_rate = 0;               // bits per second, 0 for the encoder default
+    int thread_count = 0;               // encoder threads, 0 for automatic
+};
+
+struct VideoWriterState {
+    // Public things for other parts of the program to read from
+    int width, height;
+    AVRational time_base;       // of the pts given to video_writer_write_frame
+    int64_t frames_written;
+
+    // Private internal state
+    AVFormatContext* av_format_ctx;
+    AVCodecContext* av_codec_ctx;
+    AVStream* av_stream;
+    AVFrame* av_frame;
+    AVPacket* av_packet;
+    SwsContext* sws_scaler_ctx;
+    int keyframe_interval;
+};
+
+bool video_writer_open(VideoWriterState* state, const char* filename, int width, int height,
+                       AVRational time_base, AVRational frame_rate, const VideoWriterOptions* options = NULL);
+
+// Scales the src_width x src_height RGB0 image at src (rows src_linesize
+// bytes apart, so a region of a larger frame works too) to the output size
+// and encodes it.
+bool video_writer_write_frame(VideoWriterState* state, const uint8_t* src, int src_linesize,
+                              int src_width, int src_height, int64_t pts);
+
+// Flushes the encoder and finishes the file. Returns false if that failed.
+bool video_writer_close(VideoWriterState* state);
+
+#endif
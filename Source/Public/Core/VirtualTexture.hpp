@@ -0,0 +1,119 @@
+#ifndef virtual_texture_hpp
+#define virtual_texture_hpp
+
+#include <stdint.h>
+
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <Core/SphereView.hpp>
+#include <Core/WorkerThread.hpp>
+
+// Still panoramas far larger than GL_MAX_TEXTURE_SIZE, shown through a
+// virtual texture. The image is imported once into a tile file holding a mip
+// pyramid cut into fixed size tiles. The file is memory mapped and only the
+// tiles the current view needs at its current zoom are copied into a cache
+// texture (the atlas), least recently used tiles making room for new ones.
+// A page table texture tells the shader where each tile sits in the atlas,
+// or which coarser tile stands in for one that isn't there yet. The coarsest
+// level is a single tile that never leaves the cache, so there is always
+// something to show. Memory use is set by the atlas size, not by the image.
+
+#define VT_TILE_SIZE 256                                    // texels of a tile without its border
+#define VT_TILE_BORDER 1                                    // texels copied from the neighbours, for filtering
+#define VT_SLOT_SIZE (VT_TILE_SIZE + 2 * VT_TILE_BORDER)    // texels of a stored tile
+#define VT_MAX_LEVELS 16
+
+// Tile file layout (little endian): this header, then the RGBA tiles of every
+// level from the finest to the coarsest, each level row-major, each tile
+// VT_SLOT_SIZE x VT_SLOT_SIZE texels with its border. Tiles past the right
+// edge wrap around (the image is a full turn), the ones past the bottom
+// repeat the last row.
+struct VirtualTextureHeader {
+    char magic[8];          // "S360VT01"
+    uint32_t width, height; // of level 0
+    uint32_t level_count;
+    uint32_t reserved;
+};
+
+struct VirtualTextureLevel {
+    int width, height;
+    int columns, rows;      // tiles
+    int64_t first_tile;     // index of the level's first tile in the file
+    int page_row;           // first row of the level in the page table
+};
+
+// A tile to copy into the atlas before the next draw.
+struct VtUpload {
+    int slot_x, slot_y;     // position in the atlas, in slots
+    const uint8_t* texels;  // VT_SLOT_SIZE x VT_SLOT_SIZE RGBA, in the mapped file
+};
+
+struct VtSlot {
+    int64_t tile;           // tile held, -1 if none
+    uint64_t last_used;     // frame the tile was last needed in
+    bool pinned;
+};
+
+struct VirtualTextureStats {
+    int needed;             // tiles the last view needed, coarser stand-ins included
+    int resident;
+    int uploads;            // tiles uploaded for the last view
+    int64_t loads;
+    int64_t evictions;
+};
+
+struct VirtualTextureState {
+    // Public things for other parts of the program to read from
+    int width, height;
+    int level_count;
+    VirtualTextureLevel levels[VT_MAX_LEVELS];
+    int atlas_slots;        // slots along each side of the atlas
+
+    // RGBA8 page table, page_width x page_height entries: slot x, slot y,
+    // level of the tile in that slot (a coarser one while the tile itself is
+    // missing) and 255, or all zero if nothing covers the page yet. Level L
+    // starts at row levels[L].page_row.
+    int page_width, page_height;
+    std::vector<uint8_t> page_table;
+    bool page_table_dirty;  // set on changes, cleared by whoever uploads the page table
+
+    VirtualTextureStats stats;
+
+    // Private internal state
+    const uint8_t* data;    // mapped tile file
+    int64_t data_size;
+    uint64_t frame;
+
+    std::vector<VtSlot> slots;
+    std::unordered_map<int64_t, int> resident;  // tile -> slot
+
+    // Tiles are paged in from the file on a worker thread before the render
+    // thread copies them, so it never waits for the disk
+    WorkerThread* prefetcher;
+    std::mutex mutex;
+    std::unordered_set<int64_t> prefetching;
+    std::unordered_set<int64_t> prefetched;
+};
+
+// Imports an image into a tile file, a row at a time: JPEG and PNG take
+// memory for a tile row of each level whatever their size, anything else
+// FFmpeg decodes is read whole first.
+bool virtual_texture_build(const char* image_path, const char* tile_path);
+
+// Whether the file starts like a tile file.
+bool virtual_texture_probe(const char* path);
+
+bool virtual_texture_open(VirtualTextureState* state, const char* tile_path, int atlas_slots);
+
+// Works out the tiles a view needs from its footprints (sampled against a
+// frame of width x height) and brings them into the cache, at most max_uploads
+// per call, coarse levels first. The uploads have to reach the atlas before
+// the page table, which is updated to match, is used.
+void virtual_texture_update(VirtualTextureState* state, const std::vector<ViewFootprint>& footprints,
+                            int max_uploads, std::vector<VtUpload>* uploads);
+void virtual_texture_close(VirtualTextureState* state);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef WORKER_THREAD_HPP
+#define WORKER_THREAD_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/**
+ * @brief A single background thread running posted jobs in order, used to
+ * get slow work such as tearing down decoders off the render thread.
+ */
+class WorkerThread
+{
+private:
+    using Job = std::function<void(void)>;
+
+private:
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<Job> m_jobs;
+    bool m_quit;
+
+public:
+    /**
+     * @brief Default constructor, starts the thread.
+     */
+    WorkerThread(void);
+
+public:
+    /**
+     * @brief Default destructor, runs the remaining jobs and joins the thread.
+     */
+    ~WorkerThread(void);
+
+public:
+    /**
+     * @brief Queues a job to be run on the worker thread.
+     *
+     * @param job The function to be called.
+     */
+    void Post(Job job);
+
+private:
+    void Run(void);
+};
+
+#endif
@@ -0,0 +1,272 @@
+// Checks the http cache of Sphere360 --http-cache against a server of its
+// own on the loopback interface: reads come back intact, data read once
+// never hits the network again (in this run or the next one), the disk limit
+// holds for chunks left by an earlier run, and replies that aren't the
+// requested range (a server ignoring Range, a connection cut short) are
+// never cached:
+//
+//   HttpCacheTest
+//
+// Exits with 1 if any check fails.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Core/HttpCache.hpp>
+
+extern "C" {
+#include <libavutil/error.h>
+}
+
+#define CHUNK_SIZE (64 * 1024)
+#define RESOURCE_SIZE (5 * CHUNK_SIZE + 1234)
+
+static uint8_t resource_byte(int64_t i) {
+    return (uint8_t)(i * 31 + (i >> 8));
+}
+
+// Serves RESOURCE_SIZE bytes at any path, one request per connection. How
+// depends on the path's first component:
+//   /range/...    206 with the range asked for
+//   /norange/...  200 with the whole body, Range ignored
+//   /short/...    206, but past chunk 0 the connection closes half way
+struct TestServer {
+    int socket;
+    int port;
+    std::thread thread;
+    std::atomic<int> requests;
+};
+
+static void send_all(int connection, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = send(connection, data, size, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return;
+        }
+        data += n;
+        size -= n;
+    }
+}
+
+static void serve(TestServer* server, int connection) {
+    std::string request;
+    char buffer[4096];
+    while (request.find("\r\n\r\n") == std::string::npos) {
+        ssize_t n = recv(connection, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            return;
+        }
+        request.append(buffer, n);
+    }
+    server->requests++;
+
+    long long begin = 0, last = RESOURCE_SIZE - 1;
+    size_t range = request.find("\r\nRange: bytes=");
+    bool ranged = range != std::string::npos && request.compare(0, 12, "GET /norange") != 0;
+    if (ranged) {
+        sscanf(request.c_str() + range + 15, "%lld-%lld", &begin, &last);
+        last = std::min(last, (long long)RESOURCE_SIZE - 1);
+    }
+
+    char header[256];
+    if (ranged) {
+        snprintf(header, sizeof(header),
+                 "HTTP/1.1 206 Partial Content\r\nContent-Length: %lld\r\nContent-Range: bytes %lld-%lld/%d\r\n"
+                 "Connection: close\r\n\r\n", last - begin + 1, begin, last, RESOURCE_SIZE);
+    } else {
+        snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Length: %d\r\nConnection: close\r\n\r\n",
+                 RESOURCE_SIZE);
+    }
+    send_all(connection, header, strlen(header));
+
+    long long end = last + 1;
+    if (request.compare(0, 10, "GET /short") == 0 && begin > 0) {
+        end = begin + (end - begin) / 2;
+    }
+    std::vector<char> body(end - begin);
+    for (long long i = begin; i < end; ++i) {
+        body[i - begin] = resource_byte(i);
+    }
+    send_all(connection, body.data(), body.size());
+}
+
+static bool start_server(TestServer* server) {
+    server->requests = 0;
+    server->socket = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (server->socket < 0) {
+        printf("Couldn't create socket\n");
+        return false;
+    }
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (bind(server->socket, (sockaddr*)&address, sizeof(address)) != 0 || listen(server->socket, 16) != 0 ||
+        getsockname(server->socket, (sockaddr*)&address, &length) != 0) {
+        printf("Couldn't listen on the loopback interface\n");
+        close(server->socket);
+        return false;
+    }
+    server->port = ntohs(address.sin_port);
+
+    server->thread = std::thread([server]() {
+        while (true) {
+            int connection = accept(server->socket, NULL, NULL);
+            if (connection < 0) {
+                return;
+            }
+            serve(server, connection);
+            close(connection);
+        }
+    });
+    return true;
+}
+
+static void stop_server(TestServer* server) {
+    // Wakes up accept()
+    shutdown(server->socket, SHUT_RDWR);
+    close(server->socket);
+    server->thread.join();
+}
+
+// Reads from the start to the end or the first error, returns false on an error.
+static bool read_all(AVIOContext* io, std::vector<uint8_t>* data) {
+    data->clear();
+    if (avio_seek(io, 0, SEEK_SET) != 0) {
+        return false;
+    }
+
+    uint8_t buffer[16 * 1024];
+    while (true) {
+        int n = avio_read(io, buffer, sizeof(buffer));
+        if (n == AVERROR_EOF) {
+            return true;
+        }
+        if (n < 0) {
+            return false;
+        }
+        data->insert(data->end(), buffer, buffer + n);
+    }
+}
+
+static bool is_resource(const std::vector<uint8_t>& data) {
+    if (data.size() != RESOURCE_SIZE) {
+        return false;
+    }
+    for (int64_t i = 0; i < RESOURCE_SIZE; ++i) {
+        if (data[i] != resource_byte(i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int count_chunk_files(const std::string& dir) {
+    int count = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+        count += entry.path().extension() == ".chunk";
+    }
+    return count;
+}
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+    failures += !ok;
+}
+
+int main(int argc, char** args)
+{
+    if(argc != 1)
+    {
+        printf("Usage: %s\n", args[0]);
+        return 1;
+    }
+
+    TestServer server;
+    if(!start_server(&server))
+        return 1;
+
+    char dir[] = "/tmp/HttpCacheTestXXXXXX";
+    if(!mkdtemp(dir))
+    {
+        printf("Couldn't create a cache directory\n");
+        stop_server(&server);
+        return 1;
+    }
+
+    HttpCacheConfig config;
+    config.chunk_size = CHUNK_SIZE;
+    config.memory_chunks = 2;
+    config.disk_dir = dir;
+    config.prefetch_chunks = 2;
+
+    char url[128];
+    std::vector<uint8_t> data;
+
+    // Twice through, the second time from the cache: memory only holds two
+    // chunks, so most come back from disk
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/range/video.mp4", server.port);
+    AVIOContext* io = http_cache_io_open(url, &config);
+    check(io != NULL, "open");
+    if(io)
+    {
+        check(read_all(io, &data) && is_resource(data), "first read is intact");
+        int requests = server.requests;
+        check(http_cache_io_stats(io).bytes_fetched == RESOURCE_SIZE, "every chunk is fetched once");
+        check(read_all(io, &data) && is_resource(data), "second read is intact");
+        check(server.requests == requests, "second read doesn't hit the network");
+        check(http_cache_io_stats(io).disk_hits > 0, "second read comes from disk");
+        http_cache_io_close(&io);
+    }
+    check(count_chunk_files(dir) == (RESOURCE_SIZE + CHUNK_SIZE - 1) / CHUNK_SIZE, "every chunk is on disk");
+
+    // As the next run would, with the size and the chunks on disk
+    int requests = server.requests;
+    io = http_cache_io_open(url, &config);
+    check(io && read_all(io, &data) && is_resource(data), "reopened read is intact");
+    check(server.requests == requests, "reopened read doesn't hit the network");
+    http_cache_io_close(&io);
+
+    // The chunks of the earlier runs count against a smaller limit
+    HttpCacheConfig small_config = config;
+    small_config.disk_bytes = 2 * CHUNK_SIZE;
+    io = http_cache_io_open(url, &small_config);
+    check(io != NULL && count_chunk_files(dir) == 2, "earlier chunks are evicted down to the disk limit");
+    http_cache_io_close(&io);
+
+    // Chunk 0 of a 200 reply is the right data, the next chunks aren't
+    int chunk_files = count_chunk_files(dir);
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/norange/video.mp4", server.port);
+    io = http_cache_io_open(url, &config);
+    check(io && !read_all(io, &data) && data.size() == CHUNK_SIZE, "a server ignoring Range fails past chunk 0");
+    http_cache_io_close(&io);
+    check(count_chunk_files(dir) == chunk_files + 1, "replies ignoring Range aren't cached");
+
+    chunk_files = count_chunk_files(dir);
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/short/video.mp4", server.port);
+    io = http_cache_io_open(url, &config);
+    check(io && !read_all(io, &data) && data.size() == CHUNK_SIZE, "a reply cut short fails");
+    http_cache_io_close(&io);
+    check(count_chunk_files(dir) == chunk_files + 1, "replies cut short aren't cached");
+
+    stop_server(&server);
+    std::filesystem::remove_all(dir);
+
+    printf("%s\n", failures == 0 ? "all checks passed" : "some checks failed");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,118 @@
+// Measures the sphere mesh of Sphere360 --mesh: how long the levels of detail
+// take to build, how well their layout uses the post-transform cache
+// (against the plain row by row order the mesh used to have), and how many
+// bands and triangles are left after culling, for random views:
+//
+//   MeshBench [--lon <cells around>] [--lods <count>] [--views <count>] [--fov <degrees>]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <Core/SphereMesh.hpp>
+
+// Row by row over the whole grid, as generate_uvspehre() laid the mesh out.
+static float row_order_acmr(int lon_count, int lat_count) {
+    std::vector<uint16_t> indices;
+    for (int i = 0; i < lat_count; ++i) {
+        for (int j = 0; j < lon_count; ++j) {
+            uint16_t k1 = i * (lon_count + 1) + j;
+            uint16_t k2 = k1 + lon_count + 1;
+            if (i != 0) {
+                indices.push_back(k1);
+                indices.push_back(k2);
+                indices.push_back(k1 + 1);
+            }
+            if (i != lat_count - 1) {
+                indices.push_back(k1 + 1);
+                indices.push_back(k2);
+                indices.push_back(k2 + 1);
+            }
+        }
+    }
+    return sphere_mesh_acmr(indices.data(), indices.size(), SPHERE_MESH_CACHE_SIZE);
+}
+
+int main(int argc, char** args)
+{
+    int lon_count = 256;
+    int lod_count = 4;
+    int views = 1000;
+    float fov = 45.0f;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(args[i], "--lon") == 0 && i + 1 < argc)
+            lon_count = atoi(args[++i]);
+        else if(strcmp(args[i], "--lods") == 0 && i + 1 < argc)
+            lod_count = atoi(args[++i]);
+        else if(strcmp(args[i], "--views") == 0 && i + 1 < argc)
+            views = atoi(args[++i]);
+        else if(strcmp(args[i], "--fov") == 0 && i + 1 < argc)
+            fov = atof(args[++i]);
+        else
+        {
+            printf("Usage: %s [--lon <cells around>] [--lods <count>] [--views <count>] [--fov <degrees>]\n", args[0]);
+            return 1;
+        }
+    }
+
+    const int builds = 20;
+    SphereMesh mesh;
+    double build_time = 0.0;
+    for(int i = 0; i < builds; i++)
+    {
+        sphere_mesh_build(&mesh, lon_count, lod_count);
+        build_time += mesh.build_time;
+    }
+    printf("build: %.2f ms for %d levels, %d vertices, %d indices (%.1f KiB)\n",
+        build_time / builds * 1000.0, (int)mesh.lods.size(), (int)mesh.vertices.size(), (int)mesh.indices.size(),
+        (mesh.vertices.size() * sizeof(SphereVertex) + mesh.indices.size() * sizeof(uint16_t)) / 1024.0);
+
+    for(size_t lod = 0; lod < mesh.lods.size(); lod++)
+    {
+        const SphereLod& level = mesh.lods[lod];
+        printf("lod %d: %dx%d cells, %u vertices, %u triangles, acmr %.3f (row order %.3f)\n",
+            (int)lod, level.lon_count, level.lat_count, level.vertex_count, level.index_count / 3,
+            level.acmr, row_order_acmr(level.lon_count, level.lat_count));
+    }
+
+    // The camera of Sphere360, looking at the sphere turned every which way
+    glm::mat4 proj = glm::perspective(glm::radians(fov), 16.0f / 9.0f, 0.1f, 1000.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 15.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    srand(1);
+
+    for(size_t lod = 0; lod < mesh.lods.size(); lod++)
+    {
+        SphereMeshDraws draws;
+        int64_t bands = 0, triangles = 0, ranges = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for(int i = 0; i < views; i++)
+        {
+            glm::mat4 model(1.0f);
+            model = glm::rotate(model, glm::radians(rand() % 360 * 1.0f), glm::vec3(0.0, 1.0, 0.0));
+            model = glm::rotate(model, glm::radians(rand() % 360 * 1.0f), glm::vec3(1.0, 0.0, 0.0));
+            model = glm::scale(model, glm::vec3(10.0f));
+
+            sphere_mesh_cull(&mesh, lod, proj * view * model, &draws);
+            bands += draws.bands;
+            triangles += draws.triangles;
+            ranges += draws.counts.size();
+        }
+        double cull_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / views;
+
+        const SphereLod& level = mesh.lods[lod];
+        printf("lod %d culled: %.1f of %d bands in %.1f draws, %.0f%% of the triangles, %.1f us\n",
+            (int)lod, (double)bands / views, (int)level.bands.size(), (double)ranges / views,
+            100.0 * triangles / views / (level.index_count / 3), cull_time * 1000000.0);
+    }
+
+    return 0;
+}
@@ -0,0 +1,195 @@
+// Cuts an equirectangular video into a grid of tiles for viewport-adaptive
+// playback (Sphere360 --tiles). Every tile is encoded as its own file, all
+// with keyframes on the same frames, next to a low resolution base layer and
+// a manifest listing them:
+//
+//   Tiler [--grid <columns>x<rows>] [--base-width <pixels>] [--keyint <frames>]
+//         [--codec <encoder>] [--bitrate <kbit/s per tile>] <input> <output dir>
+//
+// The output directory has to exist. Tiles are encoded in parallel.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <Core/ThreadPool.hpp>
+#include <Core/TileManifest.hpp>
+#include <Core/VideoReader.hpp>
+#include <Core/VideoWriter.hpp>
+
+struct TileJob {
+    int x, y, width, height;    // region of the source frame
+    VideoWriterState writer;
+    bool ok;
+};
+
+// Tile edges fall on even pixels so 4:2:0 encoders accept every tile size.
+static int tile_edge(int index, int count, int size) {
+    return (int)((int64_t)index * size / count) & ~1;
+}
+
+int main(int argc, char** args)
+{
+    int columns = 8;
+    int rows = 4;
+    int base_width = 1024;
+    VideoWriterOptions writer_options;
+    const char* input = nullptr;
+    const char* output_dir = nullptr;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(args[i], "--grid") == 0 && i + 1 < argc)
+            sscanf(args[++i], "%dx%d", &columns, &rows);
+        else if(strcmp(args[i], "--base-width") == 0 && i + 1 < argc)
+            base_width = atoi(args[++i]);
+        else if(strcmp(args[i], "--keyint") == 0 && i + 1 < argc)
+            writer_options.keyframe_interval = atoi(args[++i]);
+        else if(strcmp(args[i], "--codec") == 0 && i + 1 < argc)
+            writer_options.codec = args[++i];
+        else if(strcmp(args[i], "--bitrate") == 0 && i + 1 < argc)
+            writer_options.bit_rate = atoll(args[++i]) * 1000;
+        else if(!input)
+            input = args[i];
+        else if(!output_dir)
+            output_dir = args[i];
+    }
+
+    if(!input || !output_dir || columns <= 0 || rows <= 0 || base_width <= 0)
+    {
+        printf("Usage: %s [--grid <columns>x<rows>] [--base-width <pixels>] [--keyint <frames>]\n", args[0]);
+        printf("       [--codec <encoder>] [--bitrate <kbit/s per tile>] <input> <output dir>\n");
+        return 1;
+    }
+
+    VideoReaderState reader;
+    if(!video_reader_open(&reader, input))
+    {
+        printf("Couldn't open %s\n", input);
+        return 1;
+    }
+
+    int width = reader.width;
+    int height = reader.height;
+    AVStream* stream = reader.av_format_ctx->streams[reader.video_stream_index];
+    AVRational frame_rate = stream->avg_frame_rate;
+
+    // Each tile encoder gets one thread, the pool provides the parallelism.
+    ThreadPool pool;
+    writer_options.thread_count = 1;
+
+    std::string dir = output_dir;
+    if(dir.back() != '/' && dir.back() != '\\')
+        dir += '/';
+
+    TileManifest manifest;
+    manifest.columns = columns;
+    manifest.rows = rows;
+    manifest.width = width;
+    manifest.height = height;
+    manifest.base = TileStream{ "base.mp4", -1 };
+
+    std::vector<TileJob> jobs(columns * rows + 1);
+    bool ok = true;
+
+    for(int i = 0; i < columns * rows; i++)
+    {
+        int column = i % columns;
+        int row = i / columns;
+
+        TileJob& job = jobs[i];
+        job.x = tile_edge(column, columns, width);
+        job.y = tile_edge(row, rows, height);
+        job.width = tile_edge(column + 1, columns, width) - job.x;
+        job.height = tile_edge(row + 1, rows, height) - job.y;
+
+        std::string name = "tile_" + std::to_string(column) + "_" + std::to_string(row) + ".mp4";
+        manifest.tiles.push_back(TileStream{ name, -1 });
+
+        ok = video_writer_open(&job.writer, (dir + name).c_str(), job.width, job.height,
+                               reader.time_base, frame_rate, &writer_options) && ok;
+    }
+
+    // The base layer covers the whole frame at a reduced size.
+    TileJob& base = jobs.back();
+    base.x = 0;
+    base.y = 0;
+    base.width = width;
+    base.height = height;
+    int base_height = (int)((int64_t)base_width * height / width) & ~1;
+    ok = video_writer_open(&base.writer, (dir + manifest.base.url).c_str(), base_width & ~1, base_height,
+                           reader.time_base, frame_rate, &writer_options) && ok;
+
+    // Two frame buffers: the next frame is decoded while the last one is encoded.
+    int linesize = width * 4;
+    uint8_t* frame_buffers[2] = {
+        (uint8_t*)av_malloc(linesize * height),
+        (uint8_t*)av_malloc(linesize * height),
+    };
+    if(!frame_buffers[0] || !frame_buffers[1])
+    {
+        printf("Couldn't allocate frame buffers\n");
+        ok = false;
+    }
+
+    int64_t pts;
+    int current = 0;
+    int64_t frames = 0;
+    bool has_frame = ok && video_reader_read_frame(&reader, &frame_buffers[current], &pts);
+
+    for(TileJob& job : jobs)
+        job.ok = true;
+
+    while(ok && has_frame)
+    {
+        const uint8_t* frame = frame_buffers[current];
+        for(TileJob& job : jobs)
+        {
+            TileJob* job_ptr = &job;
+            pool.Submit([job_ptr, frame, linesize, pts]() {
+                const uint8_t* src = frame + job_ptr->y * linesize + job_ptr->x * 4;
+                job_ptr->ok = job_ptr->ok &&
+                    video_writer_write_frame(&job_ptr->writer, src, linesize, job_ptr->width, job_ptr->height, pts);
+            });
+        }
+
+        current = 1 - current;
+        int64_t next_pts;
+        has_frame = video_reader_read_frame(&reader, &frame_buffers[current], &next_pts);
+
+        pool.Wait();
+        pts = next_pts;
+
+        for(TileJob& job : jobs)
+            ok = ok && job.ok;
+
+        if(++frames % 100 == 0)
+            printf("%lld frames\n", (long long)frames);
+    }
+
+    if(ok && !reader.eof)
+    {
+        printf("Couldn't read all frames of %s\n", input);
+        ok = false;
+    }
+
+    for(TileJob& job : jobs)
+        ok = video_writer_close(&job.writer) && ok;
+
+    av_free(frame_buffers[0]);
+    av_free(frame_buffers[1]);
+    video_reader_close(&reader);
+
+    if(!ok)
+        return 1;
+
+    std::string manifest_path = dir + "tiles.txt";
+    if(!tile_manifest_save(manifest_path.c_str(), manifest))
+        return 1;
+
+    printf("Wrote %lld frames as %dx%d tiles, manifest %s\n", (long long)frames, columns, rows, manifest_path.c_str());
+    return EXIT_SUCCESS;
+}